@@ -0,0 +1,379 @@
+/* Ahead-of-time compilation to native code.
+   A register becomes a C variable, i<n> for an int and r<n> for a real,
+   and the spare register that breaks cycles of copies is both.  Each
+   jump target gets a label.  The compiler is run directly, not through
+   the shell, on a file written under a temporary name; its output is
+   renamed into place when done, so a reader never loads half of one.
+   The C source is kept beside it, and renamed into place first, so that
+   a shared object found under a program's name is loaded only if it was
+   compiled from that program, not from another whose hash is the same.
+*/
+
+#include <charconv>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "aot.hpp"
+#include "hash.hpp"
+#include "io.hpp"
+
+extern char **environ;
+
+namespace
+{
+
+// The interface between a compiled program and the process that loads
+// it, here and in the C source.
+struct calc_io
+{
+    int (*read_int)(void *ctx, int64_t *v);
+    int (*read_real)(void *ctx, double *v);
+    void (*write_int)(void *ctx, int64_t v);
+    void (*write_real)(void *ctx, double v);
+    void (*error)(void *ctx, const char *message);
+};
+
+const char *const PROLOGUE =
+    "#include <stdint.h>\n"
+    "struct calc_io\n"
+    "{\n"
+    "    int (*read_int)(void *ctx, int64_t *v);\n"
+    "    int (*read_real)(void *ctx, double *v);\n"
+    "    void (*write_int)(void *ctx, int64_t v);\n"
+    "    void (*write_real)(void *ctx, double v);\n"
+    "    void (*error)(void *ctx, const char *message);\n"
+    "};\n"
+    "#define FAIL(m) do { io->error(ctx, m); return 0; } while (0)\n"
+    "int calc_main(const struct calc_io *io, void *ctx)\n"
+    "{\n";
+
+typedef int entry_point(const calc_io *, void *);
+
+class translation
+{
+    const vm_program &p;
+    std::ostringstream c;
+
+    // The variable for register n, holding a value of type t.
+    string var(uint32_t n, ir_type t) const
+    {
+        if (p.types[n] != ir_void)
+            t = p.types[n];
+        return (t == ir_real ? "r" : "i") + std::to_string(n);
+    }
+
+    string var(uint32_t n) const
+    {
+        return var(n, p.types[n]);
+    }
+
+    string real(double v) const
+    {
+        if (std::isinf(v))
+            return v > 0 ? "(1.0 / 0.0)" : "(-1.0 / 0.0)";
+        char buf[32];
+        *std::to_chars(buf, buf + sizeof buf - 1, v).ptr = 0;
+        string s = buf;
+        if (s.find_first_of(".en") == string::npos)
+            s += ".0";
+        return s;
+    }
+
+    void binary(const vm_inst &x, const char *op, bool wraps)
+    {
+        c << "    " << var(x.a) << " = ";
+        if (wraps)
+            c << "(int64_t)((uint64_t)" << var(x.b) << ' ' << op << " (uint64_t)" << var(x.c)
+              << ");\n";
+        else
+            c << var(x.b) << ' ' << op << ' ' << var(x.c) << ";\n";
+    }
+
+public:
+    explicit translation(const vm_program &p) : p(p) {}
+
+    string source()
+    {
+        c << PROLOGUE;
+        for (uint32_t n = 0; n < p.registers; n++)
+        {
+            if (n < p.constants.size())
+            {
+                if (p.types[n] == ir_real)
+                    c << "    const double " << var(n) << " = " << real(p.constants[n].r) << ";\n";
+                else
+                    c << "    const int64_t " << var(n) << " = (int64_t)" << uint64_t(p.constants[n].i)
+                      << "ULL;\n";
+            }
+            else if (p.types[n] == ir_void)
+                c << "    int64_t i" << n << " = 0;\n    double r" << n << " = 0;\n";
+            else
+                c << "    " << (p.types[n] == ir_real ? "double " : "int64_t ") << var(n) << " = 0;\n";
+        }
+        std::set<uint32_t> targets;
+        for (const vm_inst &x : p.code)
+            if (x.op == vm_jump)
+                targets.insert(x.a);
+            else if (x.op == vm_jump_if || x.op == vm_jump_unless)
+                targets.insert(x.b);
+
+        static const char *const arith[] = {"+", "-", "*", "/"};
+        static const char *const compare[] = {"==", "!=", "<", ">", "<=", ">="};
+        for (uint32_t k = 0; k < p.code.size(); k++)
+        {
+            const vm_inst &x = p.code[k];
+            vm_op op = unfused(x.op);
+            if (targets.count(k))
+                c << "L" << k << ":\n";
+            switch (op)
+            {
+            case vm_mov:
+            {
+                ir_type t = p.types[x.a] != ir_void ? p.types[x.a] : p.types[x.b];
+                c << "    " << var(x.a, t) << " = " << var(x.b, t) << ";\n";
+                break;
+            }
+            case vm_add_i:
+            case vm_sub_i:
+            case vm_mul_i:
+                binary(x, arith[op - vm_add_i], true);
+                break;
+            case vm_div_i:
+                c << "    if (" << var(x.c) << " == 0)\n        FAIL(\"division by zero\");\n    "
+                  << var(x.a) << " = " << var(x.c) << " == -1 ? (int64_t)(0 - (uint64_t)"
+                  << var(x.b) << ") : " << var(x.b) << " / " << var(x.c) << ";\n";
+                break;
+            case vm_add_r:
+            case vm_sub_r:
+            case vm_mul_r:
+            case vm_div_r:
+                binary(x, arith[op - vm_add_r], false);
+                break;
+            case vm_trunc:
+                c << "    if (!(" << var(x.b) << " >= -9223372036854775808.0 && " << var(x.b)
+                  << " < 9223372036854775808.0))\n        FAIL(\"trunc of a real out of the range of int\");\n    "
+                  << var(x.a) << " = (int64_t)" << var(x.b) << ";\n";
+                break;
+            case vm_float:
+                c << "    " << var(x.a) << " = (double)" << var(x.b) << ";\n";
+                break;
+            case vm_eq_i:
+            case vm_ne_i:
+            case vm_lt_i:
+            case vm_gt_i:
+            case vm_le_i:
+            case vm_ge_i:
+                binary(x, compare[op - vm_eq_i], false);
+                break;
+            case vm_eq_r:
+            case vm_ne_r:
+            case vm_lt_r:
+            case vm_gt_r:
+            case vm_le_r:
+            case vm_ge_r:
+                binary(x, compare[op - vm_eq_r], false);
+                break;
+            case vm_read_i:
+                c << "    {\n        int64_t v;\n        if (!io->read_int(ctx, &v))\n"
+                     "            return 0;\n        "
+                  << var(x.a) << " = v;\n    }\n";
+                break;
+            case vm_read_r:
+                c << "    {\n        double v;\n        if (!io->read_real(ctx, &v))\n"
+                     "            return 0;\n        "
+                  << var(x.a) << " = v;\n    }\n";
+                break;
+            case vm_write_i:
+                c << "    io->write_int(ctx, " << var(x.a) << ");\n";
+                break;
+            case vm_write_r:
+                c << "    io->write_real(ctx, " << var(x.a) << ");\n";
+                break;
+            case vm_jump:
+                c << "    goto L" << x.a << ";\n";
+                break;
+            case vm_jump_if:
+                c << "    if (" << var(x.a) << ")\n        goto L" << x.b << ";\n";
+                break;
+            case vm_jump_unless:
+                c << "    if (!" << var(x.a) << ")\n        goto L" << x.b << ";\n";
+                break;
+            case vm_halt:
+                c << "    return 1;\n";
+                break;
+            default: // a superinstruction, which unfused() has taken apart
+                break;
+            }
+        }
+        // A label must label a statement.
+        c << "    return 1;\n}\n";
+        return c.str();
+    }
+};
+
+// Where a compiled program reads, writes and reports its errors.
+struct streams
+{
+    value_output out;
+    value_input in;
+    std::ostream &diag;
+
+    streams(std::istream &in, std::ostream &out, std::ostream &diag)
+        : out(out), in(in, &this->out), diag(diag)
+    {
+    }
+};
+
+int fail(streams *s, const char *message)
+{
+    s->out.flush();
+    s->diag << "runtime error: " << message << std::endl;
+    return 0;
+}
+
+template <class T>
+int read_value(void *ctx, T *v)
+{
+    streams *s = static_cast<streams *>(ctx);
+    const char *wrong = s->in.read(*v);
+    return wrong ? fail(s, wrong) : 1;
+}
+
+template <class T>
+void write_value(void *ctx, T v)
+{
+    static_cast<streams *>(ctx)->out.write(v);
+}
+
+void report(void *ctx, const char *message)
+{
+    fail(static_cast<streams *>(ctx), message);
+}
+
+const calc_io IO = {read_value<int64_t>, read_value<double>, write_value<int64_t>,
+                    write_value<double>, report};
+
+// Runs cc to compile source into the shared object path.so, keeping
+// source in path.c.  What cc says
+// goes to diag only if it fails: warnings about the generated code, such
+// as of a division by a constant zero the program may never reach, are
+// not the user's business, and -w quiets most of them anyway.
+bool build(const string &source, const string &path, const string &cc, std::ostream &diag)
+{
+    string so = path + ".so", tmp = so + ".tmp." + std::to_string(getpid());
+    string c_file = tmp + ".c";
+    {
+        std::ofstream f(c_file, std::ios::binary);
+        f << source;
+        if (!f.flush())
+        {
+            diag << "cannot write " << c_file << std::endl;
+            return false;
+        }
+    }
+    std::vector<string> args = {cc, "-O2", "-w", "-fPIC", "-shared", "-o", tmp, c_file};
+    std::vector<char *> argv;
+    for (string &a : args)
+        argv.push_back(&a[0]);
+    argv.push_back(nullptr);
+
+    // cc's output and errors, into a pipe read until cc closes it.
+    int said[2];
+    if (pipe2(said, O_CLOEXEC) != 0)
+    {
+        std::remove(c_file.c_str());
+        diag << "cannot compile with " << cc << ": no pipe" << std::endl;
+        return false;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, said[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, said[1], 2);
+    pid_t pid;
+    bool spawned = posix_spawnp(&pid, cc.c_str(), &actions, nullptr, argv.data(), environ) == 0;
+    posix_spawn_file_actions_destroy(&actions);
+    close(said[1]);
+    string output;
+    char chunk[4096];
+    for (ssize_t n; spawned && (n = read(said[0], chunk, sizeof chunk)) != 0;)
+        if (n > 0)
+            output.append(chunk, n);
+        else if (errno != EINTR)
+            break;
+    close(said[0]);
+    int status = 0;
+    bool ok = spawned && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+              WEXITSTATUS(status) == 0;
+    if (!ok || std::rename(c_file.c_str(), (path + ".c").c_str()) != 0 ||
+        std::rename(tmp.c_str(), so.c_str()) != 0)
+    {
+        std::remove(c_file.c_str());
+        std::remove(tmp.c_str());
+        diag << "cannot compile with " << cc << std::endl << output;
+        return false;
+    }
+    return true;
+}
+
+// Whether the file at path holds exactly text.
+bool holds(const string &path, const string &text)
+{
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f || f.tellg() != std::streamoff(text.size()))
+        return false;
+    string got(text.size(), '\0');
+    f.seekg(0);
+    return f.read(&got[0], got.size()) && got == text;
+}
+
+} // namespace
+
+string to_c(const vm_program &p)
+{
+    return translation(p).source();
+}
+
+native_program::~native_program()
+{
+    if (handle)
+        dlclose(handle);
+}
+
+bool native_program::load(const vm_program &p, const string &dir, std::ostream &diag,
+                          const string &cc)
+{
+    string source = to_c(p);
+    char name[64];
+    std::snprintf(name, sizeof name, "/%016llx-%llu",
+                  (unsigned long long)hash64(source.data(), source.size()),
+                  (unsigned long long)source.size());
+    string path = dir + name, so = path + ".so";
+    was_cached = access(so.c_str(), R_OK) == 0 && holds(path + ".c", source);
+    if (!was_cached && !build(source, path, cc, diag))
+        return false;
+    if (handle)
+        dlclose(handle);
+    handle = dlopen(so.c_str(), RTLD_NOW | RTLD_LOCAL);
+    entry = handle ? dlsym(handle, "calc_main") : nullptr;
+    if (!entry)
+    {
+        diag << "cannot load " << so << ": " << dlerror() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool native_program::run(std::istream &in, std::ostream &out, std::ostream &diag) const
+{
+    streams s(in, out, diag);
+    return reinterpret_cast<entry_point *>(entry)(&IO, &s) != 0;
+}
@@ -0,0 +1,54 @@
+/* Ahead-of-time compilation of calculator programs to native code.  The
+   register code of the VM (vm.hpp) is translated to C, a statement for
+   each instruction, and the system's C compiler makes a shared object of
+   it, which is loaded with dlopen().  Shared objects are kept in a
+   directory, named by the hash of their C source and with the source
+   beside them, so that a program run again is loaded without being
+   compiled again, once the source is seen to be the same.
+*/
+
+#ifndef AOT_HPP
+#define AOT_HPP
+
+#include <iostream>
+#include <string>
+
+#include "vm.hpp"
+
+// C source defining
+//   int calc_main(const struct calc_io *io, void *ctx)
+// which does what run() would do with p, reading and writing through the
+// functions in io, and returns 1, or 0 after a runtime error.
+std::string to_c(const vm_program &p);
+
+class native_program
+{
+public:
+    native_program() = default;
+    ~native_program();
+    native_program(const native_program &) = delete;
+    native_program &operator=(const native_program &) = delete;
+
+    // Loads p compiled from dir, compiling it with the command cc first
+    // if it is not there.  Returns false, having written a line to diag,
+    // and after it what cc said, if it could not be compiled or loaded.
+    // What cc says when it succeeds is not shown.
+    bool load(const vm_program &p, const std::string &dir, std::ostream &diag = std::cerr,
+              const std::string &cc = "cc");
+
+    // Whether load() found the program compiled already.
+    bool cached() const
+    {
+        return was_cached;
+    }
+
+    // As run() in vm.hpp, but natively, and without counting.
+    bool run(std::istream &in, std::ostream &out, std::ostream &diag = std::cerr) const;
+
+private:
+    void *handle = nullptr;
+    void *entry = nullptr;
+    bool was_cached = false;
+};
+
+#endif
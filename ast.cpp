@@ -0,0 +1,71 @@
+/* Printing of syntax trees.
+*/
+
+#include "ast.hpp"
+#include "parse.hpp"
+
+void print(std::ostream &o, const expr_ptr &e)
+{
+    if (!e)
+        o << "?";
+    else if (e->op == t_id || e->op == t_i_num || e->op == t_r_num)
+        o << e->text;
+    else if (!e->right)
+    {
+        o << "(" << names[e->op] << " ";
+        print(o, e->left);
+        o << ")";
+    }
+    else
+    {
+        o << "(" << names[e->op] << " ";
+        print(o, e->left);
+        o << " ";
+        print(o, e->right);
+        o << ")";
+    }
+}
+
+void print(std::ostream &o, const stmt_ptr &s, int indent)
+{
+    o << string(2 * indent, ' ');
+    if (!s)
+    {
+        o << "?\n";
+        return;
+    }
+    o << "(" << names[s->kind];
+    switch (s->kind)
+    {
+    case t_int:
+    case t_real:
+    case t_id:
+        o << " " << s->id << " ";
+        print(o, s->value);
+        break;
+    case t_read:
+        o << " " << names[s->type] << " " << s->id;
+        break;
+    case t_write:
+        o << " ";
+        print(o, s->value);
+        break;
+    default:
+        o << " (" << names[s->cond.rel] << " ";
+        print(o, s->cond.left);
+        o << " ";
+        print(o, s->cond.right);
+        o << ")\n";
+        for (auto &b : s->body)
+            print(o, b, indent + 1);
+        o << string(2 * indent, ' ');
+        break;
+    }
+    o << ")\n";
+}
+
+void print(std::ostream &o, const std::vector<stmt_ptr> &program)
+{
+    for (auto &s : program)
+        print(o, s);
+}
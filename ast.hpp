@@ -0,0 +1,76 @@
+/* Syntax trees for the calculator language.
+   Nodes are immutable once built and are shared by pointer, so parts of
+   a tree can be kept across an edit of the program or handed to other
+   threads without copying.
+*/
+
+#ifndef AST_HPP
+#define AST_HPP
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "scan.hpp"
+
+struct expr_node;
+struct stmt_node;
+typedef std::shared_ptr<const expr_node> expr_ptr;
+typedef std::shared_ptr<const stmt_node> stmt_ptr;
+
+// An expression.  op is t_id, t_i_num or t_r_num for a leaf; t_add,
+// t_sub, t_mul or t_div for a binary operator; or t_trunc or t_float for
+// a conversion of left.  Parts lost to a syntax error are null.
+struct expr_node
+{
+    token op;
+    string text; // image of an id or literal
+    expr_ptr left, right;
+};
+
+// left rel right, where rel is one of t_equal ... t_greater_or_equal, or
+// t_eof if it was missing.
+struct cond_node
+{
+    token rel = t_eof;
+    expr_ptr left, right;
+};
+
+// A statement.  kind is the token that begins it: t_int or t_real for a
+// declaration, t_id for an assignment, t_read, t_write, t_if or t_while.
+// type is the type named in a read, or t_id if there was none.  offset
+// is that of its first token, from where the parser began reading.
+struct stmt_node
+{
+    token kind;
+    token type = t_id;
+    size_t offset = 0;
+    string id;
+    expr_ptr value;
+    cond_node cond;
+    std::vector<stmt_ptr> body;
+};
+
+inline expr_ptr make_leaf(token op, const string &text)
+{
+    return std::make_shared<const expr_node>(expr_node{op, text, nullptr, nullptr});
+}
+
+inline expr_ptr make_binary(token op, expr_ptr left, expr_ptr right)
+{
+    return std::make_shared<const expr_node>(expr_node{op, "", std::move(left), std::move(right)});
+}
+
+inline expr_ptr make_unary(token op, expr_ptr operand)
+{
+    return std::make_shared<const expr_node>(expr_node{op, "", std::move(operand), nullptr});
+}
+
+// Prints a tree in a Lisp-like notation, one statement per line, so two
+// trees can be compared by comparing their printed forms.
+void print(std::ostream &o, const expr_ptr &e);
+void print(std::ostream &o, const stmt_ptr &s, int indent = 0);
+void print(std::ostream &o, const std::vector<stmt_ptr> &program);
+
+#endif
@@ -0,0 +1,65 @@
+/* Running one program over many rows, a row at a time on the VM, in one
+   frame, reading the input columns and writing the output columns
+   directly, with no text in between.
+*/
+
+#include <sstream>
+
+#include "batch.hpp"
+
+namespace
+{
+
+// A row's reads and writes.
+class row_values : public vm_values
+{
+    const batch_input &in;
+    batch_output &out;
+    size_t r;
+    uint32_t reads = 0;
+
+public:
+    row_values(const batch_input &in, batch_output &out, size_t r) : in(in), out(out), r(r) {}
+
+    const char *read(vm_value &v, ir_type) override
+    {
+        if (reads >= in.columns.size())
+            return "no more input";
+        v = in.columns[reads++][r];
+        return nullptr;
+    }
+
+    void write(vm_value v, ir_type t) override
+    {
+        uint32_t k = out.counts[r]++;
+        if (k == out.columns.size())
+        {
+            out.columns.emplace_back(in.rows);
+            out.types.emplace_back(in.rows, ir_void);
+        }
+        out.columns[k][r] = v;
+        out.types[k][r] = t;
+    }
+};
+
+} // namespace
+
+void run_batch(const vm_program &p, const batch_input &in, batch_output &out)
+{
+    out.columns.clear();
+    out.types.clear();
+    out.counts.assign(in.rows, 0);
+    out.errors.assign(in.rows, string());
+    vm_frame frame;
+    std::ostringstream diag;
+    for (size_t r = 0; r < in.rows; r++)
+    {
+        row_values values(in, out, r);
+        if (!run(p, frame, values, diag))
+        {
+            out.errors[r] = diag.str();
+            out.errors[r].pop_back(); // the newline
+            diag.str("");
+        }
+    }
+}
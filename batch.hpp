@@ -0,0 +1,42 @@
+/* Running one program over many independent rows of input.  A row is
+   one run of the program: the values its reads take, in order, and the
+   values its writes give.  Input and output are kept by column, so that
+   column k holds the k-th value read, or written, by each row.
+
+   Rows run one at a time on the VM (vm.hpp), in one frame, taking their
+   values from the columns and putting them there directly.  Stepping 64
+   rows together, an instruction at a time for all of them, measured no
+   better (bench/batch, 0.7-1.2x) and worse where rows loop different
+   numbers of times, so it was not kept.
+*/
+
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <string>
+#include <vector>
+
+#include "vm.hpp"
+
+struct batch_input
+{
+    size_t rows = 0;
+    std::vector<std::vector<vm_value>> columns; // each of rows values, of
+                                                // the type the program reads
+};
+
+struct batch_output
+{
+    std::vector<std::vector<vm_value>> columns; // each of as many values as rows
+    std::vector<std::vector<ir_type>> types;    // of each value in columns
+    std::vector<uint32_t> counts;               // of values written, by row
+    std::vector<std::string> errors;            // by row: its runtime error, if any
+};
+
+// Runs p once for each row of in, into out.  A row whose run stops at a
+// runtime error, or reads more values than in has columns, has the
+// diagnostic run() would have given in out.errors, and keeps what it
+// wrote before.
+void run_batch(const vm_program &p, const batch_input &in, batch_output &out);
+
+#endif
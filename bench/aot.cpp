@@ -0,0 +1,171 @@
+/* Native code against the VM.  Compiles each program of the corpus to a
+   shared object, once into an empty directory and then again, when it
+   should be found there, and runs it both natively and on the VM.  The
+   output, diagnostics and success of the two must be the same, also on
+   programs that end in a runtime error.  Last, one program's shared
+   object is put under another's name, as if their hashes were the same,
+   and must not be run for it.
+     usage: bench/aot
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "aot.hpp"
+#include "corpus.hpp"
+#include "hash.hpp"
+
+using std::cout;
+
+template <class F>
+static double seconds(F f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Where load() keeps p in dir, without the extension.
+static string path_of(const string &dir, const vm_program &p)
+{
+    string source = to_c(p);
+    char name[64];
+    std::snprintf(name, sizeof name, "/%016llx-%zu",
+                  (unsigned long long)hash64(source.data(), source.size()), source.size());
+    return dir + name;
+}
+
+static void copy(const string &from, const string &to)
+{
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream(to, std::ios::binary) << in.rdbuf();
+}
+
+struct outcome
+{
+    string output, diagnostics;
+    bool ok;
+    bool operator!=(const outcome &o) const
+    {
+        return output != o.output || diagnostics != o.diagnostics || ok != o.ok;
+    }
+};
+
+// Programs that stop with a runtime error part of the way through.
+const corpus_program failing[] = {
+    {"zero", "read int n; int i := 10; while i > n do write 100 / (i - 5); i := i - 1; end;", "0"},
+    {"trunc", "real x := 1.0; while 0 < 1 do write trunc(x); x := x * 1000.0; end;", ""},
+    {"input", "read int n; read real x; write float(n) * x; read int m;", "3 0.5"},
+    {"bad input", "read int n; write n; read real x; write x;", "7 seven"},
+    {"wrap", "int x := 9223372036854775807; write x + 1; write (0 - x - 1) / (0 - 1);", ""},
+};
+
+int main()
+{
+    char dir[] = "/tmp/parse-aot-XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        cout << "cannot make a directory for the compiled programs\n";
+        return 1;
+    }
+    bool ok = true;
+    cout << std::left << std::setw(10) << "program" << std::right << std::setw(12) << "compile ms"
+         << std::setw(10) << "load ms" << std::setw(9) << "vm ms" << std::setw(12) << "native ms"
+         << std::setw(9) << "speedup\n";
+    auto check = [&](const corpus_program &c, bool timed) {
+        std::istringstream text(c.text);
+        vm_program p;
+        if (!compile(text, p, true, cout))
+        {
+            cout << "MISMATCH: " << c.name << " does not compile\n";
+            ok = false;
+            return;
+        }
+        native_program cold, warm;
+        double t_compile = seconds([&] { ok = cold.load(p, dir, cout) && ok; });
+        double t_load = seconds([&] { ok = warm.load(p, dir, cout) && ok; });
+        if (cold.cached() || !warm.cached())
+        {
+            cout << "MISMATCH: " << c.name << " was compiled " << (cold.cached() ? "never" : "twice")
+                 << '\n';
+            ok = false;
+        }
+        outcome vm, native;
+        std::ostringstream out, diag;
+        double t_vm = seconds([&] {
+            std::istringstream in(c.input);
+            vm.ok = run(p, in, out, diag);
+        });
+        vm.output = out.str();
+        vm.diagnostics = diag.str();
+        out.str("");
+        diag.str("");
+        double t_native = seconds([&] {
+            std::istringstream in(c.input);
+            native.ok = warm.run(in, out, diag);
+        });
+        native.output = out.str();
+        native.diagnostics = diag.str();
+        if (native != vm)
+        {
+            cout << "MISMATCH: " << c.name << " wrote\n"
+                 << vm.output << vm.diagnostics << "on the VM, but\n"
+                 << native.output << native.diagnostics << "natively\n";
+            ok = false;
+        }
+        if (timed)
+            cout << std::left << std::setw(10) << c.name << std::right << std::fixed
+                 << std::setprecision(1) << std::setw(12) << t_compile * 1e3 << std::setw(10)
+                 << t_load * 1e3 << std::setw(9) << t_vm * 1e3 << std::setw(12) << t_native * 1e3
+                 << std::setw(7) << t_vm / t_native << "x\n";
+    };
+    for (const corpus_program &c : corpus)
+        check(c, true);
+    for (const corpus_program &c : failing)
+        check(c, false);
+    cout << sizeof failing / sizeof failing[0] << " programs with runtime errors checked\n";
+
+    // The first failing program's files under the name of the second.
+    vm_program first, second;
+    std::istringstream first_text(failing[0].text), second_text(failing[1].text);
+    if (compile(first_text, first, true, cout) && compile(second_text, second, true, cout))
+    {
+        string from = path_of(dir, first), to = path_of(dir, second);
+        copy(from + ".so", to + ".so");
+        copy(from + ".c", to + ".c");
+        outcome vm, native;
+        std::ostringstream out, diag;
+        std::istringstream in(failing[1].input);
+        vm.ok = run(second, in, out, diag);
+        vm.output = out.str();
+        vm.diagnostics = diag.str();
+        out.str("");
+        diag.str("");
+        in.clear();
+        in.str(failing[1].input);
+        native_program planted;
+        bool loaded = planted.load(second, dir, cout);
+        native.ok = loaded && planted.run(in, out, diag);
+        native.output = out.str();
+        native.diagnostics = diag.str();
+        if (!loaded || planted.cached() || native != vm)
+        {
+            cout << "MISMATCH: " << failing[1].name << " ran the code of " << failing[0].name
+                 << ", found under its name\n";
+            ok = false;
+        }
+    }
+    else
+        ok = false;
+
+    string rm = string("rm -rf ") + dir;
+    if (std::system(rm.c_str()) != 0)
+        cout << "could not remove " << dir << "\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+/* One program over many rows: run_batch() against running the VM once
+   for each row here.  The programs range from straight-line arithmetic
+   to loops that go round a different number of times in each row.  Each
+   row's output and errors must be those of the VM.  Both take the values
+   from memory and put them there, with no text in between.
+     usage: bench/batch [rows]
+*/
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "batch.hpp"
+
+using std::cout;
+
+struct row_program
+{
+    const char *name;
+    const char *text;
+    const char *reads; // i or r for each value read
+};
+
+const row_program programs[] = {
+    {"straight",
+     "read real x; read real y; read int k;\n"
+     "real z := x * x * 3.0 + x * y - y / 2.0;\n"
+     "write z; write trunc(z) + k * k; write float(k) * x - y;\n",
+     "rri"},
+    {"branchy",
+     "read int a; read int b;\n"
+     "int lo := a; int hi := b;\n"
+     "if a > b then lo := b; hi := a; end;\n"
+     "if hi - lo > 500000 then hi := lo + 500000; end;\n"
+     "write hi - lo; write (hi + lo) / 2;\n",
+     "ii"},
+    {"compound",
+     "read real p; read real rate; read int years;\n"
+     "int k := 0;\n"
+     "while k < years do p := p * (1.0 + rate); k := k + 1; end;\n"
+     "write p;\n",
+     "rri"},
+    {"collatz",
+     "read int n; int steps := 0;\n"
+     "while n > 1 do\n"
+     "  int half := n / 2;\n"
+     "  if n - half * 2 == 1 then n := 3 * n + 1; end;\n"
+     "  if n - half * 2 == 0 then n := half; end;\n"
+     "  steps := steps + 1;\n"
+     "end;\n"
+     "write steps;\n",
+     "i"},
+    {"faulty",
+     "read int a; read int b; write a / b; write trunc(float(a) * 1.0e17);\n",
+     "ii"},
+};
+
+static string text_of(vm_value v, ir_type t)
+{
+    char buf[32];
+    char *end = t == ir_real ? std::to_chars(buf, buf + sizeof buf, v.r).ptr
+                             : std::to_chars(buf, buf + sizeof buf, v.i).ptr;
+    return string(buf, end) + '\n';
+}
+
+// A row's reads and writes, for the VM: the values it reads from the
+// columns, and those it writes, after those of the rows before.
+class row_values : public vm_values
+{
+    const batch_input &in;
+    std::vector<vm_value> &values;
+    std::vector<ir_type> &types;
+
+public:
+    size_t row = 0;
+    uint32_t reads = 0;
+
+    row_values(const batch_input &in, std::vector<vm_value> &values, std::vector<ir_type> &types)
+        : in(in), values(values), types(types)
+    {
+    }
+
+    const char *read(vm_value &v, ir_type) override
+    {
+        if (reads >= in.columns.size())
+            return "no more input";
+        v = in.columns[reads++][row];
+        return nullptr;
+    }
+
+    void write(vm_value v, ir_type t) override
+    {
+        values.push_back(v);
+        types.push_back(t);
+    }
+};
+
+// The least time f takes in a few runs, since one is at the mercy of
+// whatever else the machine is doing.
+template <class F>
+static double seconds(F f)
+{
+    double best = 1e30;
+    for (int k = 0; k < 3; k++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - t0;
+        best = std::min(best, t.count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t rows = argc > 1 ? std::atol(argv[1]) : 200000;
+    bool ok = true;
+    cout << std::left << std::setw(10) << "program" << std::right << std::setw(14) << "vm rows/s"
+         << std::setw(15) << "batch rows/s" << std::setw(9) << "speedup\n";
+    for (const row_program &rp : programs)
+    {
+        std::istringstream text(rp.text);
+        vm_program p;
+        if (!compile(text, p, true, cout))
+        {
+            cout << "MISMATCH: " << rp.name << " does not compile\n";
+            ok = false;
+            continue;
+        }
+        std::mt19937_64 rng(7);
+        batch_input in;
+        in.rows = rows;
+        size_t width = string(rp.reads).size();
+        in.columns.assign(width, std::vector<vm_value>(rows));
+        for (size_t r = 0; r < rows; r++)
+            for (size_t k = 0; k < width; k++)
+            {
+                vm_value v;
+                if (rp.reads[k] == 'r')
+                {
+                    v.r = (rng() % 2000000) / 1000.0 - 1000.0;
+                    if (k == 1 && string(rp.name) == "compound")
+                        v.r = (rng() % 100) / 1000.0;
+                }
+                else
+                {
+                    v.i = rng() % 100000;
+                    if (string(rp.name) == "compound")
+                        v.i = rng() % 64;
+                    if (string(rp.name) == "faulty")
+                        v.i = rng() % 200;
+                }
+                in.columns[k][r] = v;
+            }
+
+        // On the VM, a row at a time.  What the rows write goes into one
+        // array, row after row, with room made for it beforehand.
+        std::vector<vm_value> values;
+        std::vector<ir_type> types;
+        std::vector<size_t> ends(rows);
+        std::vector<string> errors(rows);
+        values.reserve(rows * 4);
+        types.reserve(rows * 4);
+        row_values io(in, values, types);
+        vm_frame frame;
+        std::ostringstream row_diag;
+        double t_vm = seconds([&] {
+            values.clear();
+            types.clear();
+            for (size_t r = 0; r < rows; r++)
+            {
+                io.row = r;
+                io.reads = 0;
+                errors[r].clear();
+                if (!run(p, frame, io, row_diag))
+                {
+                    errors[r] = row_diag.str();
+                    row_diag.str("");
+                }
+                ends[r] = values.size();
+            }
+        });
+        std::vector<string> outputs(rows);
+        for (size_t r = 0, k = 0; r < rows; r++)
+            for (; k < ends[r]; k++)
+                outputs[r] += text_of(values[k], types[k]);
+
+        batch_output out;
+        double t_batch = seconds([&] { run_batch(p, in, out); });
+
+        size_t wrong = 0, failed = 0;
+        for (size_t r = 0; r < rows; r++)
+        {
+            string got;
+            for (uint32_t k = 0; k < out.counts[r]; k++)
+                got += text_of(out.columns[k][r], out.types[k][r]);
+            string error = out.errors[r].empty() ? "" : out.errors[r] + '\n';
+            failed += !error.empty();
+            if (got != outputs[r] || error != errors[r])
+            {
+                if (wrong++ == 0)
+                    cout << "MISMATCH: " << rp.name << " row " << r << " wrote\n"
+                         << outputs[r] << errors[r] << "on the VM, but\n"
+                         << got << error << "in a batch\n";
+                ok = false;
+            }
+        }
+        cout << std::left << std::setw(10) << rp.name << std::right << std::fixed
+             << std::setprecision(0) << std::setw(14) << rows / t_vm << std::setw(15)
+             << rows / t_batch << std::setprecision(1) << std::setw(8) << t_vm / t_batch << 'x';
+        if (failed)
+            cout << "  (" << failed << " rows with runtime errors)";
+        cout << '\n';
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+/* The parse cache, cold and warm.
+   Parses a set of distinct generated programs three times: into an empty
+   cache, again from memory, and then through a new cache that shares the
+   first one's directory.  Every result, tree and statement offsets and
+   all, is checked against a fresh parse.  A pass through a cache with a
+   small budget shows eviction, and a file put in the directory under
+   another program's name, or one claiming sizes far past its end, must
+   not be taken for that program's.
+     usage: bench/cache [programs] [kilobytes]
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "cache.hpp"
+#include "gen.hpp"
+#include "hash.hpp"
+#include "parse.hpp"
+
+using std::cout;
+
+static void offsets(std::ostream &o, const std::vector<stmt_ptr> &tree)
+{
+    for (auto &s : tree)
+    {
+        o << s->offset << ' ';
+        offsets(o, s->body);
+    }
+}
+
+// A tree printed, and then the offset of every statement.
+static string printed(const std::vector<stmt_ptr> &tree)
+{
+    std::ostringstream o;
+    print(o, tree);
+    offsets(o, tree);
+    return o.str();
+}
+
+// Where a cache keeps the result for text in dir.
+static string file_of(const string &dir, const string &text)
+{
+    char name[64];
+    std::snprintf(name, sizeof name, "/%016llx-%zu.parse",
+                  (unsigned long long)hash64(text.data(), text.size()), text.size());
+    return dir + name;
+}
+
+template <class F>
+static double seconds(F f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void report(const char *label, double t, size_t n, const parse_cache &c)
+{
+    parse_cache::counters s = c.stats();
+    cout << "  " << std::left << std::setw(12) << label << std::right << std::fixed
+         << std::setprecision(1) << t / n * 1e6 << " us/program   hits " << s.hits << "  disk "
+         << s.disk_hits << "  misses " << s.misses << "  evictions " << s.evictions << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = argc > 1 ? std::atoi(argv[1]) : 200;
+    size_t kb = argc > 2 ? std::atoi(argv[2]) : 16;
+    std::vector<string> programs;
+    std::vector<parse_result> expect(n);
+    std::vector<string> trees(n);
+    size_t bytes = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        programs.push_back(generate(kb << 10, i % 4 ? 0 : 0.01, unsigned(i)));
+        bytes += programs.back().size();
+        memstream in(programs[i].data(), programs[i].data() + programs[i].size());
+        std::ostringstream out, diag;
+        parser p(in, out, diag);
+        p.program();
+        expect[i].trace = out.str();
+        expect[i].diagnostics = diag.str();
+        trees[i] = printed(p.tree());
+    }
+
+    char dir[] = "/tmp/parse-cache-XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        cout << "cannot make a cache directory\n";
+        return 1;
+    }
+
+    bool ok = true;
+    std::vector<result_ptr> got(n);
+    auto pass = [&](parse_cache &c) {
+        for (size_t i = 0; i < n; i++)
+            got[i] = c.parse(programs[i].data(), programs[i].size());
+    };
+    auto check = [&] {
+        for (size_t i = 0; i < n; i++)
+            ok = ok && got[i]->trace == expect[i].trace &&
+                 got[i]->diagnostics == expect[i].diagnostics && printed(got[i]->tree) == trees[i];
+    };
+
+    volatile uint64_t sink = 0;
+    double h = seconds([&] {
+        for (auto &p : programs)
+            sink = sink + hash64(p.data(), p.size());
+    });
+    cout << n << " programs of " << kb << " KB; hashing " << std::fixed << std::setprecision(1)
+         << bytes / h / 1e9 << " GB/s\n";
+
+    parse_cache first(size_t(1) << 30, dir);
+    report("cold", seconds([&] { pass(first); }), n, first);
+    check();
+    report("memory", seconds([&] { pass(first); }), n, first);
+    check();
+    parse_cache second(size_t(1) << 30, dir);
+    report("disk", seconds([&] { pass(second); }), n, second);
+    check();
+
+    // Room for about a quarter of the programs: a cyclic scan evicts
+    // every entry before it is used again.
+    size_t output = 0;
+    for (auto &e : expect)
+        output += e.trace.size() + e.diagnostics.size();
+    parse_cache tight(output / 4, "");
+    pass(tight);
+    report("1/4 budget", seconds([&] { pass(tight); }), n, tight);
+    check();
+
+    // The first program's file, under the second's name, as if their keys
+    // had collided, and under the third's, one whose sizes would have the
+    // cache allocate petabytes: each must be parsed, not loaded.
+    if (n > 2)
+    {
+        std::ifstream from(file_of(dir, programs[0]), std::ios::binary);
+        std::ofstream(file_of(dir, programs[1]), std::ios::binary) << from.rdbuf();
+        std::ofstream(file_of(dir, programs[2]), std::ios::binary)
+            << "calc-parse 2\n999999999999999 999999999999999\n";
+        parse_cache third(size_t(1) << 30, dir);
+        for (size_t i = 1; i <= 2; i++)
+        {
+            got[i] = third.parse(programs[i].data(), programs[i].size());
+            ok = ok && got[i]->trace == expect[i].trace && printed(got[i]->tree) == trees[i];
+        }
+        parse_cache::counters s = third.stats();
+        ok = ok && s.misses == 2 && s.disk_hits == 0;
+    }
+
+    string rm = string("rm -rf ") + dir;
+    if (std::system(rm.c_str()) != 0)
+        cout << "could not remove " << dir << "\n";
+    if (!ok)
+    {
+        cout << "MISMATCH: cached result differs from a fresh parse\n";
+        return 1;
+    }
+    return 0;
+}
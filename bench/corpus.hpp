@@ -0,0 +1,123 @@
+/* Calculator programs that do some work when run, for the benchmarks
+   of the compiler and the VM, each with input for it.  Between them they
+   have loops nested in loops and in ifs, copies, invariant and common
+   subexpressions, and values computed for nothing.
+*/
+
+#ifndef CORPUS_HPP
+#define CORPUS_HPP
+
+struct corpus_program
+{
+    const char *name;
+    const char *text;
+    const char *input;
+};
+
+const corpus_program corpus[] = {
+    {"squares",
+     "read int n;\n"
+     "int m := 1000003;\n"
+     "int i := 0;\n"
+     "int s := 0;\n"
+     "while i < n do\n"
+     "  int sq := i * i;\n"
+     "  s := s + sq;\n"
+     "  s := s - s / m * m;\n"
+     "  i := i + 1;\n"
+     "end;\n"
+     "write s;\n",
+     "2000000"},
+    {"collatz",
+     "read int n;\n"
+     "int k := 1;\n"
+     "int steps := 0;\n"
+     "while k <= n do\n"
+     "  int c := k;\n"
+     "  while c > 1 do\n"
+     "    int half := c / 2;\n"
+     "    int odd := 0;\n"
+     "    if c - half * 2 == 1 then\n"
+     "      odd := 1;\n"
+     "      c := 3 * c + 1;\n"
+     "    end;\n"
+     "    if odd == 0 then\n"
+     "      c := half;\n"
+     "    end;\n"
+     "    steps := steps + 1;\n"
+     "  end;\n"
+     "  k := k + 1;\n"
+     "end;\n"
+     "write steps;\n",
+     "30000"},
+    {"primes",
+     "read int n;\n"
+     "int count := 0;\n"
+     "int p := 2;\n"
+     "while p < n do\n"
+     "  int d := 2;\n"
+     "  int prime := 1;\n"
+     "  while d * d <= p do\n"
+     "    if p - p / d * d == 0 then\n"
+     "      prime := 0;\n"
+     "      d := p;\n"
+     "    end;\n"
+     "    d := d + 1;\n"
+     "  end;\n"
+     "  count := count + prime;\n"
+     "  p := p + 1;\n"
+     "end;\n"
+     "write count;\n",
+     "60000"},
+    {"invariant",
+     "read int n;\n"
+     "read real a;\n"
+     "read real b;\n"
+     "real s := 0.0;\n"
+     "int i := 0;\n"
+     "while i < n do\n"
+     "  real x := float(i);\n"
+     "  s := s + (a * a + b * b) * x / (a * b + 1.0);\n"
+     "  if x * (a - b) > 0.0 then\n"
+     "    s := s - (a * a + b * b) / 2.0;\n"
+     "  end;\n"
+     "  i := i + 1;\n"
+     "end;\n"
+     "write s;\n"
+     "write trunc(s / float(n));\n",
+     "1000000 3.5 1.25"},
+    {"redundant",
+     "read int n;\n"
+     "int i := 0;\n"
+     "int t := 0;\n"
+     "while i < n do\n"
+     "  int j := i + 1;\n"
+     "  int k := j;\n"
+     "  int u := (i + 1) * (i + 1) + k * j;\n"
+     "  int unused := i * 7 * 9 + u;\n"
+     "  int w := (i + 1) * (i + 1);\n"
+     "  unused := w - 1;\n"
+     "  t := t + u - w;\n"
+     "  i := k;\n"
+     "end;\n"
+     "write t;\n",
+     "1000000"},
+    {"fib",
+     "read int n;\n"
+     "read int m;\n"
+     "int a := 0;\n"
+     "int b := 1;\n"
+     "int i := 0;\n"
+     "while i < n do\n"
+     "  int c := a + b;\n"
+     "  c := c - c / m * m;\n"
+     "  a := b;\n"
+     "  b := c;\n"
+     "  i := i + 1;\n"
+     "end;\n"
+     "write a;\n"
+     "write float(a) / float(m);\n",
+     "2000000 1000000007"},
+};
+
+#endif
@@ -0,0 +1,127 @@
+/* What superinstructions save.  Runs each program, lowered, with and
+   without fuse(), and reports the dispatches made, that is instructions
+   run less the second halves of superinstructions, and the time taken.
+   The table in fusion.inc was picked on the corpus (bench/pairs), so the
+   programs here that are not in it show how well it carries over.  The
+   output, and the count of instructions run, must be the same fused.
+     usage: bench/fusion
+*/
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "corpus.hpp"
+#include "parse.hpp"
+#include "profile.hpp"
+
+using std::cout;
+
+// Programs that bench/pairs did not see.
+const corpus_program unseen[] = {
+    {"gcd",
+     "read int n; int i := 1; int s := 0;\n"
+     "while i <= n do\n"
+     "  int a := i; int b := 1000;\n"
+     "  while b > 0 do int t := a - a / b * b; a := b; b := t; end;\n"
+     "  s := s + a; i := i + 1;\n"
+     "end;\n"
+     "write s;\n",
+     "300000"},
+    {"digits",
+     "read int n; int i := 0; int s := 0;\n"
+     "while i < n do\n"
+     "  int k := i;\n"
+     "  while k > 0 do s := s + (k - k / 10 * 10); k := k / 10; end;\n"
+     "  i := i + 1;\n"
+     "end;\n"
+     "write s;\n",
+     "1000000"},
+    {"newton",
+     "read int n; int i := 1; real s := 0.0;\n"
+     "while i <= n do\n"
+     "  real x := float(i); real g := x;\n"
+     "  int k := 0;\n"
+     "  while k < 8 do g := (g + x / g) / 2.0; k := k + 1; end;\n"
+     "  s := s + g; i := i + 1;\n"
+     "end;\n"
+     "write s;\n",
+     "500000"},
+};
+
+struct outcome
+{
+    string output;
+    uint64_t executed = 0, dispatched = 0;
+    double seconds;
+};
+
+static outcome execute(const vm_program &p, const char *input)
+{
+    outcome o;
+    {
+        std::istringstream in(input);
+        std::ostringstream out;
+        auto t0 = std::chrono::steady_clock::now();
+        run(p, in, out, out, &o.executed);
+        o.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        o.output = out.str();
+    }
+    run_profile profile;
+    std::istringstream in(input);
+    std::ostringstream out;
+    run(p, profile, in, out, out);
+    o.dispatched = o.executed;
+    for (size_t k = 0; k + 1 < p.code.size(); k++)
+        if (unfused(p.code[k].op) != p.code[k].op)
+            o.dispatched -= profile.count(k + 1);
+    return o;
+}
+
+static bool measure(const corpus_program &c, bool seen)
+{
+    std::istringstream text(c.text);
+    std::ostream discard(nullptr);
+    scanner s(text, discard);
+    basic_parser<scanner, no_probe, no_trace, fail_fast> parse(s, discard, discard);
+    parse.program();
+    ir_program ir;
+    if (parse.failed() || !build_ir(parse.tree(), ir, cout))
+    {
+        cout << "MISMATCH: " << c.name << " does not compile\n";
+        return false;
+    }
+    optimize(ir);
+    vm_program plain = lower(ir), fused = plain;
+    fuse(fused);
+    outcome before = execute(plain, c.input), after = execute(fused, c.input);
+    cout << std::left << std::setw(10) << c.name << std::setw(7) << (seen ? "seen" : "unseen")
+         << std::right << std::setw(13) << before.dispatched << std::setw(13) << after.dispatched
+         << std::fixed << std::setprecision(0) << std::setw(6)
+         << 100.0 * (before.dispatched - after.dispatched) / before.dispatched << '%'
+         << std::setprecision(1) << std::setw(10) << before.seconds * 1e3 << std::setw(10)
+         << after.seconds * 1e3 << std::setw(8) << before.seconds / after.seconds << "x\n";
+    if (after.output != before.output || after.executed != before.executed)
+    {
+        cout << "MISMATCH: " << c.name << " ran " << before.executed << " instructions and wrote\n"
+             << before.output << "unfused, but " << after.executed << " and\n"
+             << after.output << "fused\n";
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    bool ok = true;
+    cout << std::left << std::setw(17) << "program" << std::right << std::setw(13) << "dispatches"
+         << std::setw(13) << "fused" << std::setw(7) << "saved" << std::setw(10) << "ms"
+         << std::setw(10) << "fused ms" << std::setw(9) << "speedup\n";
+    for (const corpus_program &c : corpus)
+        ok &= measure(c, true);
+    for (const corpus_program &c : unseen)
+        ok &= measure(c, false);
+    return ok ? 0 : 1;
+}
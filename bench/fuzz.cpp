@@ -0,0 +1,384 @@
+/* Grammar-aware differential fuzzing of the parsers.
+   Seeds are input.txt and small programs from generate_shaped(); each
+   input is a seed put through a few token-level mutations: tokens
+   dropped, doubled, swapped or replaced by other terminals, statements
+   spliced in from another seed, lexical junk, and deep nesting of
+   parentheses or blocks.  Each input is run through
+     ./parse          the reference
+     ./parse -j 4, -p, -s
+                      which must match the reference exactly
+     ./parsel         the parser without this tree's error recovery,
+                      whose differences are sorted by where the two
+                      first part ways and reported, not treated as bugs
+   each in a process of its own with a wall-clock budget, so crashes
+   (stack overflows included) and inputs that take too long are caught
+   too.  Inputs that show a problem are kept in the output directory.
+   Before the random inputs come the regressions: inputs that once
+   crashed or hung a parser, which must now pass like any other.
+   Nothing here needs the network.
+     usage: bench/fuzz [-t seconds] [-b budget-ms] [-o dir] [-s seed]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "gen.hpp"
+#include "lex.hpp"
+
+using std::cout;
+
+typedef std::chrono::steady_clock clock_type;
+
+struct outcome
+{
+    string out, err;
+    int signal = 0;       // that killed it, if any
+    bool timeout = false; // killed for running past the budget
+    double ms = 0;
+};
+
+static string slurp(const string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    return string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+}
+
+// Runs a parser on the input in file, with an 8 MB stack, for at most
+// budget milliseconds.
+static outcome run(const std::vector<string> &argv, const string &file, const string &scratch,
+                   int budget)
+{
+    outcome r;
+    string out = scratch + ".out", err = scratch + ".err";
+    auto t0 = clock_type::now();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        struct rlimit stack = {8 << 20, 8 << 20};
+        setrlimit(RLIMIT_STACK, &stack);
+        int in = open(file.c_str(), O_RDONLY);
+        int o = open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int e = open(err.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(in, 0);
+        dup2(o, 1);
+        dup2(e, 2);
+        std::vector<char *> args;
+        for (auto &a : argv)
+            args.push_back(const_cast<char *>(a.c_str()));
+        args.push_back(nullptr);
+        execv(args[0], args.data());
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, WNOHANG) == 0)
+    {
+        if (clock_type::now() - t0 > std::chrono::milliseconds(budget))
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            r.timeout = true;
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    r.ms = std::chrono::duration<double, std::milli>(clock_type::now() - t0).count();
+    if (!r.timeout && WIFSIGNALED(status))
+        r.signal = WTERMSIG(status);
+    r.out = slurp(out);
+    r.err = slurp(err);
+    return r;
+}
+
+// Where two outputs first differ, as a line from each.
+static string first_difference(const string &a, const string &b)
+{
+    std::istringstream x(a), y(b);
+    string l, m;
+    while (true)
+    {
+        bool more_a = bool(std::getline(x, l)), more_b = bool(std::getline(y, m));
+        if (!more_a && !more_b)
+            return "";
+        if (!more_a)
+            l = "<end>";
+        if (!more_b)
+            m = "<end>";
+        if (l != m || !more_a || !more_b)
+            return l + " | " + m;
+    }
+}
+
+class mutator
+{
+    std::mt19937 rng;
+    const std::vector<string> &seeds;
+
+    size_t below(size_t n)
+    {
+        return n ? rng() % n : 0;
+    }
+
+    static std::vector<string> tokens(const string &text)
+    {
+        std::ostream discard(nullptr);
+        std::vector<string> t;
+        for (const lexeme &l : lex(text.data(), text.size(), discard))
+            if (l.kind != t_eof)
+                t.push_back(text.substr(l.offset, l.length));
+        return t;
+    }
+
+    string terminal()
+    {
+        static const char *const all[] = {"int", "real", "trunc", "float", "read", "write", "if",
+                                          "then", "end", "while", "do", ":=", "(", ")", "+", "-",
+                                          "*", "/", ";", "==", "<>", "<", ">", "<=", ">=", "x",
+                                          "y1", "7", "2.5", "1e3"};
+        return all[below(sizeof all / sizeof all[0])];
+    }
+
+public:
+    mutator(unsigned seed, const std::vector<string> &seeds) : rng(seed), seeds(seeds) {}
+
+    string next()
+    {
+        std::vector<string> t = tokens(seeds[below(seeds.size())]);
+        if (t.empty())
+            t.push_back(";");
+        for (size_t n = 1 + below(4); n > 0; n--)
+        {
+            size_t at = below(t.size());
+            switch (below(9))
+            {
+            case 0:
+                t.erase(t.begin() + at);
+                break;
+            case 1:
+                t.insert(t.begin() + at, t[at]);
+                break;
+            case 2:
+                if (at + 1 < t.size())
+                    std::swap(t[at], t[at + 1]);
+                break;
+            case 3:
+                t[at] = terminal();
+                break;
+            case 4:
+                t.insert(t.begin() + at, terminal());
+                break;
+            case 5:
+            {
+                // A run of tokens from another seed.
+                std::vector<string> other = tokens(seeds[below(seeds.size())]);
+                size_t from = below(other.size()), len = 1 + below(20);
+                t.insert(t.begin() + at, other.begin() + from,
+                         other.begin() + std::min(other.size(), from + len));
+                break;
+            }
+            case 6:
+            {
+                static const char *const junk[] = {"@", "2.", "3.5e+", ":", "=", "1.e5", "#", "!"};
+                t.insert(t.begin() + at, junk[below(sizeof junk / sizeof junk[0])]);
+                break;
+            }
+            case 7:
+            {
+                // Deep parentheses, deep enough now and then to test the stack.
+                size_t depth = below(4) ? 1 + below(100) : 1 + below(1000000);
+                std::vector<string> wrap(depth, "(");
+                wrap.push_back("x");
+                wrap.insert(wrap.end(), depth, ")");
+                t.insert(t.begin() + at, wrap.begin(), wrap.end());
+                break;
+            }
+            default:
+            {
+                // Deeply nested blocks.
+                size_t depth = below(4) ? 1 + below(100) : 1 + below(200000);
+                std::vector<string> wrap;
+                for (size_t k = 0; k < depth; k++)
+                    wrap.insert(wrap.end(), {"while", "x", "<", "1", "do"});
+                wrap.insert(wrap.end(), {"write", "x", ";"});
+                for (size_t k = 0; k < depth; k++)
+                    wrap.insert(wrap.end(), {"end", ";"});
+                t.insert(t.begin() + at, wrap.begin(), wrap.end());
+            }
+            }
+            if (t.empty())
+                t.push_back(";");
+        }
+        string text;
+        for (size_t k = 0; k < t.size(); k++)
+            text += (k && below(8) == 0 ? "\n" : " ") + t[k];
+        return text + "\n";
+    }
+};
+
+// Inputs that fuzzing has found problems with, all since fixed: nesting
+// deep enough to overflow the stack of ./parse, which now stops at
+// MAX_DEPTH (parse.hpp), reported after a lexical error, which leaves
+// the diagnostics in hex; and trunc or float where a statement should
+// start, which sent ./parsel's recovery round in a loop for good.
+static std::vector<string> regressions()
+{
+    auto repeat = [](const string &s, size_t n) {
+        string r;
+        for (size_t k = 0; k < n; k++)
+            r += s;
+        return r;
+    };
+    return {
+        "write " + repeat("(", 1000000) + "x" + repeat(")", 1000000) + ";\n",
+        "write " + repeat("trunc(", 100000) + "x" + repeat(")", 100000) + ";\n",
+        repeat("while x < 1 do ", 200000) + "write x;" + repeat(" end;", 200000) + "\n",
+        "write x" + repeat(" + x", 300000) + ";\n",
+        "write x" + repeat(" * x", 300000) + ";\n",
+        "x := @1; write (((x)));\n" + repeat("if x < 1 then ", 1001) + repeat("end;", 1001) + "\n",
+        "float 1;\n",
+        "x := 1; trunc (x);\nwrite x;\n",
+    };
+}
+
+static string describe(const outcome &r)
+{
+    if (r.timeout)
+        return "timeout";
+    if (r.signal == SIGSEGV)
+        return "SIGSEGV (stack overflow?)";
+    if (r.signal)
+        return string("signal ") + strsignal(r.signal);
+    return "";
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = 60;
+    int budget = 2000;
+    string dir = "fuzz-out";
+    unsigned seed = 1;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        string a = argv[i];
+        if (a == "-t")
+            seconds = std::atof(argv[i + 1]);
+        else if (a == "-b")
+            budget = std::atoi(argv[i + 1]);
+        else if (a == "-o")
+            dir = argv[i + 1];
+        else if (a == "-s")
+            seed = std::atoi(argv[i + 1]);
+        else
+        {
+            cout << "usage: bench/fuzz [-t seconds] [-b budget-ms] [-o dir] [-s seed]\n";
+            return 2;
+        }
+    }
+    mkdir(dir.c_str(), 0755);
+
+    std::vector<string> seeds = {slurp("input.txt")};
+    for (unsigned k = 0; k < 64; k++)
+    {
+        shape sh;
+        sh.bytes = 100 + k * 30;
+        sh.depth = k % 5;
+        sh.expr_length = k % 7;
+        sh.identifiers = 1 + k % 9;
+        sh.seed = seed * 1000 + k;
+        seeds.push_back(generate_shaped(sh));
+    }
+
+    const std::vector<std::vector<string>> same = {
+        {"./parse", "-j", "4"}, {"./parse", "-p"}, {"./parse", "-s"}};
+    string scratch = "/tmp/fuzz-" + std::to_string(getpid());
+    string file = scratch + ".calc";
+    mutator m(seed, seeds);
+    std::map<string, size_t> divergences; // parse against parsel, by first difference
+    std::map<string, size_t> problems;
+    size_t inputs = 0, kept = 0;
+    double slowest = 0;
+    auto keep = [&](const string &kind, const string &text) {
+        string path = dir + "/" + kind + "-" + std::to_string(++kept) + ".calc";
+        std::ofstream(path, std::ios::binary) << text;
+        return path;
+    };
+    auto problem = [&](const string &what, const string &text) {
+        if (problems[what]++ == 0)
+            cout << "  " << what << "  (" << keep("problem", text) << ")\n";
+    };
+
+    std::vector<string> fixed = regressions();
+    auto end = clock_type::now() + std::chrono::duration<double>(seconds);
+    while (!fixed.empty() || clock_type::now() < end)
+    {
+        string text;
+        if (!fixed.empty())
+        {
+            text = fixed.front();
+            fixed.erase(fixed.begin());
+        }
+        else
+            text = m.next();
+        std::ofstream(file, std::ios::binary) << text;
+        inputs++;
+        outcome ref = run({"./parse"}, file, scratch, budget);
+        slowest = std::max(slowest, ref.ms);
+        if (!describe(ref).empty())
+        {
+            problem("parse: " + describe(ref), text);
+            continue;
+        }
+        for (auto &args : same)
+        {
+            outcome r = run(args, file, scratch, budget);
+            string name = args[0] + " " + args[1] + (args.size() > 2 ? " " + args[2] : "");
+            if (!describe(r).empty())
+                problem(name + ": " + describe(r), text);
+            else if (r.out != ref.out || r.err != ref.err)
+                problem(name + ": output differs from ./parse", text);
+        }
+        outcome l = run({"./parsel"}, file, scratch, budget);
+        if (!describe(l).empty())
+            problem("parsel: " + describe(l), text);
+        else
+        {
+            string d = first_difference(ref.out, l.out);
+            if (d.empty())
+                d = first_difference(ref.err, l.err);
+            if (!d.empty() && divergences[d]++ == 0 && divergences.size() <= 20)
+                keep("diverge", text);
+        }
+    }
+    std::remove(file.c_str());
+    std::remove((scratch + ".out").c_str());
+    std::remove((scratch + ".err").c_str());
+
+    std::vector<std::pair<size_t, string>> ranked;
+    for (auto &d : divergences)
+        ranked.emplace_back(d.second, d.first);
+    std::sort(ranked.rbegin(), ranked.rend());
+    cout << inputs << " inputs, slowest " << slowest << " ms; " << ranked.size()
+         << " kinds of divergence between parse and parsel (parse | parsel):\n";
+    for (size_t k = 0; k < ranked.size() && k < 10; k++)
+        cout << "  " << ranked[k].first << "  " << ranked[k].second << "\n";
+    size_t n = 0;
+    for (auto &p : problems)
+        n += p.second;
+    cout << n << " inputs with problems" << (n ? ", kept in " + dir : "") << "\n";
+    return n ? 1 : 0;
+}
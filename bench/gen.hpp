@@ -0,0 +1,220 @@
+/* Program generators shared by the benchmarks: generate() for a fixed
+   mix of statements, and generate_shaped() to walk the grammar with
+   control over the shape of what comes out.
+*/
+
+#ifndef GEN_HPP
+#define GEN_HPP
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+// A program of about the given size, mixing every kind of statement.
+// With noise > 0, that fraction of statements is followed by a fragment
+// with a lexical or syntax error in it.
+inline string generate(size_t bytes, double noise = 0, unsigned seed = 42)
+{
+    static const char *const junk[] = {"2.", "3.5e+", ":", "=", "@", "end", "then", "x :=", "(", "1.e5"};
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> coin(0, 1);
+    std::ostringstream o;
+    auto id = [&] { return "v" + std::to_string(rng() % 64); };
+    while ((size_t)o.tellp() < bytes)
+    {
+        switch (rng() % 6)
+        {
+        case 0:
+            o << "int " << id() << " := " << rng() % 1000 << " * " << id() << ";\n";
+            break;
+        case 1:
+            o << "read " << id() << ";\n";
+            break;
+        case 2:
+            o << "write (" << id() << " + 2.5) / " << id() << ";\n";
+            break;
+        case 3:
+            o << "if " << id() << " < 10 then " << id() << " := " << id() << " - 1; end;\n";
+            break;
+        case 4:
+            o << "while " << id() << " <> 0 do\n  if " << id() << " >= 2 then write " << id()
+              << "; end;\n  " << id() << " := " << id() << " - 1;\nend;\n";
+            break;
+        default:
+            o << id() << " := " << id() << " + " << rng() % 100 << ";\n";
+            break;
+        }
+        if (noise > 0 && coin(rng) < noise)
+            o << junk[rng() % (sizeof junk / sizeof junk[0])] << ' ';
+    }
+    return o.str();
+}
+
+// The shape of a program for generate_shaped().
+struct shape
+{
+    size_t bytes = 1 << 20;
+    int depth = 2;          // deepest nesting of if and while
+    int expr_length = 3;    // most operators in an expression
+    int identifiers = 64;   // distinct names used
+    double error_rate = 0;  // fraction of statements with an error put in
+    unsigned seed = 42;
+};
+
+// A program drawn from the grammar.  Each statement is built as a list
+// of tokens; with probability error_rate one token is then dropped,
+// doubled, or preceded by junk that does not scan or does not fit.
+class shaped_generator
+{
+    const shape &sh;
+    std::mt19937 rng;
+    std::vector<string> toks;
+
+    int below(int n)
+    {
+        return n > 0 ? int(rng() % n) : 0;
+    }
+    string id()
+    {
+        return "v" + std::to_string(below(sh.identifiers));
+    }
+    void factor(int &budget)
+    {
+        switch (below(budget > 0 ? 6 : 3))
+        {
+        case 0:
+            toks.push_back(std::to_string(below(1000)));
+            break;
+        case 1:
+            toks.push_back(std::to_string(below(100)) + "." + std::to_string(below(100)));
+            break;
+        case 2:
+        case 3:
+            toks.push_back(id());
+            break;
+        case 4:
+            toks.push_back("(");
+            expr(--budget);
+            toks.push_back(")");
+            break;
+        default:
+            toks.push_back(below(2) ? "trunc" : "float");
+            toks.push_back("(");
+            expr(--budget);
+            toks.push_back(")");
+        }
+    }
+    // An expression with up to budget operators, which it uses up.
+    void expr(int &budget)
+    {
+        static const char *const ops[] = {"+", "-", "*", "/"};
+        factor(budget);
+        for (int n = below(budget + 1); n > 0 && budget > 0; n--, budget--)
+        {
+            toks.push_back(ops[below(4)]);
+            factor(budget);
+        }
+    }
+    void expr()
+    {
+        int budget = sh.expr_length;
+        expr(budget);
+    }
+    void stmt(int depth, std::ostringstream &o)
+    {
+        static const char *const rels[] = {"==", "<>", "<", ">", "<=", ">="};
+        toks.clear();
+        int kind = below(depth < sh.depth ? 8 : 6);
+        switch (kind)
+        {
+        case 0:
+        case 1:
+            toks.push_back(kind ? "real" : "int");
+            toks.push_back(id());
+            toks.push_back(":=");
+            expr();
+            break;
+        case 2:
+            toks.push_back("read");
+            if (below(2))
+                toks.push_back(below(2) ? "int" : "real");
+            toks.push_back(id());
+            break;
+        case 3:
+            toks.push_back("write");
+            expr();
+            break;
+        case 4:
+        case 5:
+            toks.push_back(id());
+            toks.push_back(":=");
+            expr();
+            break;
+        default:
+            toks.push_back(kind == 6 ? "if" : "while");
+            expr();
+            toks.push_back(rels[below(6)]);
+            expr();
+            toks.push_back(kind == 6 ? "then" : "do");
+        }
+        flush(depth, o, kind < 6);
+        if (kind < 6)
+            return;
+        for (int n = 1 + below(3); n > 0; n--)
+            stmt(depth + 1, o);
+        toks.clear();
+        toks.push_back("end");
+        toks.push_back(";");
+        flush(depth, o, false);
+    }
+    // Writes out the tokens of a line, perhaps with an error put in.
+    // Errors go only in simple statements, and leave their ';' alone: an
+    // error that unbalances an if or while, or that runs a statement into
+    // the next, can leave a stray end, which ends the whole program.
+    void flush(int depth, std::ostringstream &o, bool simple)
+    {
+        static const char *const junk[] = {"2.", "3.5e+", ":", "=", "@", "then", "(", "1.e5", ";"};
+        if (toks.back() != ";" && toks.back() != "then" && toks.back() != "do")
+            toks.push_back(";");
+        if (simple && std::uniform_real_distribution<double>(0, 1)(rng) < sh.error_rate)
+        {
+            size_t at = below(int(toks.size()) - 1);
+            switch (below(3))
+            {
+            case 0:
+                toks.erase(toks.begin() + at);
+                break;
+            case 1:
+                toks.insert(toks.begin() + at, toks[at]);
+                break;
+            default:
+                toks.insert(toks.begin() + at, junk[below(sizeof junk / sizeof junk[0])]);
+            }
+        }
+        o << string(2 * depth, ' ');
+        for (size_t k = 0; k < toks.size(); k++)
+            o << (k ? " " : "") << toks[k];
+        o << '\n';
+    }
+
+public:
+    explicit shaped_generator(const shape &sh) : sh(sh), rng(sh.seed) {}
+
+    string program()
+    {
+        std::ostringstream o;
+        while (size_t(o.tellp()) < sh.bytes)
+            stmt(0, o);
+        return o.str();
+    }
+};
+
+inline string generate_shaped(const shape &sh)
+{
+    return shaped_generator(sh).program();
+}
+
+#endif
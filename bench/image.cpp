@@ -0,0 +1,213 @@
+/* Loading a program image against parsing the source again.
+   Writes the image of a generated program, then compares the time to
+   get at the parsed program each way: reading the source and scanning
+   and parsing it, against mapping the image (with and without
+   verify()).  Both sides then walk every statement, so neither gets
+   credit for work it defers.  The image's tree, statement offsets
+   included, tokens and diagnostics are checked against the parser's, and
+   images too deep for the parser or with a record used twice, as a
+   hostile file might be, must fail verify().
+     usage: bench/image [megabytes]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "gen.hpp"
+#include "image.hpp"
+#include "lex.hpp"
+#include "parse.hpp"
+
+using std::cout;
+
+template <class F>
+static double seconds(F f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static size_t walk(const std::vector<stmt_ptr> &list)
+{
+    size_t n = list.size();
+    for (auto &s : list)
+        n += walk(s->body);
+    return n;
+}
+
+static size_t walk(const program_image &img, const uint32_t *list, size_t count)
+{
+    size_t n = count;
+    for (size_t k = 0; k < count; k++)
+    {
+        const image_stmt &s = img.stmt(list[k]);
+        n += walk(img, img.list(s.body_first), s.body_count);
+    }
+    return n;
+}
+
+// Whether two trees have their statements at the same offsets.
+static bool same_offsets(const std::vector<stmt_ptr> &a, const std::vector<stmt_ptr> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t k = 0; k < a.size(); k++)
+        if (a[k]->offset != b[k]->offset || !same_offsets(a[k]->body, b[k]->body))
+            return false;
+    return true;
+}
+
+// The image of tree, in a buffer aligned as adopt() needs.
+static std::vector<uint64_t> image_of(const std::vector<stmt_ptr> &tree)
+{
+    std::ostringstream o;
+    write_image(o, "", {}, tree, "");
+    string bytes = o.str();
+    std::vector<uint64_t> words((bytes.size() + 7) / 8);
+    bytes.copy(reinterpret_cast<char *>(words.data()), bytes.size());
+    return words;
+}
+
+static bool verifies(std::vector<uint64_t> &words)
+{
+    program_image img;
+    return img.adopt(words.data(), words.size() * 8) && img.verify();
+}
+
+// Images verify() must turn away: trees deeper than MAX_DEPTH, which
+// tree() would recurse through, and an expression whose operands are one
+// record, with which tree() would build as many nodes as 2 to the power
+// of how deep the sharing goes.
+static bool hostile_images()
+{
+    auto nested = [](int levels) {
+        expr_ptr e = make_leaf(t_i_num, "1");
+        for (int k = 1; k < levels; k++)
+            e = make_unary(t_trunc, e);
+        stmt_node s;
+        s.kind = t_write;
+        s.value = e;
+        return std::vector<stmt_ptr>{std::make_shared<const stmt_node>(s)};
+    };
+    std::vector<uint64_t> deepest = image_of(nested(MAX_DEPTH - 1)),
+                          deeper = image_of(nested(MAX_DEPTH));
+    stmt_node s;
+    s.kind = t_write;
+    s.value = make_binary(t_add, make_leaf(t_i_num, "1"), make_leaf(t_i_num, "2"));
+    std::vector<uint64_t> shared = image_of({std::make_shared<const stmt_node>(s)});
+    {
+        // The operands are records 0 and 1, the sum record 2.
+        program_image img;
+        img.adopt(shared.data(), shared.size() * 8);
+        auto *exprs = reinterpret_cast<image_expr *>(reinterpret_cast<char *>(shared.data()) +
+                                                     img.header().exprs.offset);
+        exprs[2].left = exprs[2].right;
+    }
+    return verifies(deepest) && !verifies(deeper) && !verifies(shared);
+}
+
+static string slurp(const string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    return string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mb = argc > 1 ? std::atoi(argv[1]) : 16;
+    string text = generate(mb << 20);
+    string dir = "/tmp/image-bench-" + std::to_string(getpid());
+    string src = dir + ".calc", bin = dir + ".img";
+    std::ofstream(src, std::ios::binary) << text;
+
+    std::ostream discard(nullptr);
+    std::vector<stmt_ptr> tree;
+    std::vector<lexeme> tokens;
+    string diagnostics;
+    {
+        memstream in(text.data(), text.data() + text.size());
+        std::ostringstream diag;
+        parser p(in, discard, diag);
+        p.program();
+        tree = p.tree();
+        diagnostics = diag.str();
+        tokens = lex(text.data(), text.size(), discard);
+        std::ofstream o(bin, std::ios::binary);
+        write_image(o, text, tokens, tree, diagnostics);
+    }
+
+    size_t statements = 0;
+    double parse = seconds([&] {
+        string t = slurp(src);
+        memstream in(t.data(), t.data() + t.size());
+        std::ostringstream diag;
+        parser p(in, discard, diag);
+        p.program();
+        statements = walk(p.tree());
+    });
+    double parse_lex = seconds([&] {
+        string t = slurp(src);
+        std::vector<lexeme> toks = lex(t.data(), t.size(), discard);
+        memstream in(t.data(), t.data() + t.size());
+        std::ostringstream diag;
+        parser p(in, discard, diag);
+        p.program();
+        statements = walk(p.tree());
+    });
+
+    bool ok = true;
+    size_t image_size = 0, walked = 0;
+    double load = seconds([&] {
+        program_image img;
+        ok = img.open(bin);
+        walked = walk(img, img.top(), img.top_count());
+    });
+    double verified = seconds([&] {
+        program_image img;
+        ok = ok && img.open(bin) && img.verify();
+        walked = walk(img, img.top(), img.top_count());
+    });
+    {
+        program_image img;
+        ok = ok && img.open(bin) && img.verify();
+        image_size = img.header().diagnostics.offset + img.header().diagnostics.size;
+        std::ostringstream a, b;
+        print(a, tree);
+        print(b, img.tree());
+        ok = ok && a.str() == b.str() && same_offsets(tree, img.tree()) &&
+             img.diagnostics() == diagnostics &&
+             img.source() == text && img.token_count() == tokens.size();
+        for (size_t i = 0; ok && i < tokens.size(); i++)
+            ok = img.tokens()[i].kind == tokens[i].kind && img.tokens()[i].offset == tokens[i].offset &&
+                 img.tokens()[i].length == tokens[i].length;
+        if (!ok)
+            cout << "image error: " << img.error() << "\n";
+    }
+    ok = ok && walked == statements;
+    bool refused = hostile_images();
+    std::remove(src.c_str());
+    std::remove(bin.c_str());
+
+    cout << "source " << text.size() << " bytes, image " << image_size << " bytes, " << tokens.size()
+         << " tokens, " << statements << " statements\n"
+         << std::fixed << std::setprecision(2)
+         << "  parse              " << parse * 1e3 << " ms\n"
+         << "  scan tokens, parse " << parse_lex * 1e3 << " ms\n"
+         << "  map image          " << load * 1e3 << " ms  (" << std::setprecision(0)
+         << parse / load << "x)\n"
+         << std::setprecision(2) << "  map and verify     " << verified * 1e3 << " ms  ("
+         << std::setprecision(0) << parse / verified << "x)\n";
+    if (!refused)
+        cout << "MISMATCH: verify() accepted an image too deep or with a record used twice\n";
+    if (!ok)
+        cout << "MISMATCH: image differs from the parse\n";
+    return ok && refused ? 0 : 1;
+}
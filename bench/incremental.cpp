@@ -0,0 +1,139 @@
+/* Incremental reparsing against reparsing the whole program.
+   Records an editing session on a generated program (new lines typed in
+   a keystroke at a time and then backspaced away, and literals retyped
+   in place) and replays it through a document, timing each edit.  At
+   regular points the incremental tree, tokens and diagnostics are
+   checked against those of a fresh parse of the same text.
+   Some keystrokes inside an if or while leave a statement whose error
+   recovery skips the block's end; the rest of the program then really
+   does parse differently, and is reparsed to the end.  These are a few
+   percent of the session, so p99 is no better than a full reparse.
+     usage: bench/incremental [kilobytes]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gen.hpp"
+#include "incremental.hpp"
+#include "parse.hpp"
+
+using std::cout;
+
+struct edit
+{
+    size_t offset, removed;
+    string inserted;
+};
+
+template <class F>
+static double seconds(F f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// A session of keystrokes against text, which it edits along the way.
+static std::vector<edit> record(string text, int sites)
+{
+    std::mt19937 rng(7);
+    std::vector<edit> session;
+    auto apply = [&](edit e) {
+        text.replace(e.offset, e.removed, e.inserted);
+        session.push_back(e);
+    };
+    for (int i = 0; i < sites; i++)
+    {
+        size_t at = text.find('\n', rng() % text.size());
+        if (at == string::npos)
+            continue;
+        if (i % 2 == 0)
+        {
+            const string typed = "\nv1 := (v2 + 3.5) * v3;";
+            for (size_t k = 0; k < typed.size(); k++)
+                apply({at + k, 0, typed.substr(k, 1)});
+            for (size_t k = typed.size(); k-- > 0;)
+                apply({at + k, 1, ""});
+        }
+        else
+        {
+            size_t digit = text.find_first_of("0123456789", at + 1);
+            if (digit == string::npos)
+                continue;
+            apply({digit, 1, ""});
+            apply({digit, 0, "42"});
+        }
+    }
+    return session;
+}
+
+static string snapshot(const document &d)
+{
+    std::ostringstream o;
+    print(o, d.tree());
+    for (auto &l : d.tokens())
+        o << l.kind << ' ' << l.offset << ' ' << l.length << '\n';
+    o << d.diagnostics();
+    return o.str();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t kb = argc > 1 ? std::atoi(argv[1]) : 1024;
+    string text = generate(kb << 10);
+    std::vector<edit> session = record(text, 100);
+
+    document doc(text);
+    {
+        memstream in(text.data(), text.data() + text.size());
+        std::ostream discard(nullptr);
+        std::ostringstream diag;
+        parser p(in, discard, diag);
+        p.program();
+        if (diag.str() != doc.diagnostics())
+        {
+            cout << "MISMATCH: document diagnostics differ from parser::program()\n";
+            return 1;
+        }
+    }
+
+    std::vector<double> us;
+    double full = 0, reparsed = 0;
+    int checks = 0;
+    for (size_t i = 0; i < session.size(); i++)
+    {
+        const edit &e = session[i];
+        us.push_back(seconds([&] { doc.edit(e.offset, e.removed, e.inserted); }) * 1e6);
+        reparsed += doc.reparsed();
+        if (i % 97 == 0 || i == session.size() - 1)
+        {
+            document *fresh = nullptr;
+            full += seconds([&] { fresh = new document(doc.text()); });
+            checks++;
+            if (snapshot(*fresh) != snapshot(doc))
+            {
+                cout << "MISMATCH after edit " << i << "\n";
+                return 1;
+            }
+            delete fresh;
+        }
+    }
+    std::sort(us.begin(), us.end());
+    cout << "program " << text.size() << " bytes, session of " << session.size() << " edits\n"
+         << std::fixed << std::setprecision(1)
+         << "incremental  p50 " << us[us.size() / 2] << " us  p90 " << us[us.size() * 9 / 10]
+         << " us  p99 " << us[us.size() * 99 / 100]
+         << " us  max " << us.back() << " us, " << reparsed / session.size() << " bytes reparsed per edit\n"
+         << "full reparse mean " << full / checks * 1e6 << " us\n"
+         << checks << " states checked against a full reparse\n";
+    return 0;
+}
@@ -0,0 +1,116 @@
+/* Batch reading and validation of many small files.  Writes a directory
+   of small generated programs, some with errors, and reads them all one
+   at a time, on a pool of threads, and through io_uring; then validates
+   them all each way, as parse -v does with a list of files.  Reports
+   files a second, and checks that every way reads the same bytes and
+   finds the same invalid files.  The files were just written, so they
+   are read from the page cache: this measures the cost of the system
+   calls, not of the disk.
+     usage: bench/ingest [files]
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "gen.hpp"
+#include "hash.hpp"
+#include "scan.hpp"
+#include "validate.hpp"
+
+using std::cout;
+
+typedef std::chrono::steady_clock clock_type;
+
+static double since(clock_type::time_point t0)
+{
+    return std::chrono::duration<double>(clock_type::now() - t0).count();
+}
+
+// Of a file's contents, and where it is in the list, so that a sum over
+// all files does not depend on the order they were read in.
+static uint64_t fingerprint(size_t index, const string &text)
+{
+    return hash64(text.data(), text.size(), index);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = argc > 1 ? std::atol(argv[1]) : 100000;
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    string dir = "/tmp/ingest-" + std::to_string(getpid());
+    mkdir(dir.c_str(), 0755);
+    std::vector<string> paths;
+    uint64_t expected = 0;
+    size_t bytes = 0, expected_invalid = 0;
+    for (size_t k = 0; k < n; k++)
+    {
+        shape sh;
+        sh.bytes = 100 + (k % 20) * 100;
+        sh.depth = k % 3;
+        sh.error_rate = k % 10 == 0 ? 0.2 : 0;
+        sh.seed = k + 1;
+        string text = generate_shaped(sh);
+        char name[32];
+        std::snprintf(name, sizeof name, "/%06zu.calc", k);
+        paths.push_back(dir + name);
+        std::ofstream(paths.back(), std::ios::binary) << text;
+        expected += fingerprint(k, text);
+        bytes += text.size();
+        memstream in(text.data(), text.data() + text.size());
+        std::ostream discard(nullptr);
+        expected_invalid += !validate(in, discard);
+    }
+    cout << n << " files, " << bytes / n << " bytes on average, " << workers << " workers\n\n"
+         << std::left << std::setw(10) << "reads" << std::setw(9) << "(used)" << std::right
+         << std::setw(14) << "read files/s" << std::setw(18) << "validate files/s" << '\n';
+
+    bool ok = true;
+    string first_report;
+    for (read_method how : {read_sync, read_threads, read_uring})
+    {
+        std::atomic<uint64_t> sum(0);
+        std::atomic<size_t> failed(0);
+        auto t0 = clock_type::now();
+        read_method used = read_files(paths, how, 64, [&](size_t i, string &&text, int error) {
+            sum += fingerprint(i, text);
+            failed += error != 0;
+        });
+        double reading = since(t0);
+
+        std::ostringstream report;
+        t0 = clock_type::now();
+        size_t invalid = validate_files(paths, workers, how, report);
+        double validating = since(t0);
+
+        cout << std::left << std::setw(10) << read_method_names[how] << std::setw(9)
+             << read_method_names[used] << std::right << std::fixed << std::setprecision(0)
+             << std::setw(14) << n / reading << std::setw(18) << n / validating << '\n';
+        if (sum != expected || failed)
+        {
+            cout << "MISMATCH: " << read_method_names[how] << " read different bytes\n";
+            ok = false;
+        }
+        if (first_report.empty())
+            first_report = report.str();
+        if (invalid != expected_invalid || report.str() != first_report)
+        {
+            cout << "MISMATCH: " << read_method_names[how] << " found " << invalid
+                 << " invalid files, not " << expected_invalid << '\n';
+            ok = false;
+        }
+    }
+
+    for (const string &p : paths)
+        unlink(p.c_str());
+    rmdir(dir.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+/* Input and output of values: io.hpp against iostream.  Reads a few
+   million ints and reals with >> and with value_input, and writes them
+   with << and with value_output, and then runs programs that do little
+   but read or write on the VM.  What value_input reads must be what >>
+   does, also from a stream that hands out a few bytes at a time, and
+   what value_output writes must be to_chars' shortest form of each.
+     usage: bench/io [values]
+*/
+
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "io.hpp"
+#include "vm.hpp"
+
+using std::cout;
+
+// A stream buffer that has only a few bytes at hand at a time, as a
+// pipe might.
+class trickle : public std::streambuf
+{
+    const string &text;
+    size_t at = 0;
+    char buf[7];
+
+    int_type underflow() override
+    {
+        if (at == text.size())
+            return traits_type::eof();
+        size_t n = text.copy(buf, sizeof buf, at);
+        at += n;
+        setg(buf, buf, buf + n);
+        return traits_type::to_int_type(buf[0]);
+    }
+
+public:
+    explicit trickle(const string &text) : text(text) {}
+};
+
+template <class F>
+static double seconds(F f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void line(const char *what, double mine, double theirs, size_t values)
+{
+    cout << std::left << std::setw(22) << what << std::right << std::fixed << std::setprecision(1)
+         << std::setw(12) << values / theirs / 1e6 << std::setw(12) << values / mine / 1e6
+         << std::setw(8) << theirs / mine << "x\n";
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = argc > 1 ? std::atol(argv[1]) : 2000000;
+    bool ok = true;
+    std::mt19937_64 rng(11);
+    std::vector<int64_t> ints(n);
+    std::vector<double> reals(n);
+    string int_text, real_text;
+    char buf[32];
+    for (size_t k = 0; k < n; k++)
+    {
+        ints[k] = int64_t(rng()) >> (rng() % 64);
+        reals[k] = (int64_t(rng() >> 11) - (int64_t(1) << 52)) / double(1 << (rng() % 40));
+        int_text.append(buf, std::to_chars(buf, buf + sizeof buf, ints[k]).ptr) += k % 8 ? ' ' : '\n';
+        real_text.append(buf, std::to_chars(buf, buf + sizeof buf, reals[k]).ptr) += '\n';
+    }
+
+    cout << std::left << std::setw(22) << "million values/s" << std::right << std::setw(12)
+         << "iostream" << std::setw(12) << "io.hpp" << std::setw(9) << "speedup\n";
+
+    // Reading.
+    std::vector<int64_t> got_ints(n), want_ints(n);
+    std::vector<double> got_reals(n), want_reals(n);
+    double t_theirs = seconds([&] {
+        std::istringstream in(int_text);
+        for (int64_t &v : want_ints)
+            in >> v;
+    });
+    double t_mine = seconds([&] {
+        std::istringstream in(int_text);
+        value_input input(in);
+        for (int64_t &v : got_ints)
+            input.read(v);
+    });
+    line("read int", t_mine, t_theirs, n);
+    ok &= got_ints == want_ints && got_ints == ints;
+    t_theirs = seconds([&] {
+        std::istringstream in(real_text);
+        for (double &v : want_reals)
+            in >> v;
+    });
+    t_mine = seconds([&] {
+        std::istringstream in(real_text);
+        value_input input(in);
+        for (double &v : got_reals)
+            input.read(v);
+    });
+    line("read real", t_mine, t_theirs, n);
+    ok &= got_reals == want_reals && got_reals == reals;
+    {
+        trickle t(real_text);
+        std::istream in(&t);
+        value_input input(in);
+        for (double &v : got_reals)
+            input.read(v);
+        double extra;
+        ok &= got_reals == reals && input.read(extra) == string("no more input");
+    }
+    if (!ok)
+        cout << "MISMATCH: value_input does not read what >> does\n";
+
+    // Writing.
+    string want, got;
+    t_theirs = seconds([&] {
+        std::ostringstream out;
+        for (int64_t v : ints)
+            out << v << '\n';
+        want = out.str();
+    });
+    t_mine = seconds([&] {
+        std::ostringstream out;
+        {
+            value_output output(out);
+            for (int64_t v : ints)
+                output.write(v);
+        }
+        got = out.str();
+    });
+    line("write int", t_mine, t_theirs, n);
+    if (got != want)
+    {
+        cout << "MISMATCH: value_output does not write the ints << does\n";
+        ok = false;
+    }
+    t_theirs = seconds([&] {
+        std::ostringstream out;
+        out << std::setprecision(std::numeric_limits<double>::max_digits10);
+        for (double v : reals)
+            out << v << '\n';
+    });
+    t_mine = seconds([&] {
+        std::ostringstream out;
+        {
+            value_output output(out);
+            for (double v : reals)
+                output.write(v);
+        }
+        got = out.str();
+    });
+    line("write real", t_mine, t_theirs, n);
+    if (got != real_text)
+    {
+        cout << "MISMATCH: value_output does not write reals in their shortest form\n";
+        ok = false;
+    }
+
+    // Programs on the VM.
+    struct io_program
+    {
+        const char *name;
+        const char *text;
+        const string *input;
+        size_t values;
+    };
+    string count = std::to_string(n);
+    const io_program programs[] = {
+        {"sum of ints",
+         "read int n; int s := 0;\n"
+         "while n > 0 do read int x; s := s + x; n := n - 1; end;\n"
+         "write s;\n",
+         &int_text, n},
+        {"writes",
+         "read int n; int i := 0;\n"
+         "while i < n do write i * i; write float(i) / 7.0; i := i + 1; end;\n",
+         &count, 2 * n},
+    };
+    cout << '\n' << std::left << std::setw(22) << "program" << std::right << std::setw(12)
+         << "ms" << std::setw(18) << "million values/s\n";
+    for (const io_program &io : programs)
+    {
+        std::istringstream text(io.text);
+        vm_program p;
+        compile(text, p, true, cout);
+        string input = io.input == &count ? count : count + ' ' + *io.input;
+        std::ostringstream out;
+        bool ran;
+        double t = seconds([&] {
+            std::istringstream in(input);
+            ran = run(p, in, out, out);
+        });
+        cout << std::left << std::setw(22) << io.name << std::right << std::setw(12)
+             << std::setprecision(1) << 1000 * t << std::setw(12) << io.values / t / 1e6 << '\n';
+        if (!ran)
+        {
+            cout << "MISMATCH: " << io.name << " failed: " << out.str().substr(0, 200) << '\n';
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
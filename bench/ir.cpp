@@ -0,0 +1,79 @@
+/* What the optimizations save.  Runs each program of the corpus on the
+   VM as written and optimized, and reports the instructions run and the
+   time taken by each, with what each optimization removed or moved.
+   The output of the two must be the same.
+     usage: bench/ir
+*/
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "corpus.hpp"
+#include "parse.hpp"
+#include "vm.hpp"
+
+using std::cout;
+
+struct outcome
+{
+    string output;
+    uint64_t executed = 0;
+    double seconds;
+};
+
+static outcome execute(const vm_program &p, const char *input)
+{
+    outcome o;
+    std::istringstream in(input);
+    std::ostringstream out;
+    auto t0 = std::chrono::steady_clock::now();
+    if (!run(p, in, out, out, &o.executed))
+        o.output = "failed: ";
+    o.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    o.output += out.str();
+    return o;
+}
+
+int main()
+{
+    bool ok = true;
+    cout << std::left << std::setw(10) << "program" << std::right << std::setw(13) << "executed -O0"
+         << std::setw(13) << "executed" << std::setw(7) << "saved" << std::setw(10) << "ms -O0"
+         << std::setw(8) << "ms" << "   copies common hoisted dead\n";
+    for (const corpus_program &c : corpus)
+    {
+        std::istringstream text(c.text);
+        std::ostream discard(nullptr);
+        scanner s(text, discard);
+        basic_parser<scanner, no_probe, no_trace, fail_fast> parse(s, discard, discard);
+        parse.program();
+        ir_program ir;
+        if (parse.failed() || !build_ir(parse.tree(), ir, cout))
+        {
+            cout << "MISMATCH: " << c.name << " does not compile\n";
+            ok = false;
+            continue;
+        }
+        outcome before = execute(lower(ir), c.input);
+        ir_counts n = optimize(ir);
+        outcome after = execute(lower(ir), c.input);
+        cout << std::left << std::setw(10) << c.name << std::right << std::setw(13)
+             << before.executed << std::setw(13) << after.executed << std::fixed
+             << std::setprecision(0) << std::setw(6)
+             << 100.0 * (before.executed - after.executed) / before.executed << '%'
+             << std::setprecision(1) << std::setw(10) << before.seconds * 1e3 << std::setw(8)
+             << after.seconds * 1e3 << std::setw(9) << n.copies << std::setw(7) << n.common
+             << std::setw(9) << n.hoisted << std::setw(5) << n.dead << '\n';
+        if (after.output != before.output)
+        {
+            cout << "MISMATCH: " << c.name << " wrote\n"
+                 << before.output << "as written, but\n"
+                 << after.output << "optimized\n";
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
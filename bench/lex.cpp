@@ -0,0 +1,86 @@
+/* Scaling of the parallel scanner, checked against the sequential one.
+   Every parallel token array and its diagnostics are compared with those
+   of lex() before its time is reported, first on clean input and then on
+   input sprinkled with lexical errors, which exercises the stitching of
+   chunks.  A final pass repeats the comparison over many seeds and chunk
+   counts, so that cuts land inside every kind of token.
+     usage: bench/lex [megabytes]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "gen.hpp"
+#include "lex.hpp"
+
+using std::cout;
+
+template <class F>
+static double seconds(F f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static bool same(const std::vector<lexeme> &a, const std::vector<lexeme> &b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(lexeme)) == 0;
+}
+
+static bool scaling(const char *label, const string &text)
+{
+    std::ostringstream seq_diag;
+    std::vector<lexeme> expect;
+    double base = seconds([&] { expect = lex(text.data(), text.size(), seq_diag); });
+    cout << label << ": " << text.size() << " bytes, " << expect.size() << " tokens\n";
+    cout << "  sequential  " << std::fixed << std::setprecision(3) << base << " s  "
+         << std::setprecision(1) << text.size() / base / 1e6 << " MB/s\n";
+    for (unsigned threads = 1; threads <= 32; threads *= 2)
+    {
+        std::ostringstream par_diag;
+        std::vector<lexeme> got;
+        double t = seconds([&] { got = lex_parallel(text.data(), text.size(), threads, par_diag); });
+        bool ok = same(got, expect) && par_diag.str() == seq_diag.str();
+        cout << "  threads " << std::setw(2) << threads << "  " << std::setprecision(3) << t << " s  "
+             << std::setprecision(1) << text.size() / t / 1e6 << " MB/s  speedup "
+             << std::setprecision(2) << base / t << (ok ? "" : "  MISMATCH") << "\n";
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mb = argc > 1 ? std::atoi(argv[1]) : 16;
+    cout << std::thread::hardware_concurrency() << " cores\n";
+    if (!scaling("clean", generate(mb << 20)) || !scaling("with errors", generate(mb << 20, 0.05)))
+        return 1;
+
+    int checked = 0;
+    for (unsigned seed = 1; seed <= 20; seed++)
+    {
+        string text = generate(1 << 20, 0.2, seed);
+        std::ostringstream seq_diag;
+        std::vector<lexeme> expect = lex(text.data(), text.size(), seq_diag);
+        for (unsigned threads = 2; threads <= 16; threads++, checked++)
+        {
+            std::ostringstream par_diag;
+            if (!same(lex_parallel(text.data(), text.size(), threads, par_diag), expect) ||
+                par_diag.str() != seq_diag.str())
+            {
+                cout << "MISMATCH: seed " << seed << ", " << threads << " threads\n";
+                return 1;
+            }
+        }
+    }
+    cout << "differential check: " << checked << " splits agree with the sequential scanner\n";
+    return 0;
+}
@@ -0,0 +1,124 @@
+/* What bounding a run costs.  Runs tight loops on the VM with no limits,
+   with an instruction budget, with a time limit, and with both, the
+   limits set too high to be reached, and reports the time taken by
+   each.  Then runs a loop that never ends, which each limit must stop
+   close to where it is set.
+     usage: bench/limits
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "vm.hpp"
+
+using std::cout;
+
+struct loop_program
+{
+    const char *name;
+    const char *text;
+};
+
+const loop_program programs[] = {
+    {"count", "int i := 0; while i < 30000000 do i := i + 1; end; write i;\n"},
+    {"nested",
+     "int i := 0; int s := 0;\n"
+     "while i < 3000 do\n"
+     "  int j := 0;\n"
+     "  while j < 3000 do s := s + j; j := j + 1; end;\n"
+     "  i := i + 1;\n"
+     "end;\n"
+     "write s;\n"},
+    {"real", "real x := 0.0; while x < 10000000.0 do x := x + 0.5; end; write x;\n"},
+};
+
+// The least time of a few runs, with the output of the last.
+static double best(const vm_program &p, const vm_limits &limits, string &output)
+{
+    double t = 1e9;
+    vm_frame frame;
+    for (int k = 0; k < 3; k++)
+    {
+        std::istringstream in;
+        std::ostringstream out;
+        auto t0 = std::chrono::steady_clock::now();
+        run(p, frame, limits, in, out, out);
+        t = std::min(t, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+        output = out.str();
+    }
+    return t;
+}
+
+int main()
+{
+    bool ok = true;
+    vm_limits budget, timed, both;
+    budget.instructions = both.instructions = 1ull << 62;
+    timed.time = both.time = std::chrono::hours(1);
+    cout << std::left << std::setw(10) << "program" << std::right << std::setw(10) << "none ms"
+         << std::setw(12) << "budget" << std::setw(12) << "time" << std::setw(12) << "both\n";
+    for (const loop_program &lp : programs)
+    {
+        std::istringstream text(lp.text);
+        vm_program p;
+        if (!compile(text, p, true, cout))
+        {
+            cout << "MISMATCH: " << lp.name << " does not compile\n";
+            ok = false;
+            continue;
+        }
+        string want, got;
+        double t = best(p, vm_limits(), want);
+        cout << std::left << std::setw(10) << lp.name << std::right << std::fixed
+             << std::setprecision(1) << std::setw(10) << 1000 * t;
+        for (const vm_limits *l : {&budget, &timed, &both})
+        {
+            double u = best(p, *l, got);
+            cout << std::setw(11) << std::showpos << 100 * (u / t - 1) << std::noshowpos << '%';
+            if (got != want)
+            {
+                cout << "\nMISMATCH: " << lp.name << " writes " << got << "under limits, not "
+                     << want;
+                ok = false;
+            }
+        }
+        cout << '\n';
+    }
+
+    // A loop that never ends.
+    std::istringstream text("int i := 0; while 0 < 1 do i := i + 1; end;\n");
+    vm_program p;
+    compile(text, p);
+    vm_frame frame;
+    vm_limits l;
+    l.instructions = 10000000;
+    std::istringstream in;
+    std::ostringstream out, diag;
+    uint64_t executed = 0;
+    if (run(p, frame, l, in, out, diag, &executed) || executed < l.instructions ||
+        executed > l.instructions + p.code.size() ||
+        diag.str() != "runtime error: ran out of its budget of 10000000 instructions\n")
+    {
+        cout << "MISMATCH: a budget of " << l.instructions << " stopped an endless loop after "
+             << executed << " instructions, with " << diag.str() << '\n';
+        ok = false;
+    }
+    l = vm_limits();
+    l.time = std::chrono::milliseconds(100);
+    diag.str("");
+    auto t0 = std::chrono::steady_clock::now();
+    bool ran = run(p, frame, l, in, out, diag);
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    cout << "an endless loop with 100 ms to run stopped after " << std::setprecision(1)
+         << 1000 * t << " ms\n";
+    if (ran || t < 0.1 || t > 0.2 || diag.str() != "runtime error: ran out of its time of 100 ms\n")
+    {
+        cout << "MISMATCH: it stopped with " << diag.str() << '\n';
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
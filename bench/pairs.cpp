@@ -0,0 +1,87 @@
+/* Picks the VM's superinstructions.  Runs each program of the corpus,
+   lowered but not fused, and counts how often each pair of opcodes that
+   fuse() could join ran one after the other: a pair of instructions next
+   to each other in the code, where the first does not jump and the
+   second is not jumped to.  Writes the most frequent pairs as the fusion
+   table, fusion.inc, to standard output, and the counts to standard
+   error.
+     usage: bench/pairs [pairs] > fusion.inc
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include "corpus.hpp"
+#include "parse.hpp"
+#include "profile.hpp"
+
+using std::cerr;
+using std::cout;
+
+int main(int argc, char *argv[])
+{
+    size_t wanted = argc > 1 ? std::atol(argv[1]) : 16;
+    std::map<std::pair<vm_op, vm_op>, uint64_t> pairs;
+    uint64_t total = 0;
+    for (const corpus_program &c : corpus)
+    {
+        std::istringstream text(c.text);
+        std::ostream discard(nullptr);
+        scanner s(text, discard);
+        basic_parser<scanner, no_probe, no_trace, fail_fast> parse(s, discard, discard);
+        parse.program();
+        ir_program ir;
+        if (parse.failed() || !build_ir(parse.tree(), ir, cerr))
+        {
+            cerr << c.name << " does not compile\n";
+            return 1;
+        }
+        optimize(ir);
+        vm_program p = lower(ir);
+        run_profile profile;
+        std::istringstream in(c.input);
+        std::ostringstream out;
+        run(p, profile, in, out, out);
+
+        std::set<uint32_t> targets;
+        for (const vm_inst &x : p.code)
+            if (x.op == vm_jump)
+                targets.insert(x.a);
+            else if (x.op == vm_jump_if || x.op == vm_jump_unless)
+                targets.insert(x.b);
+        for (size_t k = 0; k < p.code.size(); k++)
+        {
+            total += profile.count(k);
+            vm_op op = p.code[k].op;
+            if (k + 1 < p.code.size() && op < vm_jump && !targets.count(k + 1))
+                pairs[{op, p.code[k + 1].op}] += profile.count(k);
+        }
+    }
+
+    std::vector<std::pair<uint64_t, std::pair<vm_op, vm_op>>> ranked;
+    for (auto &p : pairs)
+        ranked.push_back({p.second, p.first});
+    std::sort(ranked.rbegin(), ranked.rend());
+    ranked.resize(std::min(ranked.size(), wanted));
+
+    cerr << std::setw(24) << "pair" << std::setw(14) << "count" << std::setw(8) << "%\n";
+    cout << "/* The VM's superinstructions, each a pair of opcodes that fuse() joins\n"
+            "   into one and run() dispatches once.  Written by bench/pairs, from how\n"
+            "   often each pair ran in the programs of bench/corpus.hpp; do not edit.\n"
+            "     FUSE(name, first, second)\n"
+            "*/\n\n";
+    for (auto &r : ranked)
+    {
+        string first = vm_op_names[r.second.first], second = vm_op_names[r.second.second];
+        cout << "FUSE(" << first << "_" << second << ", " << first << ", " << second << ")\n";
+        cerr << std::setw(24) << first + " " + second << std::setw(14) << r.first << std::setw(7)
+             << std::fixed << std::setprecision(1) << 100.0 * r.first / total << "%\n";
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+/* Speedup of parallel parsing over the sequential parser.
+   Generates a large flat program, parses it once sequentially and then
+   in parallel on 1 to 32 threads, and checks every parallel trace
+   and diagnostics against the sequential ones.
+     usage: bench/parallel [megabytes]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "gen.hpp"
+#include "parse.hpp"
+#include "parallel.hpp"
+
+using std::cout;
+
+template <class F>
+static double seconds(F f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mb = argc > 1 ? std::atoi(argv[1]) : 16;
+    string text = generate(mb << 20);
+
+    std::ostringstream seq, seq_diag;
+    double base = seconds([&] {
+        memstream in(text.data(), text.data() + text.size());
+        parser p(in, seq, seq_diag);
+        p.program();
+    });
+    string expect = seq.str(), expect_diag = seq_diag.str();
+    cout << "input " << text.size() << " bytes, " << std::thread::hardware_concurrency() << " cores\n";
+    cout << "sequential  " << std::fixed << std::setprecision(3) << base << " s\n";
+
+    for (unsigned threads = 1; threads <= 32; threads *= 2)
+    {
+        std::ostringstream par, par_diag;
+        double t = seconds([&] { parse_parallel(text.data(), text.size(), threads, par, par_diag); });
+        bool same = par.str() == expect && par_diag.str() == expect_diag;
+        cout << "threads " << std::setw(2) << threads << "  " << t << " s  speedup "
+             << std::setprecision(2) << base / t << std::setprecision(3)
+             << (same ? "" : "  MISMATCH") << "\n";
+        if (!same)
+            return 1;
+    }
+    return 0;
+}
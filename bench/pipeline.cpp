@@ -0,0 +1,100 @@
+/* Pipelined scanning and parsing against the interleaved parser.
+   Throughput is measured on one large program and latency on many small
+   ones; every pipelined trace is checked against the interleaved one.
+     usage: bench/pipeline [megabytes]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gen.hpp"
+#include "lex.hpp"
+#include "parse.hpp"
+#include "pipeline.hpp"
+
+using std::cout;
+
+template <class F>
+static double seconds(F f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void interleaved(const string &text, std::ostream &out, std::ostream &diag)
+{
+    memstream in(text.data(), text.data() + text.size());
+    parser p(in, out, diag);
+    p.program();
+}
+
+static void pipelined(const string &text, std::ostream &out, std::ostream &diag)
+{
+    parse_pipelined(text.data(), text.size(), out, diag);
+}
+
+template <class F>
+static bool throughput(const char *label, F parse, const string &text, size_t tokens,
+                       const string &expect, const string &expect_diag)
+{
+    std::ostringstream out, diag;
+    double t = seconds([&] { parse(text, out, diag); });
+    bool ok = out.str() == expect && diag.str() == expect_diag;
+    cout << "  " << std::left << std::setw(12) << label << std::right << std::fixed
+         << std::setprecision(3) << t << " s  " << std::setprecision(1)
+         << text.size() / t / 1e6 << " MB/s  " << tokens / t / 1e6 << " Mtokens/s"
+         << (ok ? "" : "  MISMATCH") << "\n";
+    return ok;
+}
+
+template <class F>
+static bool latency(const char *label, F parse, const string &text, const string &expect)
+{
+    const int runs = 2000;
+    std::vector<double> us;
+    bool ok = true;
+    for (int i = 0; i < runs; i++)
+    {
+        std::ostringstream out, diag;
+        us.push_back(seconds([&] { parse(text, out, diag); }) * 1e6);
+        ok = ok && out.str() == expect;
+    }
+    std::sort(us.begin(), us.end());
+    cout << "  " << std::left << std::setw(12) << label << std::right << std::setprecision(1)
+         << "p50 " << us[runs / 2] << " us  p99 " << us[runs * 99 / 100] << " us"
+         << (ok ? "" : "  MISMATCH") << "\n";
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mb = argc > 1 ? std::atoi(argv[1]) : 16;
+    cout << std::thread::hardware_concurrency() << " cores\n";
+
+    string big = generate(mb << 20);
+    std::ostringstream seq, seq_diag, lex_diag;
+    interleaved(big, seq, seq_diag);
+    string expect = seq.str(), expect_diag = seq_diag.str();
+    size_t tokens = lex(big.data(), big.size(), lex_diag).size();
+    cout << "throughput, " << big.size() << " bytes, " << tokens << " tokens\n";
+    if (!throughput("interleaved", interleaved, big, tokens, expect, expect_diag) ||
+        !throughput("pipelined", pipelined, big, tokens, expect, expect_diag))
+        return 1;
+
+    string small = generate(1 << 10);
+    std::ostringstream small_out, small_diag;
+    interleaved(small, small_out, small_diag);
+    cout << "latency, " << small.size() << " byte program\n";
+    if (!latency("interleaved", interleaved, small, small_out.str()) ||
+        !latency("pipelined", pipelined, small, small_out.str()))
+        return 1;
+    return 0;
+}
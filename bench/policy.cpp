@@ -0,0 +1,114 @@
+/* The parser with and without its policies' work.
+   Parses programs from generate_shaped() with the teaching parser, its
+   trace discarded, and with validator<scanner>, which neither traces,
+   recovers nor builds a tree, and checks that the validator accepts
+   every valid program and rejects every program with errors in it.
+   Then does the same for small programs written by hand, among them
+   valid ones where the teaching parser reports errors that are not
+   there, and invalid ones it once let through.
+     usage: bench/policy [megabytes]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "gen.hpp"
+#include "parse.hpp"
+
+using std::cout;
+
+// Small programs, and whether each is valid.
+const struct
+{
+    const char *text;
+    bool valid;
+} small[] = {
+    {"", true},
+    {"write trunc(1.5);", true},
+    {"real x := float(2) * 1.5; if x > 1.0 then write trunc(x); end;", true},
+    {"int i := 0; while i < 3 do i := i + 1; end; write i;", true},
+    {"trunc(1);", false},
+    {"float (x); garbage @@@", false},
+    {"float(2) + 1; write 1;", false},
+    {"write 1", false},
+    {"write (1;", false},
+    {"if 1 then write 1;", false},
+    {"int := 1;", false},
+    {"write 1; end;", false},
+    {"write 1 @;", false},
+};
+
+template <class Parser>
+static double run(const string &text, bool &failed)
+{
+    std::ostream discard(nullptr);
+    memstream in(text.data(), text.data() + text.size());
+    scanner s(in, discard);
+    auto t0 = std::chrono::steady_clock::now();
+    Parser p(s, discard, discard);
+    p.program();
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    failed = p.error_count() > 0;
+    return t;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mb = argc > 1 ? std::atoi(argv[1]) : 4;
+    bool ok = true;
+    cout << std::left << std::setw(10) << "shape" << std::right << std::setw(12) << "parser MB/s"
+         << std::setw(15) << "validator MB/s" << std::setw(9) << "speedup" << '\n';
+    for (unsigned seed = 1; seed <= 4; seed++)
+    {
+        for (double rate : {0.0, 0.01})
+        {
+            shape sh;
+            sh.bytes = mb << 20;
+            sh.depth = seed;
+            sh.expr_length = 2 * seed;
+            sh.error_rate = rate;
+            sh.seed = seed;
+            string text = generate_shaped(sh);
+            bool parser_failed, validator_failed;
+            double t_parser = run<basic_parser<scanner>>(text, parser_failed);
+            double t_validator = run<validator<scanner>>(text, validator_failed);
+            string name = (rate ? "noisy-" : "valid-") + std::to_string(seed);
+            cout << std::left << std::setw(10) << name << std::right << std::fixed
+                 << std::setprecision(1) << std::setw(12) << text.size() / t_parser / 1e6
+                 << std::setw(15) << text.size() / t_validator / 1e6;
+            // The validator stops at the first error, so a speedup means
+            // nothing on noisy programs.
+            if (rate > 0)
+                cout << std::setw(9) << "-" << '\n';
+            else
+                cout << std::setw(8) << t_parser / t_validator << "x\n";
+            if (validator_failed != (rate > 0))
+            {
+                cout << "MISMATCH: the validator " << (validator_failed ? "rejected" : "accepted")
+                     << ' ' << name << '\n';
+                ok = false;
+            }
+            if (rate > 0 && !parser_failed)
+            {
+                cout << "MISMATCH: the parser found no error in " << name << '\n';
+                ok = false;
+            }
+        }
+    }
+    for (auto &program : small)
+    {
+        bool failed;
+        run<validator<scanner>>(program.text, failed);
+        if (failed == program.valid)
+        {
+            cout << "MISMATCH: the validator " << (failed ? "rejected" : "accepted") << " '"
+                 << program.text << "'\n";
+            ok = false;
+        }
+    }
+    cout << sizeof small / sizeof small[0] << " small programs checked\n";
+    return ok ? 0 : 1;
+}
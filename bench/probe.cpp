@@ -0,0 +1,63 @@
+/* The cost of parser instrumentation, and a sample of its report.
+   Parses a generated program with no_probe and with parse_profile, and
+   checks that the profile's counts agree with what the parse did.
+     usage: bench/probe [megabytes]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "gen.hpp"
+#include "lex.hpp"
+#include "parse.hpp"
+
+using std::cout;
+
+template <class Probe>
+static double run(const string &text, basic_parser<scanner, Probe> *&keep)
+{
+    static std::ostream discard(nullptr);
+    memstream *in = new memstream(text.data(), text.data() + text.size());
+    scanner *s = new scanner(*in, discard);
+    auto t0 = std::chrono::steady_clock::now();
+    keep = new basic_parser<scanner, Probe>(*s, discard, discard);
+    keep->program();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mb = argc > 1 ? std::atoi(argv[1]) : 4;
+    string text = generate(mb << 20);
+
+    basic_parser<scanner, no_probe> *plain;
+    basic_parser<scanner, parse_profile> *profiled;
+    double t_plain = run(text, plain);
+    double t_profiled = run(text, profiled);
+    const parse_profile &prof = profiled->profile();
+    prof.report(cout);
+    cout << "\nno_probe " << std::fixed << std::setprecision(1) << t_plain * 1e3
+         << " ms, parse_profile " << t_profiled * 1e3 << " ms (+"
+         << (t_profiled / t_plain - 1) * 100 << "%)\n";
+
+    // Every token the parser scanned is counted once by kind.
+    std::ostream discard(nullptr);
+    std::vector<lexeme> tokens = lex(text.data(), text.size(), discard);
+    uint64_t counted = 0;
+    for (int t = 0; t <= t_eof; t++)
+        counted += prof.kind(token(t)).count;
+    bool ok = plain->error_count() == profiled->error_count() &&
+              plain->tree().size() == profiled->tree().size() && prof.method(m_program).calls == 1 &&
+              counted <= tokens.size() + 1 && counted + 1 >= tokens.size() &&
+              prof.method(m_stmt_list).calls > plain->tree().size();
+    if (!ok)
+    {
+        cout << "MISMATCH: profile counts disagree with the parse\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+/* What profiling a run costs.  Runs each program of the corpus on the VM
+   plainly and with a run_profile, and reports the time taken by each.
+   The output must be the same, and the profile must account for every
+   instruction run; in squares, which loops n times, the loop's condition
+   must be tested n + 1 times and each statement of its body run n times.
+     usage: bench/profile
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "corpus.hpp"
+#include "profile.hpp"
+
+using std::cout;
+
+template <class F>
+static double seconds(F f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main()
+{
+    bool ok = true;
+    cout << std::left << std::setw(12) << "program" << std::right << std::setw(14)
+         << "instructions" << std::setw(12) << "plain ms" << std::setw(14) << "profiled ms"
+         << std::setw(10) << "overhead\n";
+    for (const corpus_program &c : corpus)
+    {
+        std::istringstream text(c.text);
+        vm_program p;
+        if (!compile(text, p, true, cout))
+        {
+            cout << "MISMATCH: " << c.name << " does not compile\n";
+            ok = false;
+            continue;
+        }
+        uint64_t executed = 0;
+        string plain_out, profiled_out;
+        double t_plain = seconds([&] {
+            std::istringstream in(c.input);
+            std::ostringstream out;
+            run(p, in, out, out, &executed);
+            plain_out = out.str();
+        });
+        run_profile profile;
+        double t_profiled = seconds([&] {
+            std::istringstream in(c.input);
+            std::ostringstream out;
+            run(p, profile, in, out, out);
+            profiled_out = out.str();
+        });
+        cout << std::left << std::setw(12) << c.name << std::right << std::setw(14) << executed
+             << std::fixed << std::setprecision(1) << std::setw(12) << 1000 * t_plain
+             << std::setw(14) << 1000 * t_profiled << std::setw(8) << t_profiled / t_plain
+             << "x\n";
+
+        if (profiled_out != plain_out)
+        {
+            cout << "MISMATCH: " << c.name << " writes\n"
+                 << profiled_out << "profiled, but\n"
+                 << plain_out << "plainly\n";
+            ok = false;
+        }
+        uint64_t counted = 0, attributed = 0;
+        for (size_t at = 0; at < p.code.size(); at++)
+        {
+            counted += profile.count(at);
+            if (p.origin[at] < 0)
+                attributed += profile.count(at);
+        }
+        std::vector<run_profile::statement_stats> stats = profile.statements(p);
+        for (const run_profile::statement_stats &s : stats)
+            attributed += s.instructions;
+        if (counted != executed || attributed != executed)
+        {
+            cout << "MISMATCH: " << c.name << " ran " << executed << " instructions, but the profile counts "
+                 << counted << " by instruction and " << attributed << " by statement\n";
+            ok = false;
+        }
+        if (string(c.name) != "squares")
+            continue;
+        uint64_t n = std::atol(c.input);
+        for (size_t k = 0; k < stats.size(); k++)
+        {
+            const ir_statement &s = p.statements[k];
+            uint64_t want = s.kind == t_while ? n + 1 : s.parent >= 0 ? n : 1;
+            if (stats[k].instructions && stats[k].runs != want)
+            {
+                cout << "MISMATCH: statement " << k << " of squares ran " << stats[k].runs
+                     << " times, not " << want << '\n';
+                ok = false;
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+/* Push-style parsing, split every way.  Each test program is pushed in
+   two pieces, split at every byte, and then one byte at a time, and the
+   output must be that of parser::program() on the whole of it.  Then a
+   great many parses are kept going at once on this one thread, each fed
+   pieces of random size in turn, and some are abandoned half way.
+   Programs nested as deeply as a parse's stack holds, and past that,
+   must fail as parser::program() fails with the same bound, and not
+   run off the stack.
+     usage: bench/push [parses]
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "gen.hpp"
+#include "parse.hpp"
+#include "push.hpp"
+
+using std::cout;
+
+struct output
+{
+    string trace, diagnostics;
+    size_t statements;
+    bool operator!=(const output &o) const
+    {
+        return trace != o.trace || diagnostics != o.diagnostics || statements != o.statements;
+    }
+};
+
+static output reference(const string &text, int depth = MAX_DEPTH)
+{
+    memstream in(text.data(), text.data() + text.size());
+    std::ostringstream out, diag;
+    parser p(in, out, diag);
+    p.limit_depth(depth);
+    p.program();
+    return {out.str(), diag.str(), p.tree().size()};
+}
+
+// Pushes text in pieces that end at each of cuts.
+static output pushed(const string &text, const std::vector<size_t> &cuts,
+                     size_t stack_size = 640 * 1024)
+{
+    std::ostringstream out, diag;
+    push_parser p(out, diag, stack_size);
+    size_t from = 0;
+    for (size_t to : cuts)
+    {
+        p.push(text.data() + from, to - from);
+        from = to;
+    }
+    p.push(text.data() + from, text.size() - from);
+    p.finish();
+    return {out.str(), diag.str(), p.tree().size()};
+}
+
+static string repeat(const string &s, int n)
+{
+    string r;
+    for (int k = 0; k < n; k++)
+        r += s;
+    return r;
+}
+
+// Programs n levels deep in each way the parser recurses.
+static std::vector<string> nested(int n)
+{
+    return {"write " + repeat("(", n) + "1" + repeat(")", n) + ";\n",
+            "write " + repeat("trunc(", n) + "1.5" + repeat(")", n) + ";\n",
+            "write 1" + repeat(" + 2 * 3", n) + ";\n",
+            repeat("while 1 > 2 do\n", n) + "x := 1;\n" + repeat("end;\n", n)};
+}
+
+static long rss()
+{
+    long pages = 0, resident = 0;
+    if (FILE *f = std::fopen("/proc/self/statm", "r"))
+    {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        std::fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t parses = argc > 1 ? std::atol(argv[1]) : 10000;
+    bool ok = true;
+
+    std::ifstream f("input.txt", std::ios::binary);
+    std::vector<string> programs = {
+        string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>())};
+    for (double rate : {0.0, 0.1})
+    {
+        shape sh;
+        sh.bytes = 3000;
+        sh.depth = 3;
+        sh.error_rate = rate;
+        sh.seed = 7;
+        programs.push_back(generate_shaped(sh));
+    }
+    size_t splits = 0;
+    for (const string &text : programs)
+    {
+        output want = reference(text);
+        for (size_t k = 0; k <= text.size(); k++, splits++)
+            if (pushed(text, {k}) != want)
+            {
+                cout << "MISMATCH: split at byte " << k << " of a " << text.size()
+                     << "-byte program\n";
+                ok = false;
+                break;
+            }
+        std::vector<size_t> every(text.size());
+        for (size_t k = 0; k < text.size(); k++)
+            every[k] = k + 1;
+        if (pushed(text, every) != want)
+        {
+            cout << "MISMATCH: a " << text.size() << "-byte program pushed a byte at a time\n";
+            ok = false;
+        }
+    }
+    cout << splits << " two-piece splits and " << programs.size()
+         << " byte-at-a-time pushes checked\n";
+
+    // Deep nesting, on stacks of a few sizes.
+    for (size_t stack_size : {48 * 1024, 128 * 1024, 640 * 1024})
+    {
+        int depth = push_parser(cout, cout, stack_size).max_depth();
+        for (int n : {depth - 2, depth + 1, 100000})
+            for (const string &text : nested(n))
+            {
+                std::vector<size_t> cuts;
+                for (size_t k = 4096; k < text.size(); k += 4096)
+                    cuts.push_back(k);
+                if (pushed(text, cuts, stack_size) != reference(text, depth))
+                {
+                    cout << "MISMATCH: " << n << " levels on a " << stack_size / 1024
+                         << " KB stack\n";
+                    ok = false;
+                }
+            }
+        cout << "nested " << depth << " deep and past that on a " << stack_size / 1024
+             << " KB stack\n";
+    }
+
+    // Many at once.
+    std::vector<string> texts(parses);
+    std::vector<output> wanted(parses);
+    size_t bytes = 0;
+    for (size_t k = 0; k < parses; k++)
+    {
+        shape sh;
+        sh.bytes = 500 + k % 1500;
+        sh.depth = k % 4;
+        sh.error_rate = k % 5 == 0 ? 0.05 : 0;
+        sh.seed = k + 1;
+        texts[k] = generate_shaped(sh);
+        wanted[k] = reference(texts[k]);
+        bytes += texts[k].size();
+    }
+    long rss_before = rss();
+    std::vector<std::unique_ptr<std::ostringstream>> outs(parses), diags(parses);
+    std::vector<std::unique_ptr<push_parser>> live(parses);
+    std::vector<size_t> fed(parses, 0);
+    for (size_t k = 0; k < parses; k++)
+    {
+        outs[k].reset(new std::ostringstream);
+        diags[k].reset(new std::ostringstream);
+        live[k].reset(new push_parser(*outs[k], *diags[k]));
+    }
+    std::mt19937 rng(1);
+    auto t0 = std::chrono::steady_clock::now();
+    long rss_peak = 0;
+    for (size_t remaining = parses; remaining > 0;)
+    {
+        for (size_t k = 0; k < parses; k++)
+        {
+            if (!live[k])
+                continue;
+            size_t n = std::min<size_t>(1 + rng() % 64, texts[k].size() - fed[k]);
+            live[k]->push(texts[k].data() + fed[k], n);
+            fed[k] += n;
+            if (fed[k] == texts[k].size())
+            {
+                live[k]->finish();
+                output got = {outs[k]->str(), diags[k]->str(), live[k]->tree().size()};
+                if (got != wanted[k])
+                {
+                    cout << "MISMATCH: parse " << k << " of those at once\n";
+                    ok = false;
+                }
+                live[k].reset();
+                remaining--;
+            }
+            else if (k % 97 == 0 && fed[k] > texts[k].size() / 2)
+            {
+                live[k].reset(); // abandoned
+                remaining--;
+            }
+        }
+        rss_peak = std::max(rss_peak, rss());
+    }
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    cout << parses << " parses at once on one thread: " << std::fixed << std::setprecision(1)
+         << bytes / t / 1e6 << " MB/s in pieces of 1-64 bytes, " << (rss_peak - rss_before) / parses
+         << " KB resident per parse\n";
+    return ok ? 0 : 1;
+}
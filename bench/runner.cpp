@@ -0,0 +1,102 @@
+/* run_lines() timed by number of workers.  Runs a loop-heavy program over
+   many lines of input with 1, 2, 4, ... workers, up to twice the cores,
+   and reports lines per second and the speedup over one worker, and with
+   as many workers as cores, how near that is to linear.  On one core
+   there is nothing to scale to, and the speedups show only what the pool
+   costs; how run_lines() scales has then not been measured, and the
+   bench says so.  The output and errors must be those of running each
+   line in turn.
+     usage: bench/runner [lines]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "runner.hpp"
+#include "scan.hpp"
+
+using std::cout;
+
+// Sums i * i mod m for i below n, and divides by zero for n of 7 mod 1000.
+const char *const PROGRAM = "read int n; read int m;\n"
+                            "int i := 0; int s := 0;\n"
+                            "while i < n do\n"
+                            "  s := s + i * i;\n"
+                            "  s := s - s / m * m;\n"
+                            "  i := i + 1;\n"
+                            "end;\n"
+                            "write s;\n"
+                            "if n - n / 1000 * 1000 == 7 then write 1 / 0; end;\n"
+                            "write float(s) / float(m);\n";
+
+int main(int argc, char *argv[])
+{
+    size_t lines = argc > 1 ? std::atol(argv[1]) : 20000;
+    std::istringstream text(PROGRAM);
+    vm_program p;
+    if (!compile(text, p, true, cout))
+        return 1;
+
+    std::mt19937 rng(3);
+    string input;
+    for (size_t k = 0; k < lines; k++)
+        input += std::to_string(500 + rng() % 1000) + ' ' + std::to_string(1 + rng() % 100000) + '\n';
+
+    // Each line in turn.
+    std::ostringstream want_out, want_diag;
+    size_t want_failed = 0, line = 1;
+    vm_frame frame;
+    for (size_t at = 0; at < input.size(); line++)
+    {
+        size_t eol = input.find('\n', at);
+        memstream in(input.data() + at, input.data() + eol);
+        std::ostringstream error;
+        if (!run(p, frame, in, want_out, error))
+        {
+            want_diag << "line " << line << ": " << error.str();
+            want_failed++;
+        }
+        at = eol + 1;
+    }
+
+    bool ok = true;
+    unsigned cores = std::thread::hardware_concurrency();
+    cout << lines << " lines on " << cores << " cores\n"
+         << std::setw(8) << "workers" << std::setw(12) << "lines/s" << std::setw(9) << "speedup\n";
+    double base = 0, efficiency = 0;
+    unsigned most = 1; // workers, at most one a core
+    for (unsigned workers = 1; workers <= 2 * cores || workers <= 4; workers *= 2)
+    {
+        std::istringstream in(input);
+        std::ostringstream out, diag;
+        auto t0 = std::chrono::steady_clock::now();
+        size_t failed = run_lines(p, in, workers, out, diag);
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if (workers == 1)
+            base = t;
+        cout << std::setw(8) << workers << std::fixed << std::setprecision(0) << std::setw(12)
+             << lines / t << std::setprecision(2) << std::setw(8) << base / t << "x\n";
+        if (workers <= cores)
+        {
+            efficiency = base / t / workers;
+            most = workers;
+        }
+        if (out.str() != want_out.str() || diag.str() != want_diag.str() || failed != want_failed)
+        {
+            cout << "MISMATCH: the output of " << workers << " workers is not that of one line at a time\n";
+            ok = false;
+        }
+    }
+    if (cores < 2)
+        cout << "one core: scaling with cores not measured\n";
+    else
+        cout << most << " workers on " << cores << " cores: " << std::setprecision(0)
+             << efficiency * 100 << "% of linear\n";
+    return ok ? 0 : 1;
+}
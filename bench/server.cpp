@@ -0,0 +1,427 @@
+/* A load generator for parse -S.  Starts the server, and has a number of
+   clients, each on a connection of its own, send it small generated
+   programs one after another for a while, checking every answer against
+   the parser run in this process.  Reports requests a second and the
+   median and 99th percentile latency, beside the same for starting
+   ./parse afresh for each program.  Then plays a few hostile clients (see
+   hostile below), after each of which the server must still answer, and
+   starts a server with few descriptors to see it does not spin when
+   they run out (see starved below).
+     usage: bench/server [clients] [seconds]
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "gen.hpp"
+#include "parse.hpp"
+#include "server.hpp"
+
+using std::cout;
+
+typedef std::chrono::steady_clock clock_type;
+
+static double since(clock_type::time_point t0)
+{
+    return std::chrono::duration<double>(clock_type::now() - t0).count();
+}
+
+static int connect_to(const string &path)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof addr.sun_path - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool write_all(int fd, const string &s)
+{
+    for (size_t done = 0; done < s.size();)
+    {
+        ssize_t n = write(fd, s.data() + done, s.size() - done);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+// Reads one answer: its header line, and then as many bytes as that says.
+static bool read_answer(int fd, string &buf, string &answer)
+{
+    char chunk[64 * 1024];
+    size_t eol, need = string::npos;
+    while (true)
+    {
+        if (need == string::npos && (eol = buf.find('\n')) != string::npos)
+        {
+            size_t trace, diag;
+            if (std::sscanf(buf.c_str(), "%zu %zu", &trace, &diag) != 2)
+                return false;
+            need = eol + 1 + trace + diag;
+        }
+        if (buf.size() >= need)
+            break;
+        ssize_t n = read(fd, chunk, sizeof chunk);
+        if (n <= 0)
+            return false;
+        buf.append(chunk, n);
+    }
+    answer = buf.substr(0, need);
+    buf.erase(0, need);
+    return true;
+}
+
+// What parse prints for text, framed as the server answers.
+static string answer_for(const string &text)
+{
+    memstream in(text.data(), text.data() + text.size());
+    std::ostringstream out, diag;
+    parser p(in, out, diag);
+    p.program();
+    return std::to_string(out.str().size()) + ' ' + std::to_string(diag.str().size()) + '\n' +
+           out.str() + diag.str();
+}
+
+static string frame(const string &text)
+{
+    return std::to_string(text.size()) + '\n' + text;
+}
+
+// Connects as connect_to does, but gives up on a read after a few seconds,
+// so that a server that neither answers nor closes fails the check rather
+// than hanging it.
+static int connect_impatiently(const string &path)
+{
+    int fd = connect_to(path);
+    timeval wait = {5, 0};
+    if (fd >= 0)
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof wait);
+    return fd;
+}
+
+// Sends request on a connection of its own and says whether the answer is
+// expected; an empty expected answer means the server should close the
+// connection without one.
+static bool exchange(const string &path, const string &request, const string &expected)
+{
+    int fd = connect_impatiently(path);
+    if (fd < 0)
+        return false;
+    string buf, answer;
+    bool sent = write_all(fd, request), ok;
+    if (expected.empty())
+    {
+        // Closed, that is, and not merely quiet until the read gave up.
+        char c;
+        ssize_t n = read(fd, &c, 1);
+        ok = n == 0 || (n < 0 && errno == ECONNRESET);
+    }
+    else
+        ok = sent && read_answer(fd, buf, answer) && answer == expected;
+    close(fd);
+    return ok;
+}
+
+// Clients that once could crash the server or make it hold without limit,
+// each followed by a well-behaved one: a program nested far deeper than the
+// parser allows, which must be answered as parse answers it; lengths past
+// MAX_PROGRAM, or not numbers, after which the connection must be closed;
+// and a client sending programs of the longest kind without reading the
+// answers, which the server must soon stop reading from.  Returns how many
+// went wrong, saying which on cout.
+static size_t hostile(const string &path)
+{
+    size_t wrong = 0;
+    auto check = [&](const char *what, bool ok) {
+        string plain = "write 1;\n";
+        if (!ok || !exchange(path, frame(plain), answer_for(plain)))
+        {
+            cout << "MISMATCH: the server mishandled " << what << '\n';
+            wrong++;
+        }
+    };
+
+    string deep = "write " + string(200000, '(') + "1" + string(200000, ')') + ";\n";
+    check("200000 nested parentheses", exchange(path, frame(deep), answer_for(deep)));
+    check("a length past MAX_PROGRAM",
+          exchange(path, std::to_string(MAX_PROGRAM + 1) + '\n' + string(4096, ' '), ""));
+    check("a 20 digit length", exchange(path, "99999999999999999999\n", ""));
+    check("a length that is not a number", exchange(path, "-1\nwrite 1;\n", ""));
+
+    string longest;
+    while (longest.size() + 8 <= MAX_PROGRAM)
+        longest += "x := 1;\n";
+    string expected = answer_for(longest);
+    int fd = connect_impatiently(path);
+    std::atomic<size_t> sent(0);
+    const size_t frames = 8;
+    std::thread sender([&] {
+        string framed = frame(longest);
+        for (size_t k = 0; fd >= 0 && k < frames; k++)
+            for (size_t done = 0; done < framed.size();)
+            {
+                ssize_t n = write(fd, framed.data() + done, framed.size() - done);
+                if (n <= 0)
+                    return;
+                done += n;
+                sent += n;
+            }
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    size_t taken = sent;
+    string buf, answer;
+    size_t answered = 0;
+    while (fd >= 0 && answered < frames && read_answer(fd, buf, answer) && answer == expected)
+        answered++;
+    shutdown(fd, SHUT_RDWR);
+    sender.join();
+    close(fd);
+    cout << "a client not reading its answers had sent " << taken / 1024 << " KB after 1 s\n";
+    check("a client not reading its answers", taken < 4 * MAX_PROGRAM && answered == frames);
+    return wrong;
+}
+
+// Starts ./parse -S on path, with at most files descriptors if not 0 and
+// its diagnostics on diag if not empty, and waits for it to listen.
+// Returns its pid, or -1 if it did not start.
+static pid_t start_server(const string &path, rlim_t files = 0, const string &diag = "")
+{
+    pid_t server = fork();
+    if (server == 0)
+    {
+        if (!diag.empty())
+            dup2(open(diag.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644), 2);
+        rlimit limit = {files, files};
+        if (files)
+            setrlimit(RLIMIT_NOFILE, &limit);
+        execl("./parse", "./parse", "-S", path.c_str(), (char *)nullptr);
+        _exit(127);
+    }
+    int probe = -1;
+    for (int tries = 0; tries < 500 && (probe = connect_to(path)) < 0; tries++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (probe < 0)
+    {
+        kill(server, SIGKILL);
+        waitpid(server, nullptr, 0);
+        return -1;
+    }
+    close(probe);
+    return server;
+}
+
+// CPU seconds the process has used.
+static double cpu_seconds(pid_t pid)
+{
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    string line;
+    std::getline(stat, line);
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    string skip;
+    for (int k = 0; k < 11; k++)
+        fields >> skip;
+    double user = 0, system = 0;
+    fields >> user >> system;
+    return (user + system) / sysconf(_SC_CLK_TCK);
+}
+
+// A server allowed 32 descriptors, and more clients than it can take,
+// each sending a program: while it cannot accept more it must not spin,
+// and once some clients go, those left waiting must be answered.  Returns
+// how many things went wrong, saying which on cout.
+static size_t starved(const string &path)
+{
+    string diag = path + ".err";
+    pid_t server = start_server(path, 32, diag);
+    if (server < 0)
+    {
+        cout << "MISMATCH: the server with 32 descriptors did not start\n";
+        return 1;
+    }
+    string plain = "write 1;\n", expected = answer_for(plain);
+    std::vector<int> clients;
+    for (int k = 0; k < 48; k++)
+    {
+        int fd = connect_impatiently(path);
+        if (fd >= 0 && write_all(fd, frame(plain)))
+            clients.push_back(fd);
+    }
+    double before = cpu_seconds(server);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    double busy = cpu_seconds(server) - before;
+    size_t answered = 0, wrong = 0;
+    for (size_t k = 0; k < clients.size(); k++)
+    {
+        string buf, answer;
+        answered += read_answer(clients[k], buf, answer) && answer == expected;
+        close(clients[k]);
+    }
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+    std::ifstream said(diag);
+    string first;
+    std::getline(said, first);
+    std::remove(diag.c_str());
+    cout << "out of descriptors, the server used " << std::fixed << std::setprecision(2) << busy
+         << " s of CPU in 1 s, and said '" << first << "'\n";
+    if (clients.size() != 48 || answered != clients.size())
+    {
+        cout << "MISMATCH: " << answered << " of " << clients.size()
+             << " clients of a server out of descriptors were answered\n";
+        wrong++;
+    }
+    if (busy > 0.2)
+    {
+        cout << "MISMATCH: the server spun while out of descriptors\n";
+        wrong++;
+    }
+    return wrong;
+}
+
+static double percentile(std::vector<double> &v, double p)
+{
+    if (v.empty())
+        return 0;
+    size_t k = std::min(v.size() - 1, size_t(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+static void report(const char *what, std::vector<double> &latency, double seconds)
+{
+    double p50 = percentile(latency, 0.5) * 1e6, p99 = percentile(latency, 0.99) * 1e6;
+    cout << std::left << std::setw(16) << what << std::right << std::fixed << std::setprecision(0)
+         << std::setw(10) << latency.size() / seconds << std::setw(10) << p50 << std::setw(10) << p99
+         << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned clients = argc > 1 ? std::atoi(argv[1]) : 8;
+    double seconds = argc > 2 ? std::atof(argv[2]) : 3;
+    signal(SIGPIPE, SIG_IGN);
+
+    // Programs of a few hundred bytes to a few kilobytes, some with errors,
+    // and what parse prints for each, framed as the server answers.
+    std::vector<string> programs, answers;
+    for (unsigned k = 0; k < 256; k++)
+    {
+        shape sh;
+        sh.bytes = 200 + k * 20;
+        sh.depth = k % 4;
+        sh.error_rate = k % 4 == 0 ? 0.05 : 0;
+        sh.seed = k + 1;
+        string text = generate_shaped(sh);
+        programs.push_back(frame(text));
+        answers.push_back(answer_for(text));
+    }
+
+    string path = "/tmp/parse-" + std::to_string(getpid()) + ".sock";
+    pid_t server = start_server(path);
+    if (server < 0)
+    {
+        cout << "the server did not start\n";
+        return 1;
+    }
+
+    std::atomic<size_t> wrong(0);
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<std::thread> threads;
+    auto t0 = clock_type::now();
+    for (unsigned c = 0; c < clients; c++)
+        threads.emplace_back([&, c] {
+            int fd = connect_to(path);
+            string buf, answer;
+            for (size_t k = c; fd >= 0 && since(t0) < seconds; k += 7)
+            {
+                size_t which = k % programs.size();
+                auto t = clock_type::now();
+                if (!write_all(fd, programs[which]) || !read_answer(fd, buf, answer))
+                {
+                    wrong++;
+                    break;
+                }
+                latencies[c].push_back(since(t));
+                if (answer != answers[which])
+                    wrong++;
+            }
+            if (fd < 0)
+                wrong++;
+            else
+                close(fd);
+        });
+    for (std::thread &t : threads)
+        t.join();
+    double served = since(t0);
+    std::vector<double> all;
+    for (auto &l : latencies)
+        all.insert(all.end(), l.begin(), l.end());
+
+    // The same programs, one process each.
+    std::vector<double> spawned;
+    string file = path + ".calc";
+    auto t1 = clock_type::now();
+    for (size_t k = 0; k < 200; k++)
+    {
+        const string &framed = programs[k % programs.size()];
+        std::ofstream(file, std::ios::binary) << framed.substr(framed.find('\n') + 1);
+        auto t = clock_type::now();
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(open(file.c_str(), O_RDONLY), 0);
+            dup2(null, 1);
+            dup2(null, 2);
+            execl("./parse", "./parse", (char *)nullptr);
+            _exit(127);
+        }
+        waitpid(pid, nullptr, 0);
+        spawned.push_back(since(t));
+    }
+    double spawning = since(t1);
+    std::remove(file.c_str());
+
+    wrong += hostile(path);
+
+    kill(server, SIGTERM);
+    int status = 0;
+    waitpid(server, &status, 0);
+    wrong += starved(path);
+
+    cout << std::left << std::setw(16) << "" << std::right << std::setw(10) << "req/s"
+         << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << '\n';
+    report(("server, " + std::to_string(clients) + " clients").c_str(), all, served);
+    report("process each", spawned, spawning);
+    bool ok = wrong == 0 && !all.empty() && WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+              access(path.c_str(), F_OK) != 0;
+    if (!ok)
+        cout << "MISMATCH: " << wrong << " wrong or missing answers, server exit status " << status
+             << '\n';
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/* What sharing registers saves.  Lowers each program with a register
+   for each value and densely, where values whose lives do not overlap
+   share one (vm.hpp), and reports the registers of each, the instructions
+   run and the time taken, unoptimized and optimized.  Besides the corpus
+   there is a program with a few hundred variables, ints and reals, all
+   updated in one loop.  The output must be the same either way.
+     usage: bench/slots [ints] [reals]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "corpus.hpp"
+#include "parse.hpp"
+#include "vm.hpp"
+
+using std::cout;
+
+// A loop that updates that many int variables in a chain, each from the
+// one before, and reals likewise, and writes the sums at the end.
+static string many_variables(int ints, int reals)
+{
+    std::ostringstream t;
+    t << "read int n; int i := 0;\n";
+    for (int k = 0; k < ints; k++)
+        t << "int v" << k << " := " << k << ";\n";
+    for (int k = 0; k < reals; k++)
+        t << "real x" << k << " := " << k << ".5;\n";
+    t << "while i < n do\n  v0 := v0 + i;\n";
+    for (int k = 1; k < ints; k++)
+        t << "  v" << k << " := v" << k << " + v" << k - 1 << ";\n";
+    if (reals > 0)
+        t << "  x0 := x0 + float(i);\n";
+    for (int k = 1; k < reals; k++)
+        t << "  x" << k << " := (x" << k << " + x" << k - 1 << ") / 2.0;\n";
+    t << "  i := i + 1;\nend;\nint s := 0;\n";
+    for (int k = 0; k < ints; k++)
+        t << "s := s + v" << k << ";\n";
+    t << "write s;\nreal r := 0.0;\n";
+    for (int k = 0; k < reals; k++)
+        t << "r := r + x" << k << ";\n";
+    t << "write r;\n";
+    return t.str();
+}
+
+struct outcome
+{
+    string output;
+    uint64_t executed = 0;
+    double seconds;
+};
+
+static outcome execute(const vm_program &p, const char *input)
+{
+    outcome o;
+    std::istringstream in(input);
+    std::ostringstream out;
+    vm_frame frame;
+    auto t0 = std::chrono::steady_clock::now();
+    run(p, frame, in, out, out, &o.executed);
+    o.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    o.output = out.str();
+    return o;
+}
+
+static bool measure(const char *name, const char *text, const char *input)
+{
+    bool ok = true;
+    for (bool optimized : {false, true})
+    {
+        std::istringstream in(text);
+        std::ostream discard(nullptr);
+        scanner s(in, discard);
+        basic_parser<scanner, no_probe, no_trace, fail_fast> parse(s, discard, discard);
+        parse.program();
+        ir_program ir;
+        if (parse.failed() || !build_ir(parse.tree(), ir, cout))
+        {
+            cout << "MISMATCH: " << name << " does not compile\n";
+            return false;
+        }
+        if (optimized)
+            optimize(ir);
+        vm_program sparse = lower(ir, false), dense = lower(ir);
+        if (optimized)
+        {
+            fuse(sparse);
+            fuse(dense);
+        }
+        outcome before = execute(sparse, input), after = execute(dense, input);
+        cout << std::left << std::setw(10) << name << std::setw(4) << (optimized ? "-O" : "")
+             << std::right << std::setw(9) << sparse.registers << std::setw(9) << dense.registers
+             << std::setw(13) << before.executed << std::setw(13) << after.executed << std::fixed
+             << std::setprecision(1) << std::setw(10) << before.seconds * 1e3 << std::setw(10)
+             << after.seconds * 1e3 << std::setw(8) << before.seconds / after.seconds << "x\n";
+        if (after.output != before.output)
+        {
+            cout << "MISMATCH: " << name << " wrote\n"
+                 << before.output << "with a register for each value, but\n"
+                 << after.output << "with registers shared\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int ints = argc > 1 ? std::atoi(argv[1]) : 300;
+    int reals = argc > 2 ? std::atoi(argv[2]) : 100;
+    bool ok = true;
+    cout << std::left << std::setw(14) << "program" << std::right << std::setw(9) << "regs"
+         << std::setw(9) << "shared" << std::setw(13) << "instructions" << std::setw(13)
+         << "shared" << std::setw(10) << "ms" << std::setw(10) << "shared" << std::setw(9)
+         << "speedup\n";
+    for (const corpus_program &c : corpus)
+        ok &= measure(c.name, c.text, c.input);
+    string many = many_variables(ints, reals);
+    ok &= measure("variables", many.c_str(), "20000");
+    return ok ? 0 : 1;
+}
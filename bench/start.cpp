@@ -0,0 +1,222 @@
+/* How long it takes to start a run.  Compiles small programs once and
+   runs each many times over, a few values in and out each time, in a
+   new frame for each run, in the frames a thread keeps between runs, and
+   in one frame given for all of them, and reports the time each run takes
+   from start to end and the allocations it makes.  Then runs them the
+   same way on a few threads at once, sharing the one compiled program.
+   Once warm, a run must allocate nothing, and it must write the same
+   output however it is started.
+     usage: bench/start [runs]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scan.hpp"
+#include "vm.hpp"
+
+using std::cout;
+
+// Allocations made by each thread, counted by the operator new below.
+static thread_local uint64_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// An output stream that keeps only a hash of what is written to it, so
+// that writing allocates nothing.
+class sink : private std::streambuf, public std::ostream
+{
+    typedef std::streambuf::traits_type traits;
+    char buf[256];
+
+    void take(const char *first, const char *last)
+    {
+        for (; first != last; first++)
+            hash = (hash ^ uint8_t(*first)) * 0x100000001b3;
+    }
+
+    traits::int_type overflow(traits::int_type c) override
+    {
+        take(pbase(), pptr());
+        setp(buf, buf + sizeof buf);
+        if (!traits::eq_int_type(c, traits::eof()))
+            sputc(traits::to_char_type(c));
+        return 0;
+    }
+
+    int sync() override
+    {
+        overflow(traits::eof());
+        return 0;
+    }
+
+public:
+    uint64_t hash = 0xcbf29ce484222325;
+
+    sink() : std::ostream(this)
+    {
+        setp(buf, buf + sizeof buf);
+    }
+};
+
+struct start_program
+{
+    const char *name;
+    const char *text;
+    const char *input;
+};
+
+const start_program programs[] = {
+    {"empty", "int x := 1;\n", ""},
+    {"square", "read int x; write x * x + 1;\n", "12345"},
+    {"mean",
+     "read int n; int i := 0; real s := 0.0;\n"
+     "while i < n do read real x; s := s + x; i := i + 1; end;\n"
+     "write s / float(n);\n",
+     "4 1.5 2.5 3.5 4.5"},
+};
+
+enum mode
+{
+    fresh,  // a new frame for each run
+    pooled, // the frames the thread keeps
+    given,  // one frame for all the runs
+};
+
+const char *const mode_names[] = {"new frame", "pooled", "given frame"};
+
+struct outcome
+{
+    double seconds = 0;
+    uint64_t allocations = 0, hash = 0;
+    bool ok = true;
+};
+
+// Runs p runs times in the given mode, after a few runs to warm up.
+static outcome start(const vm_program &p, const char *input, mode m, size_t runs)
+{
+    memstream in(nullptr, nullptr);
+    sink out;
+    vm_frame frame;
+    outcome o;
+    auto once = [&] {
+        in.reset(input, input + std::strlen(input));
+        if (m == fresh)
+        {
+            vm_frame own;
+            o.ok &= run(p, own, in, out, out);
+        }
+        else if (m == pooled)
+            o.ok &= run(p, in, out, out);
+        else
+            o.ok &= run(p, frame, in, out, out);
+    };
+    for (int k = 0; k < 10; k++)
+        once();
+    uint64_t before = allocations;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < runs; k++)
+        once();
+    o.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    o.allocations = allocations - before;
+    out.flush();
+    o.hash = out.hash;
+    return o;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t runs = argc > 1 ? std::atol(argv[1]) : 200000;
+    bool ok = true;
+    std::vector<vm_program> compiled(sizeof programs / sizeof *programs);
+    for (size_t k = 0; k < compiled.size(); k++)
+    {
+        std::istringstream text(programs[k].text);
+        if (!compile(text, compiled[k], true, cout))
+            return 1;
+    }
+
+    cout << std::left << std::setw(10) << "program" << std::setw(13) << "started in" << std::right
+         << std::setw(10) << "ns/run" << std::setw(14) << "allocs/run\n";
+    for (size_t k = 0; k < compiled.size(); k++)
+    {
+        outcome first;
+        for (mode m : {fresh, pooled, given})
+        {
+            outcome o = start(compiled[k], programs[k].input, m, runs);
+            cout << std::left << std::setw(10) << programs[k].name << std::setw(13) << mode_names[m]
+                 << std::right << std::fixed << std::setprecision(0) << std::setw(10)
+                 << o.seconds / runs * 1e9 << std::setprecision(2) << std::setw(13)
+                 << double(o.allocations) / runs << '\n';
+            if (m == fresh)
+                first = o;
+            else if (o.allocations != 0)
+            {
+                cout << "MISMATCH: " << programs[k].name << " allocated " << o.allocations
+                     << " times in " << runs << " runs, " << mode_names[m] << '\n';
+                ok = false;
+            }
+            if (!o.ok || o.hash != first.hash)
+            {
+                cout << "MISMATCH: " << programs[k].name << " failed, or wrote something else, "
+                     << mode_names[m] << '\n';
+                ok = false;
+            }
+        }
+    }
+
+    // The same programs on threads at once, each run taking a pooled frame.
+    unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+    std::vector<outcome> outcomes(threads * compiled.size());
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++)
+        pool.emplace_back([&, t] {
+            for (size_t k = 0; k < compiled.size(); k++)
+                outcomes[t * compiled.size() + k] =
+                    start(compiled[k], programs[k].input, pooled, runs / threads);
+        });
+    for (std::thread &t : pool)
+        t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    cout << '\n'
+         << threads << " threads: " << std::setprecision(2)
+         << threads * (runs / threads) * compiled.size() / seconds / 1e6 << " million runs/s\n";
+    for (unsigned t = 0; t < threads; t++)
+        for (size_t k = 0; k < compiled.size(); k++)
+        {
+            const outcome &o = outcomes[t * compiled.size() + k];
+            if (!o.ok || o.allocations != 0 || o.hash != outcomes[k].hash)
+            {
+                cout << "MISMATCH: " << programs[k].name << " on thread " << t
+                     << " failed, allocated, or wrote something else\n";
+                ok = false;
+            }
+        }
+    return ok ? 0 : 1;
+}
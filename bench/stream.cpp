@@ -0,0 +1,108 @@
+/* Memory use of a streaming parse of endless input.
+   A writer thread pours a generated program, over and over, into a pipe
+   that a streaming parse reads, with the trace discarded.  The resident
+   set size is sampled as the stream goes by, and must not grow after
+   the first tenth of it.
+     usage: bench/stream [gigabytes]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "gen.hpp"
+#include "scan.hpp"
+#include "stream.hpp"
+
+using std::cout;
+
+// Resident set size in kilobytes.
+static long rss()
+{
+    long pages = 0, resident = 0;
+    if (FILE *f = std::fopen("/proc/self/statm", "r"))
+    {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        std::fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char *argv[])
+{
+    double gb = argc > 1 ? std::atof(argv[1]) : 10;
+    const size_t total = size_t(gb * (1 << 30));
+    const string chunk = generate(1 << 20);
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        cout << "cannot make a pipe\n";
+        return 1;
+    }
+    std::thread writer([&] {
+        for (size_t sent = 0; sent < total;)
+        {
+            size_t n = std::min(chunk.size(), total - sent);
+            for (size_t k = 0; k < n;)
+            {
+                ssize_t w = write(fds[1], chunk.data() + k, n - k);
+                if (w <= 0)
+                    return;
+                k += w;
+            }
+            sent += n;
+        }
+        close(fds[1]);
+    });
+
+    // Sample at every 1/100th of the statements in the stream.
+    size_t per_chunk = 0;
+    {
+        memstream in(chunk.data(), chunk.data() + chunk.size());
+        std::ostream discard(nullptr);
+        parse_stream(in, [&](const stmt_ptr &) { per_chunk++; }, discard, discard);
+    }
+    const size_t every = std::max<size_t>(1, total / chunk.size() * per_chunk / 100);
+    size_t statements = 0;
+    std::vector<long> samples;
+    auto t0 = std::chrono::steady_clock::now();
+    {
+        fdstream in(fds[0]);
+        std::ostream discard(nullptr);
+        parse_stream(in, [&](const stmt_ptr &) {
+            if (++statements % every == 0)
+                samples.push_back(rss());
+        }, discard, discard);
+    }
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    writer.join();
+    close(fds[0]);
+
+    if (samples.size() < 10)
+    {
+        cout << "too few samples\n";
+        return 1;
+    }
+    long settled = samples[samples.size() / 10];
+    long peak = *std::max_element(samples.begin(), samples.end());
+    cout << std::fixed << std::setprecision(2) << total / double(1 << 30) << " GB, " << statements
+         << " top-level statements in " << std::setprecision(1) << t << " s ("
+         << total / t / 1e6 << " MB/s)\n"
+         << "  RSS at 10% " << settled << " KB, peak " << peak << " KB, at end " << samples.back()
+         << " KB\n";
+    // A little slack for the allocator's arenas settling.
+    if (peak > settled + 1024)
+    {
+        cout << "RSS GREW: peak is " << peak - settled << " KB above the settled size\n";
+        return 1;
+    }
+    return 0;
+}
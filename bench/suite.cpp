@@ -0,0 +1,219 @@
+/* The benchmark suite: scanner, parser and end-to-end throughput on
+   programs of several shapes from generate_shaped().
+     scan     lex() into a token array
+     parse    the parser over tokens already scanned, trace discarded
+     total    scanner and parser together, trace formatted and discarded
+   Each stage runs in a fresh process of its own, so that the peak
+   resident set size is that of reading the program and running the
+   stage; the best of three runs is kept.
+   Results go to standard output as a table and, with -o, to a file as
+   one JSON object per line, tagged with the commit, for comparing runs.
+     usage: bench/suite [-o results.json] [megabytes]
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+#include "gen.hpp"
+#include "lex.hpp"
+#include "parse.hpp"
+
+using std::cout;
+
+// A source for the parser that hands out tokens scanned beforehand.
+class replay
+{
+    const char *buf;
+    const std::vector<lexeme> &tokens;
+    size_t next = 0, last = 0;
+
+public:
+    replay(const char *buf, const std::vector<lexeme> &tokens) : buf(buf), tokens(tokens) {}
+    tuple<token, string> scan()
+    {
+        last = next < tokens.size() - 1 ? next++ : next;
+        const lexeme &l = tokens[last];
+        return tuple<token, string>(l.kind, image(buf, l));
+    }
+    size_t token_start() const
+    {
+        return tokens[last].offset;
+    }
+    int errors() const
+    {
+        return 0;
+    }
+};
+
+// Takes output and throws it away, after it has been formatted.
+class sink_buf : public std::streambuf
+{
+    int_type overflow(int_type c) override
+    {
+        return c == traits_type::eof() ? 0 : c;
+    }
+    std::streamsize xsputn(const char *, std::streamsize n) override
+    {
+        return n;
+    }
+};
+
+struct result
+{
+    double seconds = 0;
+    size_t tokens = 0;
+    long peak_kb = 0;
+};
+
+static long peak_kb()
+{
+    std::ifstream f("/proc/self/status");
+    string line;
+    while (std::getline(f, line))
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::atol(line.c_str() + 6);
+    return 0;
+}
+
+// Runs stage on the program in file, in this process, which was started
+// afresh for it, and prints the result on standard output.
+static int run(const string &stage, const string &file)
+{
+    std::ifstream f(file, std::ios::binary);
+    string text((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    sink_buf nothing;
+    std::ostream trace(&nothing);
+    std::ostream discard(nullptr);
+    result r;
+    r.seconds = 1e30;
+    for (int rep = 0; rep < 3; rep++)
+    {
+        std::vector<lexeme> tokens;
+        if (stage == "parse")
+            tokens = lex(text.data(), text.size(), discard);
+        auto t0 = std::chrono::steady_clock::now();
+        if (stage == "scan")
+            tokens = lex(text.data(), text.size(), discard);
+        else if (stage == "parse")
+        {
+            replay s(text.data(), tokens);
+            basic_parser<replay> p(s, trace, trace);
+            p.program();
+        }
+        else
+        {
+            memstream in(text.data(), text.data() + text.size());
+            parser p(in, trace, trace);
+            p.program();
+        }
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        r.seconds = std::min(r.seconds, t);
+        r.tokens = tokens.size();
+    }
+    cout << r.seconds << ' ' << r.tokens << ' ' << peak_kb() << '\n';
+    return 0;
+}
+
+// Runs stage on the program in file in a new process.
+static bool measure(const char *self, const string &stage, const string &file, result &r)
+{
+    string command = string(self) + " --run " + stage + " " + file;
+    FILE *p = popen(command.c_str(), "r");
+    if (!p)
+        return false;
+    bool ok = std::fscanf(p, "%lf %zu %ld", &r.seconds, &r.tokens, &r.peak_kb) == 3;
+    return pclose(p) == 0 && ok;
+}
+
+static string commit()
+{
+    string id;
+    if (FILE *p = popen("git rev-parse --short HEAD 2>/dev/null", "r"))
+    {
+        char line[64];
+        if (std::fgets(line, sizeof line, p))
+            id = string(line, std::strcspn(line, "\n"));
+        pclose(p);
+    }
+    return id.empty() ? "unknown" : id;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 4 && string(argv[1]) == "--run")
+        return run(argv[2], argv[3]);
+    string out_file;
+    size_t mb = 8;
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "-o" && i + 1 < argc)
+            out_file = argv[++i];
+        else
+            mb = std::atoi(argv[i]);
+    }
+
+    struct config
+    {
+        const char *name;
+        shape sh;
+    };
+    std::vector<config> configs(5);
+    configs[0].name = "baseline";
+    configs[1].name = "deep";
+    configs[1].sh.depth = 12;
+    configs[2].name = "long-expr";
+    configs[2].sh.expr_length = 40;
+    configs[3].name = "many-ids";
+    configs[3].sh.identifiers = 1000000;
+    configs[4].name = "noisy";
+    configs[4].sh.error_rate = 0.05;
+
+    std::ofstream json;
+    if (!out_file.empty())
+        json.open(out_file, std::ios::app);
+    json << std::fixed;
+    string file = "/tmp/suite-" + std::to_string(getpid()) + ".calc";
+    string id = commit();
+    cout << std::left << std::setw(10) << "shape" << std::setw(7) << "stage" << std::right
+         << std::setw(10) << "MB/s" << std::setw(12) << "Mtokens/s" << std::setw(14) << "peak RSS KB"
+         << '\n';
+    bool ok = true;
+    for (auto &c : configs)
+    {
+        c.sh.bytes = mb << 20;
+        string text = generate_shaped(c.sh);
+        std::ofstream(file, std::ios::binary) << text;
+        std::ostream discard(nullptr);
+        size_t tokens = lex(text.data(), text.size(), discard).size();
+        for (const char *stage : {"scan", "parse", "total"})
+        {
+            result r;
+            if (!measure(argv[0], stage, file, r))
+            {
+                cout << c.name << ' ' << stage << ": measurement failed\n";
+                ok = false;
+                continue;
+            }
+            double mbs = text.size() / r.seconds / 1e6, tps = tokens / r.seconds;
+            cout << std::left << std::setw(10) << c.name << std::setw(7) << stage << std::right
+                 << std::fixed << std::setprecision(1) << std::setw(10) << mbs << std::setw(12)
+                 << tps / 1e6 << std::setw(14) << r.peak_kb << '\n';
+            if (json.is_open())
+                json << "{\"commit\": \"" << id << "\", \"shape\": \"" << c.name << "\", \"stage\": \""
+                     << stage << "\", \"bytes\": " << text.size() << ", \"tokens\": " << tokens
+                     << ", \"seconds\": " << std::setprecision(6) << r.seconds
+                     << ", \"mb_per_s\": " << std::setprecision(3) << mbs
+                     << ", \"tokens_per_s\": " << std::setprecision(0) << tps
+                     << ", \"peak_rss_kb\": " << r.peak_kb << "}\n";
+        }
+    }
+    std::remove(file.c_str());
+    return ok ? 0 : 1;
+}
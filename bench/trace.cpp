@@ -0,0 +1,209 @@
+/* Traces of programs that convert between int and real.  trunc and float
+   begin a factor, and so are in the FIRST sets of factor, term, expr and
+   condition; before they were, the parser took each for a syntax error,
+   deleted it, and went on as if the conversion were a parenthesized
+   expression.  Each program's trace and diagnostics, from the recovering
+   parser that parse runs, must be exactly as below.  The bare "syntax
+   error" lines are the recovering parser's, printed wherever a nonterminal
+   that may be empty, such as term_tail, turns out to be; they were there
+   before conversions were.
+     usage: bench/trace
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "parse.hpp"
+
+using std::cout;
+
+struct traced
+{
+    const char *name;
+    const char *text;
+    const char *trace;
+    const char *diagnostics;
+};
+
+const traced programs[] = {
+    {"trunc",
+     "write trunc(1.5);\n",
+     "predict program --> stmt_list eof\n"
+     "predict stmt_list --> stmt ; stmt_list\n"
+     "predict stmt --> write expr\n"
+     "matched write\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> t_trunc lparen expr rparen\n"
+     "matched trunc\n"
+     "matched lparen\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> t_r_num\n"
+     "matched r_num\n"
+     "matched rparen\n"
+     "matched semi_colon\n"
+     "matched eof\n",
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"},
+    {"float",
+     "real x := float(2) * 3.0;\n",
+     "predict program --> stmt_list eof\n"
+     "predict stmt_list --> stmt ; stmt_list\n"
+     "predict stmt --> real id gets expr \n"
+     "matched real\n"
+     "matched id\n"
+     "matched gets\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> t_float lparen expr rparen\n"
+     "matched float\n"
+     "matched lparen\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> t_i_num\n"
+     "matched i_num\n"
+     "matched rparen\n"
+     "predict factor_tail --> mul_op factor factor_tail\n"
+     "predict mul_op --> mul\n"
+     "matched mul\n"
+     "predict factor --> t_r_num\n"
+     "matched r_num\n"
+     "matched semi_colon\n"
+     "matched eof\n",
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"},
+    {"nested",
+     "read int n;\n"
+     "if float(n) > 2.5 then write trunc(float(n) / 2.0) + 1; end;\n",
+     "predict program --> stmt_list eof\n"
+     "predict stmt_list --> stmt ; stmt_list\n"
+     "predict stmt --> read type id\n"
+     "matched read\n"
+     "predict type --> int\n"
+     "matched int\n"
+     "matched id\n"
+     "matched semi_colon\n"
+     "predict stmt_list --> stmt ; stmt_list\n"
+     "predict stmt --> if condition then stmt_list end \n"
+     "matched if\n"
+     "predict condition --> expr ro expr\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> t_float lparen expr rparen\n"
+     "matched float\n"
+     "matched lparen\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> id\n"
+     "matched id\n"
+     "matched rparen\n"
+     "predict ro --> greater\n"
+     "matched greater\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> t_r_num\n"
+     "matched r_num\n"
+     "matched then\n"
+     "predict stmt_list --> stmt ; stmt_list\n"
+     "predict stmt --> write expr\n"
+     "matched write\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> t_trunc lparen expr rparen\n"
+     "matched trunc\n"
+     "matched lparen\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> t_float lparen expr rparen\n"
+     "matched float\n"
+     "matched lparen\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> id\n"
+     "matched id\n"
+     "matched rparen\n"
+     "predict factor_tail --> mul_op factor factor_tail\n"
+     "predict mul_op --> div\n"
+     "matched div\n"
+     "predict factor --> t_r_num\n"
+     "matched r_num\n"
+     "matched rparen\n"
+     "predict term_tail --> add_op term term_tail\n"
+     "predict add_op --> add\n"
+     "matched add\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> t_i_num\n"
+     "matched i_num\n"
+     "matched semi_colon\n"
+     "matched end\n"
+     "matched semi_colon\n"
+     "matched eof\n",
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"},
+    {"no lparen",
+     "write trunc 1.5;\n",
+     "predict program --> stmt_list eof\n"
+     "predict stmt_list --> stmt ; stmt_list\n"
+     "predict stmt --> write expr\n"
+     "matched write\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> t_trunc lparen expr rparen\n"
+     "matched trunc\n"
+     "predict expr --> term term_tail\n"
+     "predict term --> factor factor_tail\n"
+     "predict factor --> t_r_num\n"
+     "matched r_num\n"
+     "matched semi_colon\n"
+     "matched eof\n",
+     "syntax error: got r_num expected lparen\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error: got semi_colon expected rparen\n"
+     "syntax error\n"
+     "syntax error\n"
+     "syntax error\n"},
+};
+
+int main()
+{
+    bool ok = true;
+    for (const traced &t : programs)
+    {
+        string text = t.text;
+        memstream in(text.data(), text.data() + text.size());
+        std::ostringstream out, diag;
+        parser p(in, out, diag);
+        p.program();
+        if (out.str() != t.trace || diag.str() != t.diagnostics)
+        {
+            cout << "MISMATCH: " << t.name << " traced\n"
+                 << out.str() << diag.str() << "but should have traced\n"
+                 << t.trace << t.diagnostics;
+            ok = false;
+        }
+    }
+    cout << sizeof programs / sizeof *programs << " traces checked\n";
+    return ok ? 0 : 1;
+}
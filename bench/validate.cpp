@@ -0,0 +1,109 @@
+/* Latency of parse -v on large programs with an error near the start,
+   in the middle and near the end, and with none.  The time to reject a
+   program should grow with how far in its error is.  Checks the exit
+   status and that the diagnostic points at the error, there and for a
+   few small programs starting with a token in FIRST(program) that no
+   statement starts with.
+     usage: bench/validate [megabytes]
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "gen.hpp"
+#include "validate.hpp"
+
+using std::cout;
+
+// Runs ./parse -v on file, with its diagnostics going to err, and returns
+// its exit status, or -1 if it did not exit.
+static int run(const string &file, const string &err, double &seconds)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(open(file.c_str(), O_RDONLY), 0);
+        dup2(open(err.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644), 2);
+        execl("./parse", "./parse", "-v", (char *)nullptr);
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mb = argc > 1 ? std::atoi(argv[1]) : 32;
+    shape sh;
+    sh.bytes = mb << 20;
+    string valid = generate_shaped(sh);
+
+    string file = "/tmp/validate-" + std::to_string(getpid()) + ".calc";
+    string err = file + ".err";
+    bool ok = true;
+    cout << std::left << std::setw(8) << "error" << std::right << std::setw(12) << "at byte"
+         << std::setw(10) << "ms" << '\n';
+    for (double where : {0.01, 0.5, 0.99, -1.0})
+    {
+        // A ')' where a statement, an end or eof belongs, just after a ';'.
+        string text = valid;
+        size_t at = string::npos;
+        if (where >= 0)
+        {
+            at = text.find(';', size_t(where * text.size())) + 1;
+            text.insert(at, " )");
+            at++;
+        }
+        std::ofstream(file, std::ios::binary) << text;
+        double seconds = 0;
+        int status = run(file, err, seconds);
+        std::ifstream e(err);
+        string diag;
+        std::getline(e, diag);
+        string name = where < 0 ? "none" : where < 0.1 ? "start" : where < 0.9 ? "middle" : "end";
+        cout << std::left << std::setw(8) << name << std::right << std::setw(12)
+             << (where < 0 ? string("-") : std::to_string(at)) << std::fixed << std::setprecision(1)
+             << std::setw(10) << seconds * 1e3 << '\n';
+        bool right = where < 0 ? status == 0 && diag.empty()
+                               : status == EXIT_INVALID && diag == "byte " + std::to_string(at) +
+                                                                       ": syntax error: got rparen";
+        if (!right)
+        {
+            cout << "MISMATCH: exit status " << status << ", diagnostic '" << diag << "'\n";
+            ok = false;
+        }
+    }
+
+    const char *const starts[][2] = {{"trunc(1);", "trunc"},
+                                     {"float (x); garbage @@@", "float"},
+                                     {"float(2) + 1; write 1;", "float"}};
+    for (auto &start : starts)
+    {
+        std::ofstream(file, std::ios::binary) << start[0];
+        double seconds = 0;
+        int status = run(file, err, seconds);
+        std::ifstream e(err);
+        string diag;
+        std::getline(e, diag);
+        if (status != EXIT_INVALID || diag != string("byte 0: syntax error: got ") + start[1])
+        {
+            cout << "MISMATCH: '" << start[0] << "' gave exit status " << status
+                 << ", diagnostic '" << diag << "'\n";
+            ok = false;
+        }
+    }
+    std::remove(file.c_str());
+    std::remove(err.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+/* A content-addressed cache of parse results.
+   A file in the cache directory holds one result: a header line naming
+   the format, a line with the sizes of the trace and of an image of the
+   program (image.hpp), and then their bytes.  The image has the text, to
+   check that the file is of the program asked for, and the tree and the
+   diagnostics.  Files are written under a temporary name and renamed
+   into place, so a reader never sees half of one.
+*/
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "cache.hpp"
+#include "hash.hpp"
+#include "image.hpp"
+#include "lex.hpp"
+#include "parse.hpp"
+
+namespace
+{
+
+const char *const MAGIC = "calc-parse 2";
+
+size_t cost(const string &text, const parse_result &r)
+{
+    return sizeof r + text.size() + r.trace.size() + r.diagnostics.size() +
+           r.tree.size() * sizeof(stmt_ptr);
+}
+
+bool same(const string &text, const char *buf, size_t len)
+{
+    return text.size() == len && text.compare(0, len, buf, len) == 0;
+}
+
+} // namespace
+
+parse_cache::parse_cache(size_t budget, const string &dir) : budget(budget), dir(dir)
+{
+}
+
+result_ptr parse_cache::parse(const char *buf, size_t len)
+{
+    key k = {hash64(buf, len), len};
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        auto it = index.find(k);
+        if (it != index.end() && same(it->second->text, buf, len))
+        {
+            count.hits++;
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->result;
+        }
+    }
+
+    // Parse, or load, without holding the lock.
+    result_ptr r = dir.empty() ? nullptr : load(k, buf, len);
+    bool loaded = r != nullptr;
+    if (!loaded)
+    {
+        auto fresh = std::make_shared<parse_result>();
+        memstream in(buf, buf + len);
+        std::ostringstream out, diag;
+        parser p(in, out, diag);
+        p.program();
+        fresh->trace = out.str();
+        fresh->diagnostics = diag.str();
+        fresh->tree = p.tree();
+        if (!dir.empty())
+            store(k, buf, len, *fresh);
+        r = fresh;
+    }
+
+    std::lock_guard<std::mutex> hold(lock);
+    if (loaded)
+        count.disk_hits++;
+    else
+        count.misses++;
+    insert(k, buf, len, r);
+    return r;
+}
+
+void parse_cache::insert(const key &k, const char *buf, size_t len, result_ptr r)
+{
+    auto it = index.find(k);
+    if (it != index.end())
+    {
+        // Another thread got here first, or another program has the key
+        // and keeps it.
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+    lru.push_front({k, string(buf, len), r});
+    index[k] = lru.begin();
+    used += cost(lru.front().text, *r);
+    while (used > budget && lru.size() > 1)
+    {
+        used -= cost(lru.back().text, *lru.back().result);
+        index.erase(lru.back().k);
+        lru.pop_back();
+        count.evictions++;
+    }
+}
+
+parse_cache::counters parse_cache::stats() const
+{
+    std::lock_guard<std::mutex> hold(lock);
+    return count;
+}
+
+size_t parse_cache::size() const
+{
+    std::lock_guard<std::mutex> hold(lock);
+    return lru.size();
+}
+
+string parse_cache::path(const key &k) const
+{
+    char name[64];
+    std::snprintf(name, sizeof name, "/%016llx-%llu.parse", (unsigned long long)k.hash,
+                  (unsigned long long)k.length);
+    return dir + name;
+}
+
+result_ptr parse_cache::load(const key &k, const char *buf, size_t len) const
+{
+    std::ifstream f(path(k), std::ios::binary | std::ios::ate);
+    std::streamoff size = f.tellg();
+    f.seekg(0);
+    string magic;
+    size_t trace_len, image_len;
+    if (!std::getline(f, magic) || magic != MAGIC || !(f >> trace_len >> image_len) ||
+        f.get() != '\n')
+        return nullptr;
+    // The lengths must be those of the rest of the file, lest a damaged
+    // one have us allocate without bound.
+    uint64_t rest = uint64_t(size - f.tellg());
+    if (size < 0 || trace_len > rest || image_len != rest - trace_len)
+        return nullptr;
+    auto r = std::make_shared<parse_result>();
+    r->trace.resize(trace_len);
+    std::vector<uint64_t> words((image_len + 7) / 8); // as an image must be, 8-byte aligned
+    if (!f.read(&r->trace[0], trace_len) || !f.read(reinterpret_cast<char *>(words.data()), image_len))
+        return nullptr;
+    program_image image;
+    if (!image.adopt(words.data(), image_len) || !image.verify() ||
+        image.source() != std::string_view(buf, len))
+        return nullptr;
+    r->diagnostics = string(image.diagnostics());
+    r->tree = image.tree();
+    return r;
+}
+
+void parse_cache::store(const key &k, const char *buf, size_t len, const parse_result &r) const
+{
+    string text(buf, len);
+    std::ostream discard(nullptr);
+    std::ostringstream image;
+    write_image(image, text, lex(buf, len, discard), r.tree, r.diagnostics);
+    std::ostringstream tmp;
+    tmp << path(k) << ".tmp." << std::this_thread::get_id();
+    {
+        std::ofstream f(tmp.str(), std::ios::binary);
+        f << MAGIC << '\n' << r.trace.size() << ' ' << image.str().size() << '\n'
+          << r.trace << image.str();
+        if (!f.flush())
+        {
+            std::remove(tmp.str().c_str());
+            return;
+        }
+    }
+    std::rename(tmp.str().c_str(), path(k).c_str());
+}
@@ -0,0 +1,92 @@
+/* A content-addressed cache of parse results, so that a program that
+   has been parsed before is not scanned or parsed again.  Results are
+   keyed by the XXH64 hash and length of the program text, kept in an
+   in-memory LRU with a byte budget, and optionally also written to a
+   directory so they outlive the process.  A result is kept with the text
+   it is of, and served only for that text, so that two programs whose
+   keys collide are each parsed rather than given the other's result.
+*/
+
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+
+// Everything parser::program() produces for a program.
+struct parse_result
+{
+    string trace;
+    string diagnostics;
+    std::vector<stmt_ptr> tree;
+};
+typedef std::shared_ptr<const parse_result> result_ptr;
+
+class parse_cache
+{
+public:
+    struct counters
+    {
+        uint64_t hits = 0;      // found in memory
+        uint64_t disk_hits = 0; // found in the directory
+        uint64_t misses = 0;    // parsed
+        uint64_t evictions = 0; // dropped from memory to stay in budget
+    };
+
+    // Keeps up to budget bytes of results in memory, and if dir is not
+    // empty, also keeps every result in that directory.
+    explicit parse_cache(size_t budget, const string &dir = "");
+
+    // The result of parsing buf[0..len), from the cache if possible.
+    result_ptr parse(const char *buf, size_t len);
+
+    counters stats() const;
+    size_t size() const;
+
+private:
+    struct key
+    {
+        uint64_t hash;
+        uint64_t length;
+        bool operator==(const key &k) const
+        {
+            return hash == k.hash && length == k.length;
+        }
+    };
+    struct key_hash
+    {
+        size_t operator()(const key &k) const
+        {
+            return k.hash;
+        }
+    };
+    struct entry
+    {
+        key k;
+        string text;
+        result_ptr result;
+    };
+    typedef std::list<entry> lru_list;
+
+    size_t budget;
+    string dir;
+    mutable std::mutex lock;
+    lru_list lru; // most recently used first
+    std::unordered_map<key, lru_list::iterator, key_hash> index;
+    size_t used = 0;
+    counters count;
+
+    void insert(const key &k, const char *buf, size_t len, result_ptr r);
+    string path(const key &k) const;
+    result_ptr load(const key &k, const char *buf, size_t len) const;
+    void store(const key &k, const char *buf, size_t len, const parse_result &r) const;
+};
+
+#endif
@@ -0,0 +1,91 @@
+/* XXH64, a fast non-cryptographic hash of a byte string, for keying
+   caches by content.  Matches the reference implementation's output.
+*/
+
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace xxh
+{
+
+const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t P3 = 0x165667B19E3779F9ULL;
+const uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input)
+{
+    return rotl(acc + input * P2, 31) * P1;
+}
+
+inline uint64_t merge(uint64_t acc, uint64_t v)
+{
+    return (acc ^ round(0, v)) * P1 + P4;
+}
+
+} // namespace xxh
+
+inline uint64_t hash64(const void *data, size_t len, uint64_t seed = 0)
+{
+    using namespace xxh;
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    const unsigned char *end = p + len;
+    uint64_t h;
+    if (len >= 32)
+    {
+        uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = xxh::round(v1, read64(p));
+            v2 = xxh::round(v2, read64(p + 8));
+            v3 = xxh::round(v3, read64(p + 16));
+            v4 = xxh::round(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+    }
+    else
+        h = seed + P5;
+    h += len;
+    for (; p + 8 <= end; p += 8)
+        h = rotl(h ^ xxh::round(0, read64(p)), 27) * P1 + P4;
+    if (p + 4 <= end)
+    {
+        h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; p++)
+        h = rotl(h ^ (*p * P5), 11) * P1;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+#endif
@@ -0,0 +1,323 @@
+/* Writing program images, and opening them in place.
+   The writer numbers an expression after its operands and a statement
+   before the statements in its body, so in a valid image every index
+   points one way, and verify() can rule out cycles by checking that.
+   It also checks that no record is referred to twice, and works out how
+   deep each one is, in the order that puts a record's children first, so
+   that neither it nor tree() has to recurse on bytes not yet checked.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image.hpp"
+#include "parse.hpp"
+
+namespace
+{
+
+const char MAGIC[8] = "CALCIMG";
+const uint32_t ENDIAN = 0x01020304;
+static_assert(sizeof(lexeme) == 12, "lexemes are written as they are");
+static_assert(sizeof(image_stmt) == 32, "statements are packed");
+
+class flattener
+{
+    std::unordered_map<string, uint32_t> interned;
+
+public:
+    std::vector<image_symbol> symbols;
+    string strings;
+    std::vector<image_expr> exprs;
+    std::vector<image_stmt> stmts;
+    std::vector<uint32_t> lists;
+
+    uint32_t symbol(const string &text)
+    {
+        auto it = interned.find(text);
+        if (it != interned.end())
+            return it->second;
+        symbols.push_back({uint32_t(strings.size()), uint32_t(text.size())});
+        strings += text;
+        return interned[text] = uint32_t(symbols.size() - 1);
+    }
+
+    uint32_t expr(const expr_ptr &e)
+    {
+        if (!e)
+            return IMAGE_NONE;
+        image_expr x;
+        x.op = e->op;
+        x.text = e->text.empty() ? IMAGE_NONE : symbol(e->text);
+        x.left = expr(e->left);
+        x.right = expr(e->right);
+        exprs.push_back(x);
+        return uint32_t(exprs.size() - 1);
+    }
+
+    // Flattens a list of statements and returns where it starts in lists.
+    uint32_t list(const std::vector<stmt_ptr> &body)
+    {
+        std::vector<uint32_t> members;
+        for (auto &s : body)
+            members.push_back(stmt(s));
+        lists.insert(lists.end(), members.begin(), members.end());
+        return uint32_t(lists.size() - members.size());
+    }
+
+    uint32_t stmt(const stmt_ptr &s)
+    {
+        uint32_t i = uint32_t(stmts.size());
+        stmts.emplace_back();
+        image_stmt x = {};
+        x.kind = uint8_t(s->kind);
+        x.type = uint8_t(s->type);
+        x.offset = uint32_t(s->offset);
+        x.id = s->id.empty() ? IMAGE_NONE : symbol(s->id);
+        x.value = expr(s->value);
+        x.rel = uint8_t(s->cond.rel);
+        x.cond_left = expr(s->cond.left);
+        x.cond_right = expr(s->cond.right);
+        x.body_count = uint32_t(s->body.size());
+        x.body_first = list(s->body);
+        stmts[i] = x;
+        return i;
+    }
+};
+
+// Places sections one after another, each on an 8-byte boundary.
+class layout
+{
+    std::vector<std::pair<const void *, size_t>> parts;
+    uint64_t at = sizeof(image_header);
+
+public:
+    image_section place(const void *data, size_t size)
+    {
+        at += -at & 7;
+        parts.emplace_back(data, size);
+        image_section s = {at, size};
+        at += size;
+        return s;
+    }
+    template <class T>
+    image_section place(const std::vector<T> &v)
+    {
+        return place(v.data(), v.size() * sizeof(T));
+    }
+    void write(std::ostream &o, const image_header &h)
+    {
+        static const char zeros[8] = {};
+        uint64_t to = sizeof h;
+        o.write(reinterpret_cast<const char *>(&h), sizeof h);
+        for (auto &p : parts)
+        {
+            o.write(zeros, -to & 7);
+            to += (-to & 7) + p.second;
+            o.write(static_cast<const char *>(p.first), p.second);
+        }
+    }
+};
+
+bool inside(const image_section &s, size_t length, size_t align, size_t record)
+{
+    return s.offset <= length && s.size <= length - s.offset && s.offset % align == 0 &&
+           s.size % record == 0;
+}
+
+} // namespace
+
+void write_image(std::ostream &o, const string &source, const std::vector<lexeme> &tokens,
+                 const std::vector<stmt_ptr> &tree, const string &diagnostics)
+{
+    flattener f;
+    image_header h = {};
+    h.top_count = uint32_t(tree.size());
+    h.top_first = f.list(tree);
+
+    std::memcpy(h.magic, MAGIC, sizeof h.magic);
+    h.version = IMAGE_VERSION;
+    h.endian = ENDIAN;
+    layout l;
+    h.source = l.place(source.data(), source.size());
+    h.tokens = l.place(tokens);
+    h.symbols = l.place(f.symbols);
+    h.strings = l.place(f.strings.data(), f.strings.size());
+    h.exprs = l.place(f.exprs);
+    h.stmts = l.place(f.stmts);
+    h.lists = l.place(f.lists);
+    h.bytecode = l.place(nullptr, 0); // no bytecode yet
+    h.diagnostics = l.place(diagnostics.data(), diagnostics.size());
+    l.write(o, h);
+}
+
+program_image::~program_image()
+{
+    if (mapped)
+        munmap(const_cast<char *>(base), length);
+}
+
+bool program_image::open(const string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        problem = "cannot open " + path;
+        return false;
+    }
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        problem = "cannot map " + path;
+        return false;
+    }
+    base = static_cast<const char *>(p);
+    length = st.st_size;
+    mapped = true;
+    return check();
+}
+
+bool program_image::adopt(const void *buf, size_t len)
+{
+    base = static_cast<const char *>(buf);
+    length = len;
+    return check();
+}
+
+bool program_image::check()
+{
+    problem = "";
+    if (length < sizeof(image_header) || reinterpret_cast<uintptr_t>(base) % 8 != 0 ||
+        std::memcmp(header().magic, MAGIC, sizeof MAGIC) != 0)
+        problem = "not a program image";
+    else if (header().version != IMAGE_VERSION)
+        problem = "unsupported image version " + std::to_string(header().version);
+    else if (header().endian != ENDIAN)
+        problem = "image was written with the other byte order";
+    else
+    {
+        const image_header &h = header();
+        bool ok = inside(h.source, length, 1, 1) && inside(h.tokens, length, 4, sizeof(lexeme)) &&
+                  inside(h.symbols, length, 4, sizeof(image_symbol)) &&
+                  inside(h.strings, length, 1, 1) &&
+                  inside(h.exprs, length, 4, sizeof(image_expr)) &&
+                  inside(h.stmts, length, 4, sizeof(image_stmt)) &&
+                  inside(h.lists, length, 4, sizeof(uint32_t)) && inside(h.bytecode, length, 1, 1) &&
+                  inside(h.diagnostics, length, 1, 1) &&
+                  uint64_t(h.top_first) + h.top_count <= h.lists.size / sizeof(uint32_t);
+        if (!ok)
+            problem = "image sections out of bounds";
+    }
+    return problem.empty();
+}
+
+bool program_image::verify()
+{
+    if (!problem.empty())
+        return false;
+    const image_header &h = header();
+    size_t nsym = symbol_count(), nexpr = h.exprs.size / sizeof(image_expr),
+           nstmt = h.stmts.size / sizeof(image_stmt), nlist = h.lists.size / sizeof(uint32_t);
+    auto symbol_ok = [&](uint32_t s) { return s == IMAGE_NONE || s < nsym; };
+    // Operands come before their expression.
+    auto operand_ok = [&](uint32_t e, uint32_t i) { return e == IMAGE_NONE || e < i; };
+    auto expr_ok = [&](uint32_t e) { return e == IMAGE_NONE || e < nexpr; };
+    // How deep each record's subtree is, 0 for one not yet referred to.
+    std::vector<uint16_t> expr_depth(nexpr), stmt_depth(nstmt);
+    auto refer = [](std::vector<uint16_t> &depth, uint32_t i, uint16_t &deepest) {
+        if (i == IMAGE_NONE)
+            return true;
+        if (depth[i] == 0 || depth[i] > MAX_DEPTH)
+            return false;
+        deepest = std::max(deepest, depth[i]);
+        depth[i] = MAX_DEPTH + 1; // referred to; no other record may be
+        return true;
+    };
+    bool ok = true;
+    for (size_t i = 0; ok && i < token_count(); i++)
+        ok = tokens()[i].kind <= t_eof && tokens()[i].offset <= h.source.size &&
+             tokens()[i].length <= h.source.size - tokens()[i].offset;
+    for (size_t i = 0; ok && i < nsym; i++)
+    {
+        const image_symbol &s = section<image_symbol>(h.symbols)[i];
+        ok = s.offset <= h.strings.size && s.length <= h.strings.size - s.offset;
+    }
+    for (uint32_t i = 0; ok && i < nexpr; i++)
+    {
+        uint16_t deepest = 0;
+        ok = expr(i).op <= t_eof && symbol_ok(expr(i).text) && operand_ok(expr(i).left, i) &&
+             operand_ok(expr(i).right, i) && refer(expr_depth, expr(i).left, deepest) &&
+             refer(expr_depth, expr(i).right, deepest) && deepest < MAX_DEPTH;
+        expr_depth[i] = deepest + 1;
+    }
+    // Backwards, since a body's statements come after the statement they
+    // are in.
+    for (uint32_t i = uint32_t(nstmt); ok && i-- > 0;)
+    {
+        const image_stmt &s = stmt(i);
+        uint16_t deepest = 0;
+        ok = s.kind <= t_eof && s.type <= t_eof && s.rel <= t_eof && s.offset <= h.source.size &&
+             symbol_ok(s.id) && expr_ok(s.value) && expr_ok(s.cond_left) && expr_ok(s.cond_right) &&
+             refer(expr_depth, s.value, deepest) && refer(expr_depth, s.cond_left, deepest) &&
+             refer(expr_depth, s.cond_right, deepest) &&
+             uint64_t(s.body_first) + s.body_count <= nlist;
+        for (uint32_t k = 0; ok && k < s.body_count; k++)
+            ok = list(s.body_first)[k] > i && list(s.body_first)[k] < nstmt &&
+                 refer(stmt_depth, list(s.body_first)[k], deepest);
+        ok = ok && deepest < MAX_DEPTH;
+        stmt_depth[i] = deepest + 1;
+    }
+    for (size_t k = 0; ok && k < top_count(); k++)
+    {
+        uint16_t deepest = 0;
+        ok = top()[k] < nstmt && refer(stmt_depth, top()[k], deepest);
+    }
+    if (!ok)
+        problem = "image records out of bounds";
+    return ok;
+}
+
+expr_ptr program_image::expr_tree(uint32_t i) const
+{
+    if (i == IMAGE_NONE)
+        return nullptr;
+    const image_expr &x = expr(i);
+    string text = x.text == IMAGE_NONE ? "" : string(symbol(x.text));
+    return std::make_shared<const expr_node>(
+        expr_node{token(x.op), text, expr_tree(x.left), expr_tree(x.right)});
+}
+
+stmt_ptr program_image::stmt_tree(uint32_t i) const
+{
+    const image_stmt &x = stmt(i);
+    auto s = std::make_shared<stmt_node>();
+    s->kind = token(x.kind);
+    s->type = token(x.type);
+    s->offset = x.offset;
+    if (x.id != IMAGE_NONE)
+        s->id = string(symbol(x.id));
+    s->value = expr_tree(x.value);
+    s->cond.rel = token(x.rel);
+    s->cond.left = expr_tree(x.cond_left);
+    s->cond.right = expr_tree(x.cond_right);
+    for (uint32_t k = 0; k < x.body_count; k++)
+        s->body.push_back(stmt_tree(list(x.body_first)[k]));
+    return s;
+}
+
+std::vector<stmt_ptr> program_image::tree() const
+{
+    std::vector<stmt_ptr> t;
+    for (size_t k = 0; k < top_count(); k++)
+        t.push_back(stmt_tree(top()[k]));
+    return t;
+}
@@ -0,0 +1,164 @@
+/* Program images: a parsed program in a binary file that can be mapped
+   into memory and used where it lies, with no pass to decode it.
+
+   An image holds the source text, its tokens, the symbols (identifiers
+   and literals) interned once each, the syntax tree flattened into
+   arrays of fixed-size records that refer to each other by index, the
+   diagnostics, and a section reserved for bytecode.  Every section
+   starts on an 8-byte boundary, and records hold only 32-bit fields, so
+   they can be read in place on any machine with the writer's byte order.
+*/
+
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.hpp"
+#include "lex.hpp"
+
+const uint32_t IMAGE_VERSION = 2;
+const uint32_t IMAGE_NONE = 0xffffffff; // a missing node or symbol
+
+struct image_section
+{
+    uint64_t offset; // from the start of the image
+    uint64_t size;   // in bytes
+};
+
+struct image_header
+{
+    char magic[8];    // "CALCIMG\0"
+    uint32_t version; // IMAGE_VERSION
+    uint32_t endian;  // 0x01020304, as written
+    image_section source, tokens, symbols, strings, exprs, stmts, lists, bytecode, diagnostics;
+    uint32_t top_first; // top-level statements, in lists
+    uint32_t top_count;
+};
+
+// A symbol's text is strings[offset .. offset + length).
+struct image_symbol
+{
+    uint32_t offset, length;
+};
+
+// An expr_node.  text is a symbol; left and right are exprs.
+struct image_expr
+{
+    uint32_t op, text, left, right;
+};
+
+// A stmt_node.  kind, type and rel are tokens, a byte each; offset is
+// into the source; id is a symbol; value, cond_left and cond_right are
+// exprs; the body is lists[body_first .. body_first + body_count).
+struct image_stmt
+{
+    uint8_t kind, type, rel, unused;
+    uint32_t offset, id, value;
+    uint32_t cond_left, cond_right;
+    uint32_t body_first, body_count;
+};
+
+// Writes the image of a program: its text, the tokens lex() found in it,
+// the tree the parser built, and the parser's diagnostics.
+void write_image(std::ostream &o, const string &source, const std::vector<lexeme> &tokens,
+                 const std::vector<stmt_ptr> &tree, const string &diagnostics);
+
+// An image in memory, either mapped from a file or in a caller's buffer.
+// Opening checks the header and that every section lies in the image;
+// verify() also checks every index in every record, and that the records
+// form a tree no deeper than a parser would build (MAX_DEPTH), which
+// costs time in proportion to the size of the program.  tree() must not
+// be called on an image that has not passed verify().
+class program_image
+{
+    const char *base = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    string problem = "no image";
+
+    bool check();
+    template <class T>
+    const T *section(const image_section &s) const
+    {
+        return reinterpret_cast<const T *>(base + s.offset);
+    }
+    expr_ptr expr_tree(uint32_t i) const;
+    stmt_ptr stmt_tree(uint32_t i) const;
+
+public:
+    program_image() = default;
+    program_image(const program_image &) = delete;
+    program_image &operator=(const program_image &) = delete;
+    ~program_image();
+
+    // Maps the file at path, or uses buf[0..len), which must stay put and
+    // be 8-byte aligned.  Both return false, with error() set, if it is
+    // not a valid image.
+    bool open(const string &path);
+    bool adopt(const void *buf, size_t len);
+    bool verify();
+    const string &error() const
+    {
+        return problem;
+    }
+
+    const image_header &header() const
+    {
+        return *reinterpret_cast<const image_header *>(base);
+    }
+    std::string_view source() const
+    {
+        return std::string_view(base + header().source.offset, header().source.size);
+    }
+    const lexeme *tokens() const
+    {
+        return section<lexeme>(header().tokens);
+    }
+    size_t token_count() const
+    {
+        return header().tokens.size / sizeof(lexeme);
+    }
+    std::string_view symbol(uint32_t i) const
+    {
+        const image_symbol &s = section<image_symbol>(header().symbols)[i];
+        return std::string_view(section<char>(header().strings) + s.offset, s.length);
+    }
+    size_t symbol_count() const
+    {
+        return header().symbols.size / sizeof(image_symbol);
+    }
+    const image_expr &expr(uint32_t i) const
+    {
+        return section<image_expr>(header().exprs)[i];
+    }
+    const image_stmt &stmt(uint32_t i) const
+    {
+        return section<image_stmt>(header().stmts)[i];
+    }
+    const uint32_t *list(uint32_t first) const
+    {
+        return section<uint32_t>(header().lists) + first;
+    }
+    const uint32_t *top() const
+    {
+        return list(header().top_first);
+    }
+    size_t top_count() const
+    {
+        return header().top_count;
+    }
+    std::string_view diagnostics() const
+    {
+        return std::string_view(base + header().diagnostics.offset, header().diagnostics.size);
+    }
+
+    // The tree in the form the parser builds, for code that wants one.
+    std::vector<stmt_ptr> tree() const;
+};
+
+#endif
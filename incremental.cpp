@@ -0,0 +1,204 @@
+/* Incremental reparsing of a program as it is edited.
+
+   A parse that reaches a top-level boundary is in the same state as a
+   fresh parser started at that boundary would be: in stmt_list, with the
+   next token as lookahead and nothing open.  So once a reparse started
+   before an edit reaches a boundary past the edit that the old text also
+   had, everything after it parses as it did before, and the old units
+   can be kept.  Only their offsets change, in one pass over the units.
+
+   An edit can also leave no such boundary: a stray end at the top level
+   stops the parse, and a statement whose recovery skips the end of its
+   block puts everything after it inside that block.  The old units after
+   the edit are then kept aside rather than dropped.  Each is still what a
+   fresh parse from its offset gives, as long as the text from there on is
+   unchanged, so the edit that puts things right picks them up again
+   instead of parsing the rest anew.  The edits in between, though, do
+   parse the rest of the program, and take as long as a full parse.
+*/
+
+#include <algorithm>
+#include <sstream>
+
+#include "incremental.hpp"
+#include "parse.hpp"
+
+using std::get;
+
+namespace
+{
+
+// A scanner that also records the tokens it returns.
+class recording_scanner
+{
+    scanner s;
+    std::vector<lexeme> &tokens;
+
+public:
+    recording_scanner(std::istream &in, std::ostream &diag, std::vector<lexeme> &tokens)
+        : s(in, diag), tokens(tokens) {}
+
+    tuple<token, string> scan()
+    {
+        tuple<token, string> t = s.scan();
+        // match(t_eof) scans past the end once more.
+        if (tokens.empty() || tokens.back().kind != t_eof)
+            tokens.push_back({get<0>(t), uint32_t(s.token_start()),
+                              uint32_t(s.token_end() - s.token_start())});
+        return t;
+    }
+    int errors() const
+    {
+        return s.errors();
+    }
+    size_t token_start() const
+    {
+        return s.token_start();
+    }
+};
+
+} // namespace
+
+document::document(const string &text) : source(text)
+{
+    reparse(0, 0, 0);
+}
+
+void document::edit(size_t offset, size_t removed, const string &inserted)
+{
+    source.replace(offset, removed, inserted);
+    long delta = long(inserted.size()) - long(removed);
+    auto kept = std::lower_bound(spare.begin(), spare.end(), offset + removed,
+                                 [](const unit &u, size_t off) { return u.offset < off; });
+    spare.erase(spare.begin(), kept);
+    for (auto &u : spare)
+        u.offset += delta;
+    // Start with the unit holding the byte before the edit: an edit right
+    // at a boundary can move the end of the unit before it.
+    size_t before = offset ? offset - 1 : 0;
+    auto u = std::upper_bound(units.begin(), units.end(), before,
+                              [](size_t off, const unit &u) { return off < u.offset; });
+    reparse(u - units.begin() - 1, offset + inserted.size(), delta);
+}
+
+// Reparses the new text from the start of unit first, which lies before
+// the edit, until it reaches a boundary at or after edit_end (in the new
+// text) that was a boundary in the old text too, delta bytes earlier, or
+// that starts a spare unit.
+void document::reparse(size_t first, size_t edit_end, long delta)
+{
+    size_t start = units.empty() ? 0 : units[first].offset;
+    memstream in(source.data() + start, source.data() + source.size());
+    std::ostringstream diag;
+    std::ostream discard(nullptr); // no trace
+    std::vector<lexeme> toks;
+    recording_scanner s(in, diag, toks);
+    basic_parser<recording_scanner> p(s, discard, diag);
+
+    std::vector<unit> fresh;
+    size_t unit_start = 0, stmt_begin = 0, tok_begin = 0;
+    auto close = [&](size_t end, size_t tok_end) {
+        unit u;
+        u.offset = start + unit_start;
+        u.length = end - unit_start;
+        u.statements.assign(p.tree().begin() + stmt_begin, p.tree().end());
+        for (size_t k = tok_begin; k < tok_end; k++)
+        {
+            lexeme l = toks[k];
+            l.offset -= unit_start;
+            u.tokens.push_back(l);
+        }
+        u.diagnostics = diag.str();
+        diag.str("");
+        fresh.push_back(std::move(u));
+        unit_start = end;
+        stmt_begin = p.tree().size();
+        tok_begin = tok_end;
+    };
+    auto splice = [&](size_t last) {
+        units.erase(units.begin() + first, units.begin() + last);
+        units.insert(units.begin() + first, std::make_move_iterator(fresh.begin()),
+                     std::make_move_iterator(fresh.end()));
+        for (size_t k = first + fresh.size(); k < units.size(); k++)
+            units[k].offset += delta;
+    };
+    auto by_offset = [](const unit &u, size_t off) { return u.offset < off; };
+
+    bool started = first > 0 || p.start_program();
+    bool more = started;
+    while (more)
+    {
+        more = p.next_statement();
+        if (!more || !p.clean_statement())
+            continue;
+        // The lookahead token starts the next unit.
+        size_t boundary = p.position();
+        close(boundary, toks.size() - 1);
+        if (start + boundary < edit_end)
+            continue;
+        size_t old = start + boundary - delta;
+        auto u = units.size() > first + 1
+                     ? std::lower_bound(units.begin() + first + 1, units.end(), old, by_offset)
+                     : units.end();
+        if (u != units.end() && u->offset == old)
+        {
+            last_reparsed = boundary;
+            splice(u - units.begin());
+            return;
+        }
+        auto v = std::lower_bound(spare.begin(), spare.end(), start + boundary, by_offset);
+        if (v != spare.end() && v->offset == start + boundary)
+        {
+            last_reparsed = boundary;
+            units.erase(units.begin() + first, units.end());
+            units.insert(units.end(), std::make_move_iterator(fresh.begin()),
+                         std::make_move_iterator(fresh.end()));
+            units.insert(units.end(), std::make_move_iterator(v), std::make_move_iterator(spare.end()));
+            spare.clear();
+            return;
+        }
+    }
+    if (started)
+        p.finish_program();
+    close(source.size() - start, toks.size());
+    last_reparsed = source.size() - start;
+    if (spare.empty())
+        for (size_t k = first + 1; k < units.size(); k++)
+        {
+            size_t now = size_t(long(units[k].offset) + delta);
+            if (now >= edit_end)
+            {
+                spare.push_back(std::move(units[k]));
+                spare.back().offset = now;
+            }
+        }
+    splice(units.size());
+}
+
+std::vector<stmt_ptr> document::tree() const
+{
+    std::vector<stmt_ptr> t;
+    for (auto &u : units)
+        t.insert(t.end(), u.statements.begin(), u.statements.end());
+    return t;
+}
+
+std::vector<lexeme> document::tokens() const
+{
+    std::vector<lexeme> t;
+    for (auto &u : units)
+        for (lexeme l : u.tokens)
+        {
+            l.offset += u.offset;
+            t.push_back(l);
+        }
+    return t;
+}
+
+string document::diagnostics() const
+{
+    string d;
+    for (auto &u : units)
+        d += u.diagnostics;
+    return d;
+}
@@ -0,0 +1,69 @@
+/* Incremental reparsing of a program as it is edited.
+
+   A document keeps its text cut into units at top-level statement
+   boundaries, and for each unit the statement trees, tokens and
+   diagnostics that parsing it produced.  An edit rescans and reparses
+   from the unit it falls in, and only until the parse reaches a boundary
+   that the old text also had after the edit; the units from there on
+   are reused as they were.  Reparse time is thus proportional to the
+   size of the edit and the statements around it, not of the program,
+   except while an edit leaves the rest of the program parsing
+   differently (see incremental.cpp).
+*/
+
+#ifndef INCREMENTAL_HPP
+#define INCREMENTAL_HPP
+
+#include <vector>
+
+#include "ast.hpp"
+#include "lex.hpp"
+
+class document
+{
+    // A stretch of text that parses on its own: from one top-level
+    // boundary (the first token after a top-level ';' that was matched)
+    // to the next, so usually one statement.  The first unit starts at
+    // the start of the text and the last runs to its end.  Token offsets
+    // are relative to the unit, so the units after an edit only have their
+    // own offsets shifted.
+    struct unit
+    {
+        size_t offset, length;
+        std::vector<stmt_ptr> statements;
+        std::vector<lexeme> tokens;
+        string diagnostics;
+    };
+
+    string source;
+    std::vector<unit> units;
+    // The units that followed an edit after which no old boundary was
+    // reached: contiguous, running to the end of the text, and still
+    // valid, but not part of the tree.
+    std::vector<unit> spare;
+    size_t last_reparsed = 0;
+
+    void reparse(size_t first, size_t edit_end, long delta);
+
+public:
+    explicit document(const string &text);
+
+    // Replaces removed bytes at offset with inserted, and reparses.
+    void edit(size_t offset, size_t removed, const string &inserted);
+
+    const string &text() const
+    {
+        return source;
+    }
+    std::vector<stmt_ptr> tree() const;
+    std::vector<lexeme> tokens() const;
+    // What parser::program() would print to its diagnostic stream.
+    string diagnostics() const;
+    // Bytes of text parsed again by the last edit.
+    size_t reparsed() const
+    {
+        return last_reparsed;
+    }
+};
+
+#endif
@@ -0,0 +1,337 @@
+/* Reading many small files at once.
+   There is no liburing here, so the ring is set up and driven through
+   the raw system calls.  Each of depth slots holds one file, with at
+   most one request in flight for it: an open, and then reads into a
+   buffer that doubles when a read fills it.  A read that comes up short
+   is taken as the end of the file, as it is for regular files, which
+   saves a last read to see zero bytes; the blocking reads do the same.
+   Files are closed synchronously, which is cheap.  If the ring fails,
+   the requests in flight are waited for before their buffers are let
+   go, since the kernel would otherwise go on reading into them.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "ingest.hpp"
+#include "parallel.hpp"
+
+using std::string;
+
+const char *const read_method_names[] = {"sync", "threads", "uring"};
+
+namespace
+{
+
+const size_t FIRST_READ = 16 * 1024;
+
+// Reads all of path into text; returns 0 or an errno.
+int read_whole(const string &path, string &text)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return errno;
+    size_t got = 0;
+    text.resize(FIRST_READ);
+    while (true)
+    {
+        ssize_t n = ::read(fd, &text[got], text.size() - got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            int error = errno;
+            ::close(fd);
+            text.clear();
+            return error;
+        }
+        got += n;
+        if (got < text.size())
+            break;
+        text.resize(2 * text.size());
+    }
+    text.resize(got);
+    ::close(fd);
+    return 0;
+}
+
+class uring
+{
+    int fd = -1;
+    void *sq_ring = MAP_FAILED, *cq_ring = MAP_FAILED;
+    size_t sq_ring_size = 0, cq_ring_size = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqes_size = 0;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_cqe *cqes;
+    unsigned queued = 0;      // filled in, not yet in the ring
+    unsigned unsubmitted = 0; // in the ring, not yet taken by the kernel
+    unsigned in_flight = 0;   // taken by the kernel, not yet reaped
+
+    template <class T>
+    static T *at(void *base, unsigned offset)
+    {
+        return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+    }
+
+public:
+    // Sets up a ring for up to entries requests in flight; false if the
+    // kernel cannot, or is too old to open and read through one.
+    bool open(unsigned entries)
+    {
+        io_uring_params p = {};
+        fd = syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0 || !(p.features & IORING_FEAT_RW_CUR_POS)) // the 5.6 kernels that brought OPENAT and READ
+            return false;
+        sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                       IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED)
+            return false;
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            cq_ring = sq_ring;
+        else
+        {
+            cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           fd, IORING_OFF_CQ_RING);
+            if (cq_ring == MAP_FAILED)
+                return false;
+        }
+        sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED)
+            return false;
+        sq_tail = at<unsigned>(sq_ring, p.sq_off.tail);
+        sq_mask = at<unsigned>(sq_ring, p.sq_off.ring_mask);
+        sq_array = at<unsigned>(sq_ring, p.sq_off.array);
+        cq_head = at<unsigned>(cq_ring, p.cq_off.head);
+        cq_tail = at<unsigned>(cq_ring, p.cq_off.tail);
+        cq_mask = at<unsigned>(cq_ring, p.cq_off.ring_mask);
+        cqes = at<io_uring_cqe>(cq_ring, p.cq_off.cqes);
+        return true;
+    }
+
+    ~uring()
+    {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqes_size);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+            munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED)
+            munmap(sq_ring, sq_ring_size);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    // The next request to fill in.  The caller keeps no more requests in
+    // flight than the ring has entries.
+    io_uring_sqe *next()
+    {
+        unsigned tail = *sq_tail + queued++;
+        unsigned index = tail & *sq_mask;
+        sq_array[index] = index;
+        io_uring_sqe *sqe = &sqes[index];
+        *sqe = io_uring_sqe();
+        return sqe;
+    }
+
+    // Submits the requests filled in, with any the kernel did not take
+    // last time, and waits for at least one to finish.  The kernel takes
+    // requests in order and says how many it took; the rest stay in the
+    // ring for the next call.  On failure, they stay there for good.
+    bool submit_and_wait()
+    {
+        __atomic_store_n(sq_tail, *sq_tail + queued, __ATOMIC_RELEASE);
+        unsubmitted += queued;
+        queued = 0;
+        while (true)
+        {
+            long n = syscall(__NR_io_uring_enter, fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (n >= 0)
+            {
+                in_flight += n;
+                unsubmitted -= n;
+                return true;
+            }
+            if (errno != EINTR)
+                return false;
+        }
+    }
+
+    // Calls f(user_data, result) for each finished request.
+    template <class F>
+    void reap(F f)
+    {
+        unsigned head = *cq_head, tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            const io_uring_cqe &cqe = cqes[head & *cq_mask];
+            uint64_t data = cqe.user_data;
+            int res = cqe.res;
+            __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+            in_flight--;
+            f(data, res);
+        }
+    }
+
+    // Waits for every request the kernel took to finish, calling f for
+    // each as reap() does; false if even waiting fails.  Those it has not
+    // taken it never will, as nothing more is submitted.
+    template <class F>
+    bool drain(F f)
+    {
+        while (true)
+        {
+            reap(f);
+            if (in_flight == 0)
+                return true;
+            if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+                errno != EINTR)
+                return false;
+        }
+    }
+};
+
+struct slot
+{
+    bool busy = false;
+    size_t file = 0;
+    int fd = -1; // until the open finishes
+    size_t got = 0;
+    string text;
+};
+
+// Reads with a ring; false, having read nothing, if there is none.
+bool read_uring_files(const std::vector<string> &paths, unsigned depth,
+                      const std::function<void(size_t, string &&, int)> &got)
+{
+    depth = std::max(1u, std::min<unsigned>(depth, std::min<size_t>(paths.size(), 4096)));
+    std::vector<slot> slots(depth); // outlives the ring, which may still be writing into them
+    uring ring;
+    if (!ring.open(depth))
+        return false;
+    size_t next_file = 0, active = 0;
+
+    auto read_more = [&](size_t k) {
+        slot &s = slots[k];
+        io_uring_sqe *sqe = ring.next();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = s.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&s.text[s.got]);
+        sqe->len = s.text.size() - s.got;
+        sqe->off = s.got;
+        sqe->user_data = k;
+    };
+    auto start = [&](size_t k) {
+        if (next_file == paths.size())
+            return;
+        slot &s = slots[k];
+        s.busy = true;
+        s.file = next_file++;
+        s.fd = -1;
+        s.got = 0;
+        io_uring_sqe *sqe = ring.next();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(paths[s.file].c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = k;
+        active++;
+    };
+    auto finish = [&](size_t k, int error) {
+        slot &s = slots[k];
+        if (s.fd >= 0)
+            ::close(s.fd);
+        s.busy = false;
+        active--;
+        if (error)
+            got(s.file, string(), error);
+        else
+        {
+            s.text.resize(s.got);
+            got(s.file, std::move(s.text), 0);
+        }
+        s.text = string();
+        start(k);
+    };
+
+    for (size_t k = 0; k < depth; k++)
+        start(k);
+    while (active > 0)
+    {
+        if (!ring.submit_and_wait())
+        {
+            // Nothing more will come through the ring: the files in flight
+            // and those left fail with the same error.  The kernel may
+            // still be reading into the buffers of those in flight, so
+            // they are waited for first, and the files they opened kept to
+            // be closed; if that fails too, the buffers are never freed.
+            int error = errno;
+            bool drained = ring.drain([&](uint64_t k, int res) {
+                if (res >= 0 && slots[k].fd < 0)
+                    slots[k].fd = res;
+            });
+            if (!drained)
+                for (slot &s : slots)
+                    new string(std::move(s.text));
+            size_t left = next_file;
+            next_file = paths.size();
+            for (size_t k = 0; k < depth; k++)
+                if (slots[k].busy)
+                    finish(k, error);
+            for (size_t i = left; i < paths.size(); i++)
+                got(i, string(), error);
+            break;
+        }
+        ring.reap([&](uint64_t k, int res) {
+            slot &s = slots[k];
+            if (res < 0)
+                finish(k, -res);
+            else if (s.fd < 0)
+            {
+                s.fd = res;
+                s.text.resize(FIRST_READ);
+                read_more(k);
+            }
+            else
+            {
+                s.got += res;
+                if (s.got < s.text.size())
+                    finish(k, 0);
+                else
+                {
+                    s.text.resize(2 * s.text.size());
+                    read_more(k);
+                }
+            }
+        });
+    }
+    return true;
+}
+
+} // namespace
+
+read_method read_files(const std::vector<string> &paths, read_method how, unsigned depth,
+                       const std::function<void(size_t, string &&, int)> &got)
+{
+    if (how == read_uring && read_uring_files(paths, depth, got))
+        return read_uring;
+    if (how == read_sync)
+        depth = 1;
+    for_each_index(paths.size(), std::max(depth, 1u), [&](size_t i) {
+        string text;
+        int error = read_whole(paths[i], text);
+        got(i, std::move(text), error);
+    });
+    return how == read_sync ? read_sync : read_threads;
+}
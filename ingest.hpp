@@ -0,0 +1,34 @@
+/* Reading many small files at once, for batch parses.  Opening and
+   reading a file a system call at a time leaves the parser waiting on
+   each; here many are in flight together, through io_uring where the
+   kernel has it, or else through a pool of threads doing ordinary
+   blocking reads, and each file is handed on whole as soon as it is in.
+*/
+
+#ifndef INGEST_HPP
+#define INGEST_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+enum read_method
+{
+    read_sync,    // one file at a time, on the calling thread
+    read_threads, // blocking reads on a pool of threads
+    read_uring    // io_uring, on the calling thread
+};
+
+extern const char *const read_method_names[];
+
+// Reads the files named in paths, with up to depth of them in flight at
+// once, and calls got(i, text, error) for paths[i] once all of it is in:
+// error is 0, or the errno from opening or reading it, and then text is
+// empty.  Files finish in no particular order, and with read_threads,
+// got is called from the pool's threads, several at a time.  read_uring
+// falls back to read_threads where io_uring is not to be had.  Returns
+// the method used.
+read_method read_files(const std::vector<std::string> &paths, read_method how, unsigned depth,
+                       const std::function<void(size_t, std::string &&, int)> &got);
+
+#endif
@@ -0,0 +1,101 @@
+/* Blocked input and output of values.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include "io.hpp"
+
+namespace
+{
+
+// Whitespace, as >> skips it in the classic locale.
+inline bool space(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+} // namespace
+
+void value_output::make_room()
+{
+    if (!buf)
+    {
+        buf.reset(new char[IO_BLOCK]);
+        at = buf.get();
+        end = at + IO_BLOCK;
+    }
+    else
+        flush();
+}
+
+// Keeps what is left of the block, moved to its start, and reads more
+// after it.  Takes only what the stream has at hand, or else waits for
+// one character, so that a program reading from a terminal gets each
+// line as it is typed.  Returns false if nothing more could be read.
+bool value_input::fill()
+{
+    if (!buf)
+    {
+        buf.reset(new char[IO_BLOCK]);
+        at = end = buf.get();
+    }
+    size_t kept = end - at;
+    std::memmove(buf.get(), at, kept);
+    at = buf.get();
+    end = at + kept;
+    if (ended || kept == IO_BLOCK)
+        return false;
+    std::streambuf *sb = in.rdbuf();
+    std::streamsize n = sb->in_avail();
+    if (n <= 0)
+    {
+        if (tied)
+            tied->flush();
+        if (in.tie())
+            in.tie()->flush();
+        if (std::streambuf::traits_type::eq_int_type(sb->sgetc(), std::streambuf::traits_type::eof()))
+        {
+            ended = true;
+            in.setstate(std::ios::eofbit);
+            return false;
+        }
+        n = std::max<std::streamsize>(sb->in_avail(), 1);
+    }
+    end += sb->sgetn(end, std::min<std::streamsize>(n, IO_BLOCK - kept));
+    return true;
+}
+
+// The next word of input, up to whitespace, or false if there is none.
+// A word longer than a block is cut at the end of the block.
+bool value_input::word(const char *&first, const char *&last)
+{
+    for (;;)
+    {
+        while (at < end && space(*at))
+            at++;
+        if (at < end)
+            break;
+        if (!fill())
+            return false;
+    }
+    char *w = at;
+    for (;;)
+    {
+        while (at < end && !space(*at))
+            at++;
+        if (at < end)
+            break;
+        // The word may go on into what is not read yet.
+        size_t got = at - w;
+        at = w;
+        bool more = fill();
+        w = at;
+        at = w + got;
+        if (!more)
+            break;
+    }
+    first = w;
+    last = at;
+    return true;
+}
@@ -0,0 +1,113 @@
+/* Input and output for the read and write statements of running programs,
+   on the VM (vm.hpp) and natively (aot.hpp).  Values are read from the
+   stream's buffer a block at a time and parsed where they lie with
+   from_chars, and written with to_chars into a block that goes out in one
+   write when it is full, so that neither goes through iostream's
+   formatting and its sentries a value at a time.
+
+   Input is read ahead of what the program takes, so the stream is left
+   past it.  Output waits in the block until it fills, the run ends, a
+   runtime error is reported, or more input is needed, so that a prompt
+   is out before the program waits for its answer, as cin's tie to cout
+   would see to.
+
+   The blocks are allocated at the first read or write.  Given a slot to
+   keep its block in, one that outlives it, a value_input or value_output
+   leaves the block there for the next to use, so that one run after
+   another allocates nothing.
+*/
+
+#ifndef IO_HPP
+#define IO_HPP
+
+#include <charconv>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+
+// Size of the blocks read and written.
+const size_t IO_BLOCK = 64 * 1024;
+
+// A block of IO_BLOCK bytes, or none yet.
+typedef std::unique_ptr<char[]> io_block;
+
+class value_output
+{
+    std::ostream &out;
+    io_block own;
+    io_block &buf; // own, or the slot given
+    char *at, *end;
+
+    void make_room();
+
+public:
+    explicit value_output(std::ostream &out, io_block *slot = nullptr)
+        : out(out), buf(slot ? *slot : own), at(buf.get()), end(buf ? at + IO_BLOCK : nullptr)
+    {
+    }
+    ~value_output()
+    {
+        flush();
+    }
+
+    // Writes v and a newline.
+    template <class T>
+    void write(T v)
+    {
+        if (end - at < 32) // the most either to_chars gives, and the newline
+            make_room();
+        at = std::to_chars(at, end, v).ptr;
+        *at++ = '\n';
+    }
+
+    // Writes out what is waiting, to out.
+    void flush()
+    {
+        if (at != buf.get())
+            out.write(buf.get(), at - buf.get());
+        at = buf.get();
+    }
+};
+
+class value_input
+{
+    std::istream &in;
+    value_output *tied; // flushed before waiting for input
+    io_block own;
+    io_block &buf; // own, or the slot given
+    char *at, *end;
+    bool ended = false;
+
+    bool fill();
+    bool word(const char *&first, const char *&last);
+
+    template <class T>
+    const char *parse(T &v, const char *wrong)
+    {
+        const char *first, *last;
+        if (!word(first, last))
+            return "no more input";
+        std::from_chars_result got = std::from_chars(first, last, v);
+        return got.ec != std::errc() || got.ptr != last ? wrong : nullptr;
+    }
+
+public:
+    value_input(std::istream &in, value_output *tied = nullptr, io_block *slot = nullptr)
+        : in(in), tied(tied), buf(slot ? *slot : own), at(buf.get()), end(at)
+    {
+    }
+
+    // Reads the next value into v, or says what is wrong: that there is
+    // no more input, or that the next word is not a number of the type
+    // of v.
+    const char *read(int64_t &v)
+    {
+        return parse(v, "input is not an int");
+    }
+    const char *read(double &v)
+    {
+        return parse(v, "input is not a real");
+    }
+};
+
+#endif
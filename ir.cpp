@@ -0,0 +1,788 @@
+/* The SSA form of calculator programs, and its optimizations.
+   Construction follows Braun et al., "Simple and Efficient Construction
+   of Static Single Assignment Form" (CC 2013): a variable's value in a
+   block is found by looking back through its predecessors, and a block
+   whose predecessors are not all known yet (a loop header, until the
+   body is done) gets placeholder phis that are filled in when it is
+   sealed.  Each assignment is built as a copy, and phis are made without
+   checking whether they are needed; the optimizations clear both away.
+*/
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+#include "ir.hpp"
+
+const char *const ir_op_names[] = {"const", "copy", "phi", "add", "sub", "mul", "div",
+                                   "trunc", "float", "eq", "ne", "lt", "gt", "le", "ge",
+                                   "read", "write", "jump", "branch", "halt"};
+const char *const ir_type_names[] = {"void", "int", "real", "bool"};
+
+std::vector<int> ir_program::succs(int b) const
+{
+    const ir_inst &last = insts[blocks[b].code.back()];
+    if (last.op == op_jump)
+        return {last.target[0]};
+    if (last.op == op_branch)
+        return {last.target[0], last.target[1]};
+    return {};
+}
+
+namespace
+{
+
+class builder
+{
+    struct variable
+    {
+        string name;
+        ir_type type;
+    };
+
+    ir_program &ir;
+    std::ostream &diag;
+    bool ok = true;
+    std::vector<variable> vars;
+    std::vector<std::unordered_map<string, int>> scopes; // innermost last
+    std::vector<std::unordered_map<int, int>> defs;     // by block: variable to value
+    std::vector<bool> sealed;
+    std::vector<std::vector<std::pair<int, int>>> incomplete; // by block: variable, phi
+    int current = 0;
+    int stmt = -1; // being built
+
+    void error(const string &message)
+    {
+        diag << "semantic error: " << message << std::endl;
+        ok = false;
+    }
+
+    int new_block(std::vector<int> preds)
+    {
+        ir.blocks.emplace_back();
+        ir.blocks.back().preds = std::move(preds);
+        defs.emplace_back();
+        sealed.push_back(false);
+        incomplete.emplace_back();
+        return ir.blocks.size() - 1;
+    }
+
+    int emit(ir_op op, ir_type type, std::vector<int> args = {})
+    {
+        ir_inst in;
+        in.op = op;
+        in.type = type;
+        in.block = current;
+        in.args = std::move(args);
+        in.stmt = stmt;
+        ir.insts.push_back(std::move(in));
+        ir.blocks[current].code.push_back(ir.insts.size() - 1);
+        return ir.insts.size() - 1;
+    }
+
+    int jump(int target)
+    {
+        int j = emit(op_jump, ir_void);
+        ir.insts[j].target[0] = target;
+        return j;
+    }
+
+    // A phi with no arguments yet, after any others at the top of block.
+    int phi(int block, ir_type type)
+    {
+        ir_inst in;
+        in.op = op_phi;
+        in.type = type;
+        in.block = block;
+        in.stmt = stmt;
+        ir.insts.push_back(std::move(in));
+        int id = ir.insts.size() - 1;
+        std::vector<int> &code = ir.blocks[block].code;
+        auto at = std::find_if(code.begin(), code.end(),
+                               [&](int k) { return ir.insts[k].op != op_phi; });
+        code.insert(at, id);
+        return id;
+    }
+
+    void write_var(int var, int block, int value)
+    {
+        defs[block][var] = value;
+    }
+
+    int read_var(int var, int block)
+    {
+        auto it = defs[block].find(var);
+        if (it != defs[block].end())
+            return it->second;
+        const std::vector<int> &preds = ir.blocks[block].preds;
+        int value;
+        if (!sealed[block])
+        {
+            value = phi(block, vars[var].type);
+            incomplete[block].emplace_back(var, value);
+        }
+        else if (preds.size() == 1)
+            value = read_var(var, preds[0]);
+        else
+        {
+            value = phi(block, vars[var].type);
+            write_var(var, block, value); // a loop back to here finds the phi
+            add_operands(var, value);
+        }
+        write_var(var, block, value);
+        return value;
+    }
+
+    void add_operands(int var, int phi)
+    {
+        for (size_t k = 0; k < ir.blocks[ir.insts[phi].block].preds.size(); k++)
+        {
+            int value = read_var(var, ir.blocks[ir.insts[phi].block].preds[k]);
+            ir.insts[phi].args.push_back(value);
+        }
+    }
+
+    void seal(int block)
+    {
+        for (auto &p : incomplete[block])
+            add_operands(p.first, p.second);
+        incomplete[block].clear();
+        sealed[block] = true;
+    }
+
+    // The variable named, or -1 if none is visible.
+    int lookup(const string &name)
+    {
+        for (auto s = scopes.rbegin(); s != scopes.rend(); ++s)
+        {
+            auto it = s->find(name);
+            if (it != s->end())
+                return it->second;
+        }
+        return -1;
+    }
+
+    int declare(const string &name, ir_type type)
+    {
+        if (lookup(name) >= 0)
+            error(name + " is already declared");
+        vars.push_back({name, type});
+        scopes.back()[name] = vars.size() - 1;
+        return vars.size() - 1;
+    }
+
+    ir_type type_of(int value)
+    {
+        return value < 0 ? ir_void : ir.insts[value].type;
+    }
+
+    // The value of e, or -1 after an error.
+    int expression(const expr_ptr &e)
+    {
+        if (!e)
+        {
+            error("an expression is missing");
+            return -1;
+        }
+        switch (e->op)
+        {
+        case t_id:
+        {
+            int var = lookup(e->text);
+            if (var < 0)
+            {
+                error(e->text + " is not declared");
+                return -1;
+            }
+            return read_var(var, current);
+        }
+        case t_i_num:
+        {
+            int64_t v = 0;
+            const char *end = e->text.data() + e->text.size();
+            std::from_chars_result got = std::from_chars(e->text.data(), end, v);
+            if (got.ec != std::errc() || got.ptr != end)
+            {
+                error("integer " + e->text + " is out of range");
+                return -1;
+            }
+            int c = emit(op_const, ir_int);
+            ir.insts[c].i = v;
+            return c;
+        }
+        case t_r_num:
+        {
+            int c = emit(op_const, ir_real);
+            ir.insts[c].r = std::strtod(e->text.c_str(), nullptr);
+            return c;
+        }
+        case t_trunc:
+        case t_float:
+        {
+            int v = expression(e->left);
+            ir_type from = e->op == t_trunc ? ir_real : ir_int;
+            if (v < 0)
+                return -1;
+            if (type_of(v) != from)
+            {
+                error(string(e->op == t_trunc ? "trunc" : "float") + " of " +
+                      ir_type_names[type_of(v)]);
+                return -1;
+            }
+            return emit(e->op == t_trunc ? op_trunc : op_float, e->op == t_trunc ? ir_int : ir_real, {v});
+        }
+        default:
+        {
+            int l = expression(e->left), r = expression(e->right);
+            if (l < 0 || r < 0)
+                return -1;
+            if (type_of(l) != type_of(r))
+            {
+                error(string("operands of ") + ir_op_names[op_add + (e->op - t_add)] + " are " +
+                      ir_type_names[type_of(l)] + " and " + ir_type_names[type_of(r)]);
+                return -1;
+            }
+            return emit(ir_op(op_add + (e->op - t_add)), type_of(l), {l, r});
+        }
+        }
+    }
+
+    int condition(const cond_node &c)
+    {
+        if (c.rel == t_eof)
+        {
+            error("a comparison is missing");
+            return -1;
+        }
+        int l = expression(c.left), r = expression(c.right);
+        if (l < 0 || r < 0)
+            return -1;
+        if (type_of(l) != type_of(r))
+        {
+            error(string("comparison of ") + ir_type_names[type_of(l)] + " and " +
+                  ir_type_names[type_of(r)]);
+            return -1;
+        }
+        return emit(ir_op(op_eq + (c.rel - t_equal)), ir_bool, {l, r});
+    }
+
+    // Assigns value to var, checking that the types agree.
+    void assign(int var, int value)
+    {
+        if (var < 0 || value < 0)
+            return;
+        if (vars[var].type != type_of(value))
+        {
+            error(vars[var].name + " is " + ir_type_names[vars[var].type] + ", not " +
+                  ir_type_names[type_of(value)]);
+            return;
+        }
+        write_var(var, current, value);
+    }
+
+    void statement(const stmt_node &s)
+    {
+        int parent = stmt;
+        stmt = ir.statements.size();
+        ir.statements.push_back({s.kind, s.id, s.offset, parent});
+        statement_code(s);
+        stmt = parent;
+    }
+
+    void statement_code(const stmt_node &s)
+    {
+        int self = stmt;
+        switch (s.kind)
+        {
+        case t_int:
+        case t_real:
+        {
+            int v = expression(s.value);
+            int var = declare(s.id, s.kind == t_int ? ir_int : ir_real);
+            if (v >= 0)
+                assign(var, emit(op_copy, type_of(v), {v}));
+            break;
+        }
+        case t_id:
+        {
+            int var = lookup(s.id);
+            if (var < 0)
+                error(s.id + " is not declared");
+            int v = expression(s.value);
+            if (v >= 0)
+                assign(var, emit(op_copy, type_of(v), {v}));
+            break;
+        }
+        case t_read:
+        {
+            int var = s.type == t_id ? lookup(s.id)
+                                     : declare(s.id, s.type == t_int ? ir_int : ir_real);
+            if (var < 0)
+            {
+                error(s.id + " is not declared");
+                break;
+            }
+            assign(var, emit(op_read, vars[var].type));
+            break;
+        }
+        case t_write:
+        {
+            int v = expression(s.value);
+            if (v >= 0)
+                emit(op_write, ir_void, {v});
+            break;
+        }
+        case t_if:
+        {
+            int c = condition(s.cond);
+            int from = current;
+            int branch = emit(op_branch, ir_void, {c});
+            int then = new_block({from});
+            seal(then);
+            current = then;
+            statements(s.body);
+            stmt = self;
+            int jump_out = jump(-1);
+            int join = new_block({from, current});
+            seal(join);
+            ir.insts[branch].target[0] = then;
+            ir.insts[branch].target[1] = join;
+            ir.insts[jump_out].target[0] = join;
+            current = join;
+            break;
+        }
+        case t_while:
+        {
+            int pre = new_block({current});
+            jump(pre);
+            seal(pre);
+            current = pre;
+            int header = new_block({pre});
+            jump(header);
+            size_t loop = ir.loops.size();
+            ir.loops.push_back({pre, header, -1});
+            current = header;
+            int c = condition(s.cond);
+            int branch = emit(op_branch, ir_void, {c});
+            int body = new_block({header});
+            seal(body);
+            current = body;
+            statements(s.body);
+            stmt = self;
+            jump(header);
+            ir.blocks[header].preds.push_back(current);
+            seal(header);
+            int exit = new_block({header});
+            seal(exit);
+            ir.insts[branch].target[0] = body;
+            ir.insts[branch].target[1] = exit;
+            ir.loops[loop].exit = exit;
+            current = exit;
+            break;
+        }
+        default:
+            error("unexpected statement");
+        }
+    }
+
+    void statements(const std::vector<stmt_ptr> &list)
+    {
+        scopes.emplace_back();
+        for (const stmt_ptr &s : list)
+            statement(*s);
+        scopes.pop_back();
+    }
+
+public:
+    builder(ir_program &ir, std::ostream &diag) : ir(ir), diag(diag) {}
+
+    bool build(const std::vector<stmt_ptr> &program)
+    {
+        ir = ir_program();
+        current = new_block({});
+        seal(current);
+        statements(program);
+        emit(op_halt, ir_void);
+        return ok;
+    }
+};
+
+// Values replaced by others, and the instructions that yielded them
+// dropped from their blocks.
+class replacements
+{
+    std::vector<int> to;
+
+public:
+    explicit replacements(size_t n) : to(n, -1) {}
+
+    bool replaced(int v) const
+    {
+        return to[v] >= 0;
+    }
+
+    void replace(int v, int with)
+    {
+        to[v] = with;
+    }
+
+    int resolve(int v) const
+    {
+        while (to[v] >= 0)
+            v = to[v];
+        return v;
+    }
+
+    void apply(ir_program &ir) const
+    {
+        for (ir_block &b : ir.blocks)
+        {
+            b.code.erase(std::remove_if(b.code.begin(), b.code.end(),
+                                        [&](int k) { return replaced(k); }),
+                         b.code.end());
+            for (int k : b.code)
+                for (int &a : ir.insts[k].args)
+                    a = resolve(a);
+        }
+    }
+};
+
+bool is_compare(ir_op op)
+{
+    return op >= op_eq && op <= op_ge;
+}
+
+// An int division that cannot fail: by a constant other than zero.
+bool safe_division(const ir_program &ir, const ir_inst &in)
+{
+    const ir_inst &d = ir.insts[in.args[1]];
+    return in.type != ir_int || (d.op == op_const && d.i != 0);
+}
+
+// Whether the instruction yields a value and does nothing else, and so
+// may be run anywhere its arguments are known, or not at all.
+bool pure(const ir_program &ir, const ir_inst &in)
+{
+    switch (in.op)
+    {
+    case op_const:
+    case op_copy:
+    case op_add:
+    case op_sub:
+    case op_mul:
+    case op_float:
+        return true;
+    case op_div:
+        return safe_division(ir, in);
+    default:
+        return is_compare(in.op);
+    }
+}
+
+size_t propagate_copies(ir_program &ir)
+{
+    replacements r(ir.insts.size());
+    size_t removed = 0;
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (ir_block &b : ir.blocks)
+            for (int k : b.code)
+            {
+                const ir_inst &in = ir.insts[k];
+                if (r.replaced(k))
+                    continue;
+                int same = -1;
+                if (in.op == op_copy)
+                    same = r.resolve(in.args[0]);
+                else if (in.op == op_phi)
+                {
+                    // A phi whose arguments are all one value, or itself.
+                    for (int a : in.args)
+                    {
+                        int v = r.resolve(a);
+                        if (v == k || v == same)
+                            continue;
+                        if (same >= 0)
+                        {
+                            same = -1;
+                            break;
+                        }
+                        same = v;
+                    }
+                }
+                if (same >= 0)
+                {
+                    r.replace(k, same);
+                    removed++;
+                    changed = true;
+                }
+            }
+    }
+    r.apply(ir);
+    return removed;
+}
+
+// Immediate dominators, by the iterative method of Cooper, Harvey and
+// Kennedy, "A Simple, Fast Dominance Algorithm".  Unreachable blocks
+// get -1.
+std::vector<int> dominators(const ir_program &ir)
+{
+    size_t n = ir.blocks.size();
+    std::vector<int> order, number(n, -1), idom(n, -1);
+    std::vector<bool> seen(n, false);
+    // Postorder, without recursion.
+    std::vector<std::pair<int, size_t>> stack = {{0, 0}};
+    seen[0] = true;
+    while (!stack.empty())
+    {
+        int b = stack.back().first;
+        std::vector<int> s = ir.succs(b);
+        if (stack.back().second < s.size())
+        {
+            int t = s[stack.back().second++];
+            if (!seen[t])
+            {
+                seen[t] = true;
+                stack.push_back({t, 0});
+            }
+        }
+        else
+        {
+            number[b] = order.size();
+            order.push_back(b);
+            stack.pop_back();
+        }
+    }
+    auto intersect = [&](int a, int b) {
+        while (a != b)
+        {
+            while (number[a] < number[b])
+                a = idom[a];
+            while (number[b] < number[a])
+                b = idom[b];
+        }
+        return a;
+    };
+    idom[0] = 0;
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (auto it = order.rbegin(); it != order.rend(); ++it)
+        {
+            int b = *it, d = -1;
+            if (b == 0)
+                continue;
+            for (int p : ir.blocks[b].preds)
+                if (number[p] >= 0 && idom[p] >= 0)
+                    d = d < 0 ? p : intersect(p, d);
+            if (d != idom[b])
+            {
+                idom[b] = d;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+size_t eliminate_common(ir_program &ir)
+{
+    std::vector<int> idom = dominators(ir);
+    std::vector<std::vector<int>> children(ir.blocks.size());
+    for (size_t b = 1; b < ir.blocks.size(); b++)
+        if (idom[b] >= 0)
+            children[idom[b]].push_back(b);
+
+    typedef std::tuple<int, int, int, int, int64_t> key; // op, type, args, constant bits
+    std::map<key, int> available;
+    replacements r(ir.insts.size());
+    size_t removed = 0;
+
+    // Depth first through the dominator tree, so that what is available
+    // at a block is what its dominators computed.
+    std::vector<std::pair<int, std::vector<key>>> stack;
+    auto enter = [&](int b) {
+        std::vector<key> added;
+        for (int k : ir.blocks[b].code)
+        {
+            const ir_inst &in = ir.insts[k];
+            bool candidate = pure(ir, in) || in.op == op_div || in.op == op_trunc;
+            if (!candidate || in.op == op_copy)
+                continue;
+            int a = in.args.size() > 0 ? r.resolve(in.args[0]) : -1;
+            int c = in.args.size() > 1 ? r.resolve(in.args[1]) : -1;
+            bool commutes = in.op == op_add || in.op == op_mul || in.op == op_eq || in.op == op_ne;
+            if (commutes && a > c)
+                std::swap(a, c);
+            int64_t bits = in.i;
+            if (in.type == ir_real && in.op == op_const)
+                std::memcpy(&bits, &in.r, sizeof bits);
+            key k2(in.op, in.type, a, c, bits);
+            auto it = available.find(k2);
+            if (it != available.end())
+            {
+                r.replace(k, it->second);
+                removed++;
+            }
+            else
+            {
+                available[k2] = k;
+                added.push_back(k2);
+            }
+        }
+        stack.push_back({b, std::move(added)});
+    };
+    std::vector<std::pair<int, size_t>> walk = {{0, 0}};
+    enter(0);
+    while (!walk.empty())
+    {
+        int b = walk.back().first;
+        if (walk.back().second < children[b].size())
+        {
+            int c = children[b][walk.back().second++];
+            walk.push_back({c, 0});
+            enter(c);
+        }
+        else
+        {
+            for (const key &k : stack.back().second)
+                available.erase(k);
+            stack.pop_back();
+            walk.pop_back();
+        }
+    }
+    r.apply(ir);
+    return removed;
+}
+
+size_t hoist_invariants(ir_program &ir)
+{
+    size_t hoisted = 0;
+    for (auto loop = ir.loops.rbegin(); loop != ir.loops.rend(); ++loop)
+    {
+        auto inside = [&](int b) { return b >= loop->header && b < loop->exit; };
+        std::vector<int> &pre = ir.blocks[loop->preheader].code;
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (int b = loop->header; b < loop->exit; b++)
+            {
+                std::vector<int> kept;
+                for (int k : ir.blocks[b].code)
+                {
+                    ir_inst &in = ir.insts[k];
+                    bool invariant = pure(ir, in) && std::none_of(in.args.begin(), in.args.end(),
+                                                                  [&](int a) {
+                                                                      return inside(ir.insts[a].block);
+                                                                  });
+                    if (!invariant)
+                    {
+                        kept.push_back(k);
+                        continue;
+                    }
+                    pre.insert(pre.end() - 1, k);
+                    in.block = loop->preheader;
+                    hoisted += in.op != op_const; // constants cost nothing to run anywhere
+                    changed = true;
+                }
+                ir.blocks[b].code.swap(kept);
+            }
+        }
+    }
+    return hoisted;
+}
+
+// Every value here is a store to a variable, of a sort, so the values
+// never used are the dead stores: those, and whatever only they used.
+size_t eliminate_dead_stores(ir_program &ir)
+{
+    std::vector<bool> live(ir.insts.size(), false);
+    std::vector<int> work;
+    for (const ir_block &b : ir.blocks)
+        for (int k : b.code)
+            if (!pure(ir, ir.insts[k]) && ir.insts[k].op != op_phi)
+            {
+                live[k] = true;
+                work.push_back(k);
+            }
+    while (!work.empty())
+    {
+        int k = work.back();
+        work.pop_back();
+        for (int a : ir.insts[k].args)
+            if (!live[a])
+            {
+                live[a] = true;
+                work.push_back(a);
+            }
+    }
+    size_t removed = 0;
+    for (ir_block &b : ir.blocks)
+    {
+        auto dead = [&](int k) { return !live[k]; };
+        for (int k : b.code)
+            removed += dead(k) && ir.insts[k].op != op_const;
+        b.code.erase(std::remove_if(b.code.begin(), b.code.end(), dead), b.code.end());
+    }
+    return removed;
+}
+
+} // namespace
+
+bool build_ir(const std::vector<stmt_ptr> &program, ir_program &ir, std::ostream &diag)
+{
+    return builder(ir, diag).build(program);
+}
+
+ir_counts optimize(ir_program &ir)
+{
+    ir_counts n;
+    n.copies = propagate_copies(ir);
+    n.common = eliminate_common(ir);
+    n.hoisted = hoist_invariants(ir);
+    n.dead = eliminate_dead_stores(ir);
+    return n;
+}
+
+void print(std::ostream &o, const ir_program &ir)
+{
+    for (size_t b = 0; b < ir.blocks.size(); b++)
+    {
+        o << 'b' << b << ':';
+        if (!ir.blocks[b].preds.empty())
+        {
+            o << "  ; from";
+            for (int p : ir.blocks[b].preds)
+                o << " b" << p;
+        }
+        o << '\n';
+        for (int k : ir.blocks[b].code)
+        {
+            const ir_inst &in = ir.insts[k];
+            o << "    ";
+            if (in.type != ir_void)
+                o << 'v' << k << " = ";
+            o << ir_op_names[in.op];
+            if (in.type != ir_void)
+                o << '.' << ir_type_names[in.type];
+            if (in.op == op_const)
+            {
+                if (in.type == ir_int)
+                    o << ' ' << in.i;
+                else
+                    o << ' ' << in.r;
+            }
+            for (size_t a = 0; a < in.args.size(); a++)
+                o << (a ? ", v" : " v") << in.args[a];
+            for (int t : in.target)
+                if (t >= 0)
+                    o << " b" << t;
+            o << '\n';
+        }
+    }
+}
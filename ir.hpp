@@ -0,0 +1,134 @@
+/* An intermediate representation of calculator programs, in static
+   single assignment form, and the optimizations done on it.
+
+   The language, as the IR gives it meaning:
+     - There are two types: int, 64 bits with wraparound, and real, a
+       double.  Nothing converts implicitly: both operands of an operator
+       or a comparison have the same type, and trunc and float convert.
+     - int x := E, real x := E, read int x and read real x declare x,
+       from there to the end of the statement list they are in.  A name
+       may not be declared again where it is already visible.  x := E
+       and read x need x declared, with the type of E.
+     - int / truncates toward zero.  Dividing an int by zero, and trunc
+       of a real that no int can hold, are runtime errors.
+
+   A program is a list of basic blocks, each a list of instructions that
+   begins with its phis and ends with a jump, a branch or a halt.  Every
+   instruction that yields a value is that value; there are no separate
+   variables.  Constants are instructions too.
+*/
+
+#ifndef IR_HPP
+#define IR_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "ast.hpp"
+
+enum ir_type : uint8_t
+{
+    ir_void, // of an instruction that yields nothing
+    ir_int,
+    ir_real,
+    ir_bool
+};
+
+enum ir_op : uint8_t
+{
+    op_const,  // i or r, by type
+    op_copy,   // args[0]
+    op_phi,    // args[k] if control came from preds[k]
+    op_add,    // args[0] + args[1], in type; likewise the next three
+    op_sub,
+    op_mul,
+    op_div,
+    op_trunc,  // real args[0] to int
+    op_float,  // int args[0] to real
+    op_eq,     // args[0] == args[1], both of one type; likewise the next five
+    op_ne,
+    op_lt,
+    op_gt,
+    op_le,
+    op_ge,
+    op_read,   // the next input, of type
+    op_write,  // args[0]
+    op_jump,   // to target[0]
+    op_branch, // to target[0] if args[0], else to target[1]
+    op_halt
+};
+
+extern const char *const ir_op_names[];
+extern const char *const ir_type_names[];
+
+struct ir_inst
+{
+    ir_op op;
+    ir_type type;          // of the value it yields
+    int block = -1;        // that holds it
+    std::vector<int> args; // the values it uses
+    int64_t i = 0;         // of an int constant
+    double r = 0;          // of a real constant
+    int target[2] = {-1, -1};
+    int stmt = -1;         // the statement it was built for, if any
+};
+
+struct ir_block
+{
+    std::vector<int> code;  // its instructions, in order
+    std::vector<int> preds; // in the order of its phis' arguments
+};
+
+// A while loop: the preheader runs once before it, the header tests the
+// condition, and control leaves it for exit.  The loop's blocks are the
+// header and those numbered up to exit, nested loops included.
+struct ir_loop
+{
+    int preheader, header, exit;
+};
+
+// A statement of the source, so that what runs can be traced back to it.
+// An if or a while owns the code that tests its condition and the jumps
+// around its body, and what it takes to leave and enter that body.
+struct ir_statement
+{
+    token kind;    // as in stmt_node
+    string id;     // the variable it declares, assigns or reads, if any
+    size_t offset; // of its first token, in the program text
+    int parent;    // the if or while it is in, or -1
+};
+
+struct ir_program
+{
+    std::vector<ir_inst> insts;
+    std::vector<ir_block> blocks;         // entered at 0
+    std::vector<ir_loop> loops;           // outermost first
+    std::vector<ir_statement> statements; // in the order they begin
+
+    // The blocks control can go to from b.
+    std::vector<int> succs(int b) const;
+};
+
+// Builds the IR of a program that parsed without errors.  Returns false,
+// having written a line to diag for each error found, if the program
+// breaks a rule of the language.
+bool build_ir(const std::vector<stmt_ptr> &program, ir_program &ir, std::ostream &diag = std::cerr);
+
+// What each optimization removed or moved.
+struct ir_counts
+{
+    size_t copies = 0;  // copies and redundant phis propagated away
+    size_t common = 0;  // subexpressions computed already
+    size_t hoisted = 0; // loop-invariant instructions moved out of loops
+    size_t dead = 0;    // values never used
+};
+
+// Optimizes the program in place: copy propagation, common-subexpression
+// elimination, loop-invariant code motion and dead-store elimination.
+ir_counts optimize(ir_program &ir);
+
+// Prints the program, a block at a time, for reading.
+void print(std::ostream &o, const ir_program &ir);
+
+#endif
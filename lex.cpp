@@ -0,0 +1,168 @@
+/* Token arrays, scanned sequentially or in parallel.
+
+   The parallel scanner cuts the input into equal chunks at arbitrary
+   bytes and scans each one speculatively, guessing that a token starts
+   right at the cut.  The guess is wrong when a token (an identifier, a
+   real literal, ':=', '<=', '<>' ...) straddles the cut, so the chunks
+   are then stitched together in order: starting from the end of the
+   last token known to be right, the input is rescanned sequentially
+   until a token starts where one of the chunk's speculative tokens does.
+   The scanner carries no state from one token to the next beyond its
+   position, so from that token on the speculative tokens are exactly
+   what a sequential scan would have produced, and the rest of the chunk
+   is taken as is.  Usually that happens within a token or two of the cut.
+*/
+
+#include <algorithm>
+#include <sstream>
+
+#include "lex.hpp"
+#include "parallel.hpp"
+
+using std::get;
+
+string image(const char *buf, const lexeme &l)
+{
+    switch (l.kind)
+    {
+    case t_id:
+    case t_i_num:
+    case t_r_num:
+        return string(buf + l.offset, l.length);
+    default:
+        return "";
+    }
+}
+
+std::vector<lexeme> lex(const char *buf, size_t len, std::ostream &diag)
+{
+    memstream in(buf, buf + len);
+    scanner s(in, diag);
+    std::vector<lexeme> tokens;
+    token t;
+    do
+    {
+        t = get<0>(s.scan());
+        tokens.push_back({t, uint32_t(s.token_start()), uint32_t(s.token_end() - s.token_start())});
+    } while (t != t_eof);
+    return tokens;
+}
+
+namespace
+{
+
+// Lexical errors, each tagged with the index of the token whose scan
+// reported it, so they can be dropped along with a wrong guess.
+typedef std::vector<std::pair<size_t, string>> error_list;
+
+// Scans the tokens that start in buf[begin..end), letting the last one
+// run past end.  The scanner at a cut may not be at a token boundary.
+struct chunk
+{
+    size_t begin, end;
+    std::vector<lexeme> tokens;
+    error_list errors;
+};
+
+// A scanner started at offset base of buf, whose lexical errors are
+// collected per token instead of printed.
+class resumed_scanner
+{
+    memstream in;
+    std::ostringstream d;
+    scanner s;
+    size_t base;
+public:
+    resumed_scanner(const char *buf, size_t len, size_t base)
+        : in(buf + base, buf + len), s(in, d), base(base) {}
+
+    lexeme next(error_list &errors, size_t index)
+    {
+        int before = s.errors();
+        token t = get<0>(s.scan());
+        if (s.errors() != before)
+        {
+            errors.push_back({index, d.str()});
+            d.str("");
+        }
+        return {t, uint32_t(base + s.token_start()), uint32_t(s.token_end() - s.token_start())};
+    }
+};
+
+void scan_chunk(const char *buf, size_t len, chunk &c)
+{
+    resumed_scanner s(buf, len, c.begin);
+    error_list errors;
+    for (;;)
+    {
+        lexeme l = s.next(errors, c.tokens.size());
+        if (l.offset >= c.end && !(l.kind == t_eof && c.end == len))
+            break;
+        c.tokens.push_back(l);
+        if (l.kind == t_eof)
+            break;
+    }
+    // An error reported while scanning the token past the end belongs to
+    // the next chunk.
+    while (!errors.empty() && errors.back().first >= c.tokens.size())
+        errors.pop_back();
+    c.errors = std::move(errors);
+}
+
+} // namespace
+
+std::vector<lexeme> lex_parallel(const char *buf, size_t len, unsigned nthreads,
+                                 std::ostream &diag)
+{
+    const size_t MIN_CHUNK = 1 << 16;
+    size_t n = std::max<size_t>(1, std::min<size_t>(nthreads, len / MIN_CHUNK));
+    std::vector<chunk> chunks(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        chunks[i].begin = len / n * i;
+        chunks[i].end = i == n - 1 ? len : len / n * (i + 1);
+    }
+    for_each_index(n, nthreads, [&](size_t i) { scan_chunk(buf, len, chunks[i]); });
+
+    // Stitch.  The first chunk starts at a real token boundary.
+    std::vector<lexeme> tokens;
+    error_list errors;
+    auto adopt = [&](const chunk &c, size_t from) {
+        for (auto &e : c.errors)
+            if (e.first >= from)
+                errors.push_back({tokens.size() + e.first - from, e.second});
+        tokens.insert(tokens.end(), c.tokens.begin() + from, c.tokens.end());
+    };
+    adopt(chunks[0], 0);
+
+    size_t i = 1;
+    while (tokens.empty() || tokens.back().kind != t_eof)
+    {
+        size_t resume = tokens.empty() ? 0 : tokens.back().offset + tokens.back().length;
+        resumed_scanner s(buf, len, resume);
+        for (;;)
+        {
+            lexeme l = s.next(errors, tokens.size());
+            tokens.push_back(l);
+            if (l.kind == t_eof)
+                break;
+            while (i < n && l.offset >= chunks[i].end)
+                i++;
+            if (i == n || l.offset < chunks[i].begin)
+                continue;
+            auto &spec = chunks[i].tokens;
+            auto j = std::lower_bound(spec.begin(), spec.end(), l.offset,
+                                      [](const lexeme &a, size_t off) { return a.offset < off; });
+            if (j != spec.end() && j->offset == l.offset)
+            {
+                adopt(chunks[i], j - spec.begin() + 1);
+                i++;
+                break;
+            }
+        }
+    }
+
+    for (auto &e : errors)
+        diag << e.second;
+    return tokens;
+}
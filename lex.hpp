@@ -0,0 +1,35 @@
+/* Token arrays: the whole input scanned up front into compact tokens,
+   sequentially or in parallel.
+*/
+
+#ifndef LEX_HPP
+#define LEX_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "scan.hpp"
+
+// A token and where it lies in the input.  Offsets are 32 bits, which
+// limits a token array to 4 GB of source.
+struct lexeme
+{
+    token kind;
+    uint32_t offset;
+    uint32_t length;
+};
+
+// The token_image scanner::scan() would have returned with the token.
+string image(const char *buf, const lexeme &l);
+
+// Scans buf[0..len) into an array ending with t_eof, printing lexical
+// errors to diag as scanner::scan() would.
+std::vector<lexeme> lex(const char *buf, size_t len, std::ostream &diag = std::cerr);
+
+// Same result as lex(), with the input split into chunks that are
+// scanned on up to nthreads threads.
+std::vector<lexeme> lex_parallel(const char *buf, size_t len, unsigned nthreads,
+                                 std::ostream &diag = std::cerr);
+
+#endif
@@ -0,0 +1,151 @@
+/* Parallel parsing of one large program.
+
+   Statement boundaries are found with a two-pass prefix scan.  Each
+   thread scans one piece of the input, recording the net if/while ...
+   end nesting across it and the first ';' it sees at each nesting level.
+   A sequential pass over the per-piece totals then gives the depth at
+   the start of every piece, and from that its first top-level ';'.
+   Pieces start only at white space or ';', neither of which can be part
+   of a token, so every piece lexes exactly as it would in place.
+
+   The chunks between boundaries are then parsed in parallel, each into
+   its own trace and diagnostics.  A chunk whose parse does not end
+   cleanly at a top-level ';' (error recovery may swallow it, say) is not
+   trusted: its output and that of later chunks is dropped and the rest
+   of the input is parsed sequentially, so both output streams match
+   those of the sequential parser.
+*/
+
+#include <cctype>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "parse.hpp"
+#include "parallel.hpp"
+
+using std::get;
+
+namespace
+{
+
+// Smallest piece worth handing to a thread of its own.
+const size_t MIN_PIECE = 1 << 16;
+
+struct piece
+{
+    size_t begin, end;
+    int delta = 0;                    // net nesting across the piece
+    std::map<int, size_t> first_semi; // local depth -> offset just past first ';'
+};
+
+void scan_piece(const char *buf, piece &p)
+{
+    memstream in(buf + p.begin, buf + p.end);
+    std::ostringstream quiet; // errors are reported when the chunk is parsed
+    scanner s(in, quiet);
+    int depth = 0;
+    for (token t; (t = get<0>(s.scan())) != t_eof;)
+    {
+        switch (t)
+        {
+        case t_if:
+        case t_while:
+            depth++;
+            break;
+        case t_end:
+            depth--;
+            break;
+        case t_semicolon:
+            p.first_semi.emplace(depth, p.begin + s.token_end());
+            break;
+        default:
+            break;
+        }
+    }
+    p.delta = depth;
+}
+
+} // namespace
+
+void parse_parallel(const char *buf, size_t len, unsigned nthreads,
+                    std::ostream &out, std::ostream &diag)
+{
+    if (nthreads == 0)
+        nthreads = 1;
+
+    // Cut the input into pieces that start at white space or ';'.
+    size_t npieces = std::min<size_t>(4 * nthreads, len / MIN_PIECE + 1);
+    std::vector<piece> pieces;
+    size_t begin = 0;
+    for (size_t i = 1; i <= npieces; i++)
+    {
+        size_t end = std::max(begin, len / npieces * i);
+        if (i == npieces)
+            end = len;
+        while (end < len && !isspace((unsigned char)buf[end]) && buf[end] != ';')
+            end++;
+        if (end > begin)
+            pieces.push_back({begin, end});
+        begin = end;
+    }
+    for_each_index(pieces.size(), nthreads, [&](size_t i) { scan_piece(buf, pieces[i]); });
+
+    // Prefix sum of nesting depths gives each piece's top-level boundary.
+    std::vector<size_t> cuts = {0};
+    int depth = 0;
+    for (auto &p : pieces)
+    {
+        if (depth >= 0)
+        {
+            auto it = p.first_semi.find(-depth);
+            if (it != p.first_semi.end() && it->second > cuts.back())
+                cuts.push_back(it->second);
+        }
+        depth += p.delta;
+    }
+    if (cuts.size() == 1 || cuts.back() != len)
+        cuts.push_back(len);
+
+    // Parse the chunks.  Each one but the last is trimmed back to the end
+    // of its final statement, where the next chunk takes over.
+    size_t n = cuts.size() - 1;
+    std::vector<string> trace(n), diags(n);
+    std::vector<char> ok(n);
+    for_each_index(n, nthreads, [&](size_t k) {
+        memstream in(buf + cuts[k], buf + cuts[k + 1]);
+        std::ostringstream o, d;
+        parser p(in, o, d);
+        if (k == 0)
+            p.program();
+        else if (k == n - 1)
+            p.rest();
+        else
+            p.slice();
+        trace[k] = o.str();
+        diags[k] = d.str();
+        ok[k] = k == n - 1 || p.clean_cut();
+        if (ok[k] && k != n - 1)
+        {
+            trace[k].resize(p.output_cut());
+            diags[k].resize(p.diagnostic_cut());
+        }
+    });
+
+    size_t k = 0;
+    for (; k < n && ok[k]; k++)
+    {
+        out << trace[k];
+        diag << diags[k];
+    }
+    if (k < n)
+    {
+        memstream in(buf + cuts[k], buf + len);
+        parser p(in, out, diag);
+        if (k == 0)
+            p.program();
+        else
+            p.rest();
+    }
+    out.flush();
+}
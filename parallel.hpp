@@ -0,0 +1,39 @@
+/* Parallel parsing of one large program.
+   The input is cut at top-level statement boundaries, the pieces are
+   parsed on separate threads, and their traces are stitched together in
+   order.  Output is identical to that of the sequential parser.
+*/
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Parses the program in buf[0..len) with up to nthreads threads, writing
+// the trace to out and diagnostics to diag exactly as parser::program()
+// would.
+void parse_parallel(const char *buf, size_t len, unsigned nthreads,
+                    std::ostream &out = std::cout, std::ostream &diag = std::cerr);
+
+// Runs f(0) ... f(n-1) on up to nthreads threads.
+template <class F>
+void for_each_index(size_t n, unsigned nthreads, F f)
+{
+    std::atomic<size_t> next(0);
+    auto work = [&] {
+        for (size_t i; (i = next++) < n;)
+            f(i);
+    };
+    std::vector<std::thread> pool;
+    for (unsigned k = 1; k < nthreads && k < n; k++)
+        pool.emplace_back(work);
+    work();
+    for (auto &t : pool)
+        t.join();
+}
+
+#endif
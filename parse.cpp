@@ -1,10 +1,43 @@
-/* Complete recursive descent parser for the calculator language.
-   Builds on figure 2.16 in the text.  Prints a trace of productions
-   predicted and tokens matched.  Does no error recovery: prints
-   "syntax error" and dies on invalid input.
+/* Driver for the calculator parser.  Reads a program on standard input
+   and prints a trace of productions predicted and tokens matched.
+     -j N   parse in parallel on N threads (same output)
+     -p     scan on a second thread, pipelined with the parser
+     -c DIR reuse the output of an earlier run on the same program,
+            kept in directory DIR
+     -s     stream: read through a fixed buffer and keep no statement once
+            it is parsed, so memory stays bounded on endless input
+     -r FILE profile the parse: print where its time went to standard
+            error at the end, and write the same report to FILE as JSON;
+            with -x, but not -a or -l, profile the run instead
+            (profile.hpp): print its costliest statements to standard
+            error, and write its time by statement to FILE as collapsed
+            stacks for a flame graph
+     -o FILE also write the parsed program to FILE as an image (image.hpp)
+     -S PATH serve parses on the Unix domain socket PATH (server.hpp),
+            with as many workers as -j says, or one per core
+     -v     validate only: print no trace, stop at the first error with a
+            one-line diagnostic, and exit with status 1 if there was one
+     -v FILE...
+            validate each of the files, reading many at once (ingest.hpp)
+            and checking them on as many threads as -j says, or one per
+            core; diagnostics begin with the file's name
+     -x FILE run the program in FILE (vm.hpp), with its input on
+            standard input; it exits with status 1 on an error
+     -O0    with -x: run the program as written, not optimized (ir.hpp)
+     -a DIR with -x, but not -l: run the program as native code
+            (aot.hpp), compiled into DIR, or found there from an earlier run
+     -l     with -x: run the program once for each line of standard
+            input, with the line as its input, on as many threads as -j
+            says, or one per core (runner.hpp)
+     -b N   with -x, but not -a: stop a run with an error once it has
+            run N instructions (vm.hpp)
+     -t MS  with -x, but not -a: stop a run with an error once it has
+            run for MS milliseconds
    Michael L. Scott, 2008-2022.
 */
 
+#include <charconv>
+#include <cstring>
 #include <iostream>
 #include <tuple>
 #include <vector>
@@ -19,659 +52,195 @@ using std::hex;
 using std::string;
 using std::tie;
 
-#include "scan.hpp"
-
-// const char* names[] = {"read", "write", "id", "literal", "gets", "add",
-//                        "sub", "mul", "div", "lparen", "rparen", "eof"};
-
-const char *names[] = {"int", "id", "gets", "real", "trunc", "lparen", "rparen", "float",
-                       "read", "write", "if", "then", "end", "while", "do", "i_num", "r_num",
-                       "equal", "noequal", "less", "greater", "less_or_equal", "greater_or_equal",
-                       "add", "sub", "mul", "div", "semi_colon", "eof"};
-
-const std::vector<token> FIRST_P = {t_int, t_real, t_id, t_read, t_write, t_if, t_while, t_trunc, t_float};
-const std::vector<token> FIRST_S = {t_int, t_real, t_id, t_read, t_write, t_if, t_while, t_trunc, t_float};
-const std::vector<token> FIRST_SL = {t_int, t_real, t_id, t_read, t_write, t_if, t_while, t_trunc, t_float};
-const std::vector<token> FIRST_TP = {t_int, t_real};
-const std::vector<token> FIRST_F = {t_lparen, t_id, t_i_num, t_r_num};
-const std::vector<token> FIRST_T = {t_lparen, t_id, t_i_num, t_r_num};
-const std::vector<token> FIRST_E = {t_lparen, t_id, t_i_num, t_r_num};
-const std::vector<token> FIRST_C = {t_lparen, t_id, t_i_num, t_r_num};
-const std::vector<token> FIRST_AO = {t_add, t_sub};
-const std::vector<token> FIRST_MO = {t_mul, t_div};
-const std::vector<token> FIRST_TT = {t_add, t_sub};
-const std::vector<token> FIRST_FT = {t_mul, t_div};
-const std::vector<token> FIRST_RO = {t_equal, t_not_equal, t_less, t_greater, t_less_or_equal, t_greater_or_equal, t_less_or_equal, t_less_or_equal};
-
-const std::vector<token> FOLLOW_P = {t_eof};
-const std::vector<token> FOLLOW_SL = {t_eof, t_end};
-const std::vector<token> FOLLOW_S = {t_semicolon};
-const std::vector<token> FOLLOW_TP = {t_id};
-const std::vector<token> FOLLOW_C = {t_then, t_do};
-const std::vector<token> FOLLOW_E = {t_rparen, t_equal, t_not_equal, t_less, t_greater, t_less_or_equal, t_greater_or_equal, t_semicolon, t_then, t_do};
-const std::vector<token> FOLLOW_TT = {t_rparen, t_equal, t_not_equal, t_less, t_greater, t_less_or_equal, t_greater_or_equal, t_semicolon, t_then, t_do};
-const std::vector<token> FOLLOW_T = {t_add, t_sub, t_rparen, t_equal, t_not_equal, t_less, t_greater, t_less_or_equal, t_then, t_do, t_greater_or_equal, t_semicolon};
-const std::vector<token> FOLLOW_FT = {
-    t_add,
-    t_sub,
-    t_mul,
-    t_div,
-    t_rparen,
-    t_not_equal,
-    t_less,
-    t_greater,
-    t_equal,
-    t_less_or_equal,
-    t_then,
-    t_do,
-    t_greater_or_equal,
-    t_semicolon,
-};
-const std::vector<token> FOLLOW_F = {t_mul, t_div, t_add, t_sub, t_rparen, t_less, t_greater, t_less_or_equal, t_greater_or_equal, t_semicolon, t_equal, t_not_equal, t_then, t_do};
-const std::vector<token> FOLLOW_RO = {t_lparen, t_id, t_i_num, t_r_num, t_trunc, t_float};
-const std::vector<token> FOLLOW_AO = {t_lparen, t_id, t_i_num, t_r_num, t_trunc, t_float};
-const std::vector<token> FOLLOW_MO = {t_lparen, t_id, t_i_num, t_r_num, t_trunc, t_float};
-
-bool contains(std::vector<token> tokens, token k)
+#include "aot.hpp"
+#include "cache.hpp"
+#include "image.hpp"
+#include "lex.hpp"
+#include "parse.hpp"
+#include "parallel.hpp"
+#include "pipeline.hpp"
+#include "profile.hpp"
+#include "runner.hpp"
+#include "server.hpp"
+#include "stream.hpp"
+#include "validate.hpp"
+#include "vm.hpp"
+
+// Reads all of s into n, as a number in decimal; false if it is not one,
+// or too big for n.
+template <class T>
+static bool number(const char *s, T &n)
 {
-    return std::count(tokens.begin(), tokens.end(), k);
+    const char *end = s + std::strlen(s);
+    std::from_chars_result got = std::from_chars(s, end, n);
+    return got.ec == std::errc() && got.ptr == end;
 }
 
-class parser
+static int usage()
 {
-    token next_token;
-    string token_image;
-    scanner s;
-
-    void errors()
-    {
-        cerr << "syntax error ffffff" << endl;
-        exit(1);
-    }
-
-    void error()
-    {
-        cerr << "syntax error" << endl;
-    }
+    cerr << "usage: parse [-j threads | -p | -s | -c cachedir | -r report | -o image | -S socket | -v [file...] | -x program [-O0] [-a dir | [-l | -r stacks] [-b instructions] [-t ms]]]" << endl;
+    return 2;
+}
 
-    void match(token expected)
-    {
-        if (next_token == expected)
-        {
-            cout << "matched " << names[next_token] << endl;
-            tie(next_token, token_image) = s.scan();
-        }
+int main(int argc, char *argv[])
+{
+    unsigned threads = 0;
+    bool pipelined = false, streaming = false, validating = false, optimized = true,
+         by_line = false;
+    string cache_dir, image_file, report_file, socket_path, program_file, native_dir;
+    vm_limits limits;
+    uint64_t ms = 0;
+    std::vector<string> files;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc && number(argv[i + 1], threads))
+            i++;
+        else if (arg == "-p")
+            pipelined = true;
+        else if (arg == "-s")
+            streaming = true;
+        else if (arg == "-c" && i + 1 < argc)
+            cache_dir = argv[++i];
+        else if (arg == "-r" && i + 1 < argc)
+            report_file = argv[++i];
+        else if (arg == "-o" && i + 1 < argc)
+            image_file = argv[++i];
+        else if (arg == "-S" && i + 1 < argc)
+            socket_path = argv[++i];
+        else if (arg == "-x" && i + 1 < argc)
+            program_file = argv[++i];
+        else if (arg == "-O0")
+            optimized = false;
+        else if (arg == "-a" && i + 1 < argc)
+            native_dir = argv[++i];
+        else if (arg == "-l")
+            by_line = true;
+        else if (arg == "-b" && i + 1 < argc && number(argv[i + 1], limits.instructions))
+            i++;
+        else if (arg == "-t" && i + 1 < argc && number(argv[i + 1], ms) &&
+                 ms <= uint64_t(std::chrono::nanoseconds::max().count() / 1000000))
+        {
+            limits.time = std::chrono::milliseconds(ms);
+            i++;
+        }
+        else if (arg == "-v")
+            validating = true;
+        else if (validating && arg[0] != '-')
+            files.push_back(arg);
         else
-        {
-            cerr << "syntax error: got " << names[next_token] << " expected " << names[expected] << endl;
-        }
-    }
-
-public:
-    parser()
-    {
-        tie(next_token, token_image) = s.scan();
-    }
-
-    void program()
-    {
-        if (!contains(FIRST_P, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_TP, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_P, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-        switch (next_token)
-        {
-        case t_int:
-        case t_real:
-        case t_id:
-        case t_read:
-        case t_write:
-        case t_if:
-        case t_while:
-        case t_eof:
-            cout << "predict program --> stmt_list eof" << endl;
-            stmt_list();
-            match(t_eof);
-            break;
-        default:
-            return;
-        }
+            return usage();
     }
-
-private:
-    void stmt_list()
-    {
-
-        if (!contains(FIRST_SL, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_SL, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_SL, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-
-        switch (next_token)
-        {
-        case t_int:
-        case t_real:
-        case t_id:
-        case t_read:
-        case t_write:
-        case t_if:
-        case t_while:
-            cout << "predict stmt_list --> stmt ; stmt_list" << endl;
-            stmt();
-            match(t_semicolon);
-            stmt_list();
-            break;
-        case t_end:
-        case t_eof:
-            cout << "predict stmt_list --> epsilon" << endl;
-            break; // epsilon production
-        default:
-            error();
-        }
+    // With -x, -a, -l and -r each choose how to run, and -b and -t bound
+    // the VM, which -a does not use.
+    bool native = !native_dir.empty(), profiled = !program_file.empty() && !report_file.empty();
+    if (native + by_line + profiled > 1 || (native && (limits.instructions || ms)))
+        return usage();
+    if (!program_file.empty())
+    {
+        std::ifstream f(program_file, std::ios::binary);
+        if (!f)
+        {
+            cerr << "cannot read " << program_file << endl;
+            return 1;
+        }
+        string text((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        std::istringstream source(text);
+        vm_program p;
+        if (!compile(source, p, optimized))
+            return 1;
+        std::ios::sync_with_stdio(false);
+        if (!report_file.empty())
+        {
+            run_profile profile;
+            bool ok = run(p, profile, limits, std::cin, cout);
+            cout.flush();
+            profile.report(cerr, p, text);
+            std::ofstream stacks(report_file);
+            profile.report_stacks(stacks, p, text);
+            return ok ? 0 : 1;
+        }
+        if (by_line)
+        {
+            unsigned workers = threads ? threads : std::thread::hardware_concurrency();
+            return run_lines(p, std::cin, workers, cout, cerr, limits) ? 1 : 0;
+        }
+        if (native_dir.empty())
+        {
+            vm_frame frame;
+            return run(p, frame, limits, std::cin, cout) ? 0 : 1;
+        }
+        native_program native;
+        if (!native.load(p, native_dir))
+            return 1;
+        return native.run(std::cin, cout) ? 0 : 1;
+    }
+    if (!socket_path.empty())
+        return serve(socket_path, threads ? threads : std::thread::hardware_concurrency()) ? 0 : 1;
+    if (!files.empty())
+    {
+        unsigned workers = threads ? threads : std::thread::hardware_concurrency();
+        return validate_files(files, workers) ? EXIT_INVALID : 0;
+    }
+    if (validating)
+    {
+        fdstream in(0);
+        return validate(in) ? 0 : EXIT_INVALID;
+    }
+    if (!report_file.empty())
+    {
+        scanner s;
+        basic_parser<scanner, parse_profile> p(s);
+        p.program();
+        cout.flush();
+        p.profile().report(cerr);
+        std::ofstream json(report_file);
+        p.profile().report_json(json);
+        return 0;
+    }
+    if (streaming)
+    {
+        fdstream in(0);
+        parse_stream(in, [](const stmt_ptr &) {});
+        return 0;
+    }
+    if (!cache_dir.empty())
+    {
+        string text((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+        parse_cache cache(0, cache_dir);
+        result_ptr r = cache.parse(text.data(), text.size());
+        cout << r->trace;
+        cerr << r->diagnostics;
+        return 0;
+    }
+    if (!image_file.empty())
+    {
+        string text((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+        memstream in(text.data(), text.data() + text.size());
+        std::ostringstream diag;
+        parser p(in, cout, diag);
+        p.program();
+        cerr << diag.str();
+        std::ostream discard(nullptr); // the parser has reported them
+        std::ofstream o(image_file, std::ios::binary);
+        write_image(o, text, lex(text.data(), text.size(), discard), p.tree(), diag.str());
+        if (!o.flush())
+        {
+            cerr << "cannot write " << image_file << endl;
+            return 1;
+        }
+        return 0;
     }
-
-    void stmt()
-    {
-        if (!contains(FIRST_S, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_S, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_S, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-
-        switch (next_token)
-        {
-        case t_int:
-            cout << "predict stmt --> int id gets expr" << endl;
-            match(t_int);
-            match(t_id);
-            match(t_gets);
-            expr();
-            break;
-        case t_real:
-            cout << "predict stmt --> real id gets expr " << endl;
-            match(t_real);
-            match(t_id);
-            match(t_gets);
-            expr();
-            break;
-        case t_id:
-            cout << "predict stmt --> id gets expr" << endl;
-            match(t_id);
-            match(t_gets);
-            expr();
-            break;
-        case t_read:
-            cout << "predict stmt --> read type id" << endl;
-            match(t_read);
-            type();
-            match(t_id);
-            break;
-        case t_write:
-            cout << "predict stmt --> write expr" << endl;
-            match(t_write);
-            expr();
-            break;
-        case t_if:
-            cout << "predict stmt --> if condition then stmt_list end " << endl;
-            match(t_if);
-            condition();
-            match(t_then);
-            stmt_list();
-            match(t_end);
-            break;
-        case t_while:
-            cout << "predict stmt --> while condition do stmt_list end" << endl;
-            match(t_while);
-            condition();
-            match(t_do);
-            stmt_list();
-            match(t_end);
-            break;
-        default:
-            error();
-            break;
-        }
-    }
-
-    void type()
-    {
-        switch (next_token)
-        {
-        case t_int:
-            cout << "predict type --> int" << endl;
-            match(t_int);
-            break;
-        case t_real:
-            cout << "predict type --> real" << endl;
-            match(t_real);
-            break;
-        case t_id:
-            cout << "predict type --> epsilon" << endl;
-            break; // epsilon production
-        default:
-            break;
-        }
-    }
-
-    void condition()
-    {
-        if (!contains(FIRST_C, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_C, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_C, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-        switch (next_token)
-        {
-        case t_lparen:
-        case t_id:
-        case t_i_num:
-        case t_r_num:
-        case t_float:
-        case t_trunc:
-            cout << "predict condition --> expr ro expr" << endl;
-            expr();
-            ro();
-            expr();
-            break;
-        default:
-            break;
-        }
-    }
-
-    void expr()
-    {
-        if (!contains(FIRST_E, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_E, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_E, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-        switch (next_token)
-        {
-        case t_lparen:
-        case t_id:
-        case t_i_num:
-        case t_r_num:
-        case t_float:
-        case t_trunc:
-            cout << "predict expr --> term term_tail" << endl;
-            term();
-            term_tail();
-            break;
-        default:
-            break;
-        }
-    }
-
-    void term_tail()
-    {
-        if (!contains(FIRST_TT, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_TT, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_TT, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-        switch (next_token)
-        {
-        case t_add:
-        case t_sub:
-            cout << "predict term_tail --> add_op term term_tail" << endl;
-            add_op();
-            term();
-            term_tail();
-            break;
-        case t_rparen:
-        case t_equal:
-        case t_not_equal:
-        case t_greater:
-        case t_less:
-        case t_greater_or_equal:
-        case t_less_or_equal:
-        case t_do:
-        case t_then:
-        case t_semicolon:
-            cout << "predict term_tail --> epsilon" << endl;
-            break; // epsilon production
-        default:
-            break;
-        }
-    }
-
-    void term()
-    {
-        if (!contains(FIRST_T, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_T, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_T, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-        switch (next_token)
-        {
-        case t_lparen:
-        case t_id:
-        case t_i_num:
-        case t_r_num:
-        case t_float:
-        case t_trunc:
-            cout << "predict term --> factor factor_tail" << endl;
-            factor();
-            factor_tail();
-            break;
-        default:
-            break;
-        }
-    }
-
-    void factor_tail()
-    {
-        if (!contains(FIRST_FT, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_FT, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_FT, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-        switch (next_token)
-        {
-        case t_mul:
-        case t_div:
-            cout << "predict factor_tail --> mul_op factor factor_tail"
-                 << endl;
-            mul_op();
-            factor();
-            factor_tail();
-            break;
-        case t_add:
-        case t_sub:
-        case t_semicolon:
-        case t_rparen:
-        case t_equal:
-        case t_not_equal:
-        case t_greater:
-        case t_less:
-        case t_greater_or_equal:
-        case t_less_or_equal:
-        case t_do:
-        case t_then:
-            cout << "predict factor_tail --> epsilon" << endl;
-            break; // epsilon production
-        default:
-            break;
-        }
-    }
-
-    void factor()
-    {
-        if (!contains(FIRST_F, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_F, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_F, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-        switch (next_token)
-        {
-        case t_i_num:
-            cout << "predict factor --> t_i_num" << endl;
-            match(t_i_num);
-            break;
-        case t_r_num:
-            cout << "predict factor --> t_r_num" << endl;
-            match(t_r_num);
-            break;
-        case t_id:
-            cout << "predict factor --> id" << endl;
-            match(t_id);
-            break;
-        case t_lparen:
-            cout << "predict factor --> lparen expr rparen" << endl;
-            match(t_lparen);
-            expr();
-            match(t_rparen);
-            break;
-        case t_trunc:
-            cout << "predict factor --> t_trunc lparen expr rparen" << endl;
-            match(t_trunc);
-            match(t_lparen);
-            expr();
-            match(t_rparen);
-            break;
-        case t_float:
-            cout << "predict factor --> t_float lparen expr rparen" << endl;
-            match(t_float);
-            match(t_lparen);
-            expr();
-            match(t_rparen);
-            break;
-        default:
-            break;
-        }
-    }
-
-    void ro()
-    {
-        if (!contains(FIRST_RO, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_RO, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_RO, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-        switch (next_token)
-        {
-        case t_equal:
-            cout << "predict ro --> equal" << endl;
-            match(t_equal);
-            break;
-        case t_not_equal:
-            cout << "predict ro --> not_equal" << endl;
-            match(t_not_equal);
-            break;
-        case t_less:
-            cout << "predict ro --> less" << endl;
-            match(t_less);
-            break;
-        case t_greater:
-            cout << "predict ro --> greater" << endl;
-            match(t_greater);
-            break;
-        case t_less_or_equal:
-            cout << "predict ro --> less_or_equal" << endl;
-            match(t_less_or_equal);
-            break;
-        case t_greater_or_equal:
-            cout << "predict ro --> greater_or_equal" << endl;
-            match(t_greater_or_equal);
-            break;
-        default:
-            break;
-        }
-    }
-
-    void add_op()
-    {
-        if (!contains(FIRST_AO, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_AO, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_AO, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-        switch (next_token)
-        {
-        case t_add:
-            cout << "predict add_op --> add" << endl;
-            match(t_add);
-            break;
-        case t_sub:
-            cout << "predict add_op --> sub" << endl;
-            match(t_sub);
-            break;
-        default:
-            break;
-        }
-    }
-
-    void mul_op()
-    {
-        if (!contains(FIRST_MO, next_token))
-        {
-            error();
-            while (true)
-            {
-                if (contains(FIRST_MO, next_token))
-                {
-                    break;
-                }
-                else if (contains(FOLLOW_MO, next_token) || next_token == t_eof)
-                {
-                    return;
-                }
-                else
-                    tie(next_token, token_image) = s.scan();
-            }
-        }
-        switch (next_token)
-        {
-        case t_mul:
-            cout << "predict mul_op --> mul" << endl;
-            match(t_mul);
-            break;
-        case t_div:
-            cout << "predict mul_op --> div" << endl;
-            match(t_div);
-            break;
-        default:
-            return;
-        }
+    if (threads || pipelined)
+    {
+        // These modes need the whole program in memory.
+        string text((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+        if (threads)
+            parse_parallel(text.data(), text.size(), threads);
+        else
+            parse_pipelined(text.data(), text.size());
+        return 0;
     }
-}; // parser
-
-int main()
-{
     parser p;
     p.program();
     return 0;
@@ -0,0 +1,828 @@
+/* Recursive descent parser for the calculator language.
+   Builds on figure 2.16 in the text.  Prints a trace of productions
+   predicted and tokens matched, builds a syntax tree (ast.hpp) as it
+   goes, and recovers from syntax errors by skipping to a token in the
+   FIRST or FOLLOW set of the current nonterminal.
+   Michael L. Scott, 2008-2022.
+*/
+
+#ifndef PARSE_HPP
+#define PARSE_HPP
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <tuple>
+#include <vector>
+
+using std::endl;
+using std::string;
+using std::tie;
+
+#include "ast.hpp"
+#include "policy.hpp"
+#include "probe.hpp"
+#include "scan.hpp"
+
+// const char* names[] = {"read", "write", "id", "literal", "gets", "add",
+//                        "sub", "mul", "div", "lparen", "rparen", "eof"};
+
+inline const char *names[] = {"int", "id", "gets", "real", "trunc", "lparen", "rparen", "float",
+                       "read", "write", "if", "then", "end", "while", "do", "i_num", "r_num",
+                       "equal", "noequal", "less", "greater", "less_or_equal", "greater_or_equal",
+                       "add", "sub", "mul", "div", "semi_colon", "eof"};
+
+const std::vector<token> FIRST_P = {t_int, t_real, t_id, t_read, t_write, t_if, t_while, t_trunc, t_float};
+const std::vector<token> FIRST_S = {t_int, t_real, t_id, t_read, t_write, t_if, t_while, t_trunc, t_float};
+const std::vector<token> FIRST_SL = {t_int, t_real, t_id, t_read, t_write, t_if, t_while, t_trunc, t_float};
+const std::vector<token> FIRST_TP = {t_int, t_real};
+const std::vector<token> FIRST_F = {t_lparen, t_id, t_i_num, t_r_num, t_trunc, t_float};
+const std::vector<token> FIRST_T = {t_lparen, t_id, t_i_num, t_r_num, t_trunc, t_float};
+const std::vector<token> FIRST_E = {t_lparen, t_id, t_i_num, t_r_num, t_trunc, t_float};
+const std::vector<token> FIRST_C = {t_lparen, t_id, t_i_num, t_r_num, t_trunc, t_float};
+const std::vector<token> FIRST_AO = {t_add, t_sub};
+const std::vector<token> FIRST_MO = {t_mul, t_div};
+const std::vector<token> FIRST_TT = {t_add, t_sub};
+const std::vector<token> FIRST_FT = {t_mul, t_div};
+const std::vector<token> FIRST_RO = {t_equal, t_not_equal, t_less, t_greater, t_less_or_equal, t_greater_or_equal, t_less_or_equal, t_less_or_equal};
+
+const std::vector<token> FOLLOW_P = {t_eof};
+const std::vector<token> FOLLOW_SL = {t_eof, t_end};
+const std::vector<token> FOLLOW_S = {t_semicolon};
+const std::vector<token> FOLLOW_TP = {t_id};
+const std::vector<token> FOLLOW_C = {t_then, t_do};
+const std::vector<token> FOLLOW_E = {t_rparen, t_equal, t_not_equal, t_less, t_greater, t_less_or_equal, t_greater_or_equal, t_semicolon, t_then, t_do};
+const std::vector<token> FOLLOW_TT = {t_rparen, t_equal, t_not_equal, t_less, t_greater, t_less_or_equal, t_greater_or_equal, t_semicolon, t_then, t_do};
+const std::vector<token> FOLLOW_T = {t_add, t_sub, t_rparen, t_equal, t_not_equal, t_less, t_greater, t_less_or_equal, t_then, t_do, t_greater_or_equal, t_semicolon};
+const std::vector<token> FOLLOW_FT = {
+    t_add,
+    t_sub,
+    t_mul,
+    t_div,
+    t_rparen,
+    t_not_equal,
+    t_less,
+    t_greater,
+    t_equal,
+    t_less_or_equal,
+    t_then,
+    t_do,
+    t_greater_or_equal,
+    t_semicolon,
+};
+const std::vector<token> FOLLOW_F = {t_mul, t_div, t_add, t_sub, t_rparen, t_less, t_greater, t_less_or_equal, t_greater_or_equal, t_semicolon, t_equal, t_not_equal, t_then, t_do};
+const std::vector<token> FOLLOW_RO = {t_lparen, t_id, t_i_num, t_r_num, t_trunc, t_float};
+const std::vector<token> FOLLOW_AO = {t_lparen, t_id, t_i_num, t_r_num, t_trunc, t_float};
+const std::vector<token> FOLLOW_MO = {t_lparen, t_id, t_i_num, t_r_num, t_trunc, t_float};
+
+// How deeply a program may nest, counting each if or while body, each
+// parenthesized expression or conversion, and each operator in a chain
+// such as a + b + c, whose tree is as deep as the chain is long.  The
+// parser, and the code that walks its trees, recurse once a level, at
+// most about 450 bytes of stack each, so this keeps a hostile program
+// from running a thread out of stack.
+const int MAX_DEPTH = 1000;
+
+inline bool contains(const std::vector<token> &tokens, token k)
+{
+    return std::count(tokens.begin(), tokens.end(), k);
+}
+
+// The parser proper, reading tokens from any Source that provides
+// scanner's scan() and errors(), reporting to a Probe (probe.hpp), and
+// tracing, recovering from errors and building a tree as its policies
+// (policy.hpp) say.  A fail_fast parser is driven with program().
+template <class Source, class Probe = no_probe, class Trace = print_trace,
+          class Recovery = skip_recovery, class Build = build_tree>
+class basic_parser
+{
+    token next_token;
+    string token_image;
+    Source &s;
+    std::ostream &out;
+    std::ostream &diag;
+    int syntax_errors = 0;
+    int nesting = 0;           // if and while bodies currently open
+    int depth = 0;             // levels open, as MAX_DEPTH counts them
+    int max_depth = MAX_DEPTH;
+    bool abandoned = false;    // for nesting too deep; the rest is skipped
+    bool top_clean = false;    // last top-level statement's ';' was matched
+    bool cut = false;
+    std::streampos out_cut, diag_cut;
+    std::vector<stmt_ptr> statements;
+    Probe probe;
+    bool stopped = false; // by fail_fast
+
+    struct failure
+    {
+    };
+
+    void advance()
+    {
+        uint64_t start = probe.before_scan();
+        tie(next_token, token_image) = s.scan();
+        probe.scanned(next_token, start);
+        if (!Recovery::recovers && s.errors())
+            throw failure(); // the scanner has reported it
+    }
+
+    void predict(const char *production)
+    {
+        if (!abandoned)
+            Trace::predict(out, production);
+    }
+
+    // Gives up on a program that nests deeper than max_depth.  Without
+    // recovery the parse stops; with it, the rest of the input is skipped,
+    // with no more syntax errors reported and nothing more traced, so that
+    // the parse unwinds at once.
+    void too_deep()
+    {
+        ++syntax_errors;
+        probe.error();
+        diag << "syntax error: nested deeper than " << std::to_string(max_depth) << endl;
+        if (!Recovery::recovers)
+            throw failure();
+        abandoned = true;
+        while (next_token != t_eof)
+            advance();
+    }
+
+    // One level of nesting, open for the life of the object.
+    struct level
+    {
+        basic_parser &p;
+        explicit level(basic_parser &p) : p(p)
+        {
+            if (p.depth == p.max_depth && !p.abandoned)
+                p.too_deep();
+            p.depth++;
+        }
+        ~level()
+        {
+            --p.depth;
+        }
+    };
+
+    void errors()
+    {
+        diag << "syntax error ffffff" << endl;
+        exit(1);
+    }
+
+    void error()
+    {
+        if (abandoned)
+            return;
+        ++syntax_errors;
+        probe.error();
+        if (Recovery::recovers)
+            diag << "syntax error" << endl;
+        else
+        {
+            diag << "syntax error: got " << names[next_token] << endl;
+            throw failure();
+        }
+    }
+
+    // Deals with a next token that is not in first, the FIRST set of the
+    // current nonterminal.  With recovery, reports an error and skips
+    // tokens until one is in first (returning true) or in follow, its
+    // FOLLOW set (returning false).  Without, lets the parse go on if the
+    // nonterminal can be empty and the token can follow it, and stops it
+    // otherwise.
+    bool recover(const std::vector<token> &first, const std::vector<token> &follow,
+                 bool nullable = false)
+    {
+        if (!Recovery::recovers && nullable && contains(follow, next_token))
+            return true;
+        error();
+        while (true)
+        {
+            if (contains(first, next_token))
+                return true;
+            else if (contains(follow, next_token) || next_token == t_eof)
+                return false;
+            else
+                advance();
+        }
+    }
+
+    // The image of the id about to be matched, if that is what comes next.
+    string name() const
+    {
+        return next_token == t_id ? Build::name(token_image) : "";
+    }
+
+    bool match(token expected)
+    {
+        if (next_token == expected)
+        {
+            if (!abandoned)
+                Trace::matched(out, names[next_token]);
+            advance();
+            return true;
+        }
+        else if (abandoned)
+            return false;
+        else
+        {
+            ++syntax_errors;
+            diag << "syntax error: got " << names[next_token] << " expected " << names[expected] << endl;
+            if (!Recovery::recovers)
+                throw failure();
+            return false;
+        }
+    }
+
+public:
+    basic_parser(Source &s, std::ostream &out = std::cout, std::ostream &diag = std::cerr)
+        : s(s), out(out), diag(diag)
+    {
+        try
+        {
+            advance();
+        }
+        catch (failure &)
+        {
+            stopped = true;
+        }
+    }
+
+    // Sets how deeply the program may nest, MAX_DEPTH unless set.  A
+    // parser running on a small stack needs a smaller bound.
+    void limit_depth(int levels)
+    {
+        max_depth = levels;
+    }
+
+    // Whether a fail_fast parser stopped at an error.
+    bool failed() const
+    {
+        return stopped;
+    }
+
+    // Lexical and syntax errors reported so far.
+    int error_count() const
+    {
+        return s.errors() + syntax_errors;
+    }
+
+    // Top-level statements parsed so far.
+    const std::vector<stmt_ptr> &tree() const
+    {
+        return statements;
+    }
+
+    // What the probe has gathered.
+    const Probe &profile() const
+    {
+        return probe;
+    }
+
+    // Takes the top-level statements parsed so far, so that a parse of a
+    // long stream need not keep them all.
+    std::vector<stmt_ptr> release()
+    {
+        std::vector<stmt_ptr> taken;
+        taken.swap(statements);
+        return taken;
+    }
+
+    // Parses a run of top-level statements up to eof, as one slice of a
+    // larger program whose other slices are parsed elsewhere.
+    void slice()
+    {
+        stmt_list(statements);
+    }
+
+    // True if the input ended just after a top-level ';' that was matched
+    // normally.  A parse of the whole program would then have been in the
+    // same state at that point, and the output up to output_cut() and
+    // diagnostic_cut() is what it would have printed so far.
+    bool clean_cut() const
+    {
+        return cut;
+    }
+    std::streampos output_cut() const
+    {
+        return out_cut;
+    }
+    std::streampos diagnostic_cut() const
+    {
+        return diag_cut;
+    }
+
+    // Parses the statements that finish a program, from a point where the
+    // statements before them have already been parsed: the same work
+    // program() does after predicting stmt_list.
+    void rest()
+    {
+        stmt_list(statements);
+        match(t_eof);
+    }
+
+    void program()
+    {
+        typename Probe::scope enter(probe, m_program);
+        if (stopped)
+            return;
+        try
+        {
+            if (start_program())
+            {
+                stmt_list(statements);
+                match(t_eof);
+            }
+        }
+        catch (failure &)
+        {
+            stopped = true;
+        }
+    }
+
+    // program() one statement at a time: start_program(), then
+    // next_statement() until it returns false, then finish_program().
+    // start_program() returns false if program() would stop at once.
+    bool start_program()
+    {
+        // The text skips to FIRST(type) here, not FIRST(program).
+        if (!contains(FIRST_P, next_token) && !recover(FIRST_TP, FOLLOW_P, true))
+            return false;
+        switch (next_token)
+        {
+        case t_int:
+        case t_real:
+        case t_id:
+        case t_read:
+        case t_write:
+        case t_if:
+        case t_while:
+        case t_eof:
+            predict("program --> stmt_list eof");
+            return true;
+        default:
+            // trunc and float are in FIRST_P, as in the text, but no
+            // statement starts with either.
+            error();
+            return false;
+        }
+    }
+
+    bool next_statement()
+    {
+        return stmt_list_item(statements);
+    }
+
+    void finish_program()
+    {
+        match(t_eof);
+    }
+
+    // Whether the statement just parsed by next_statement() ended with its
+    // ';' matched, which leaves the parser in the state a fresh one would
+    // be in at position(), the offset of the next token.
+    bool clean_statement() const
+    {
+        return top_clean;
+    }
+    size_t position() const
+    {
+        return s.token_start();
+    }
+
+private:
+    void stmt_list(std::vector<stmt_ptr> &list)
+    {
+        while (stmt_list_item(list))
+            ;
+    }
+
+    // One step of stmt_list --> stmt ; stmt_list, parsing a statement onto
+    // list.  Returns true if stmt_list goes on to a further step.
+    bool stmt_list_item(std::vector<stmt_ptr> &list)
+    {
+        typename Probe::scope enter(probe, m_stmt_list);
+
+        if (!contains(FIRST_SL, next_token) && !recover(FIRST_SL, FOLLOW_SL, true))
+            return false;
+
+        switch (next_token)
+        {
+        case t_int:
+        case t_real:
+        case t_id:
+        case t_read:
+        case t_write:
+        case t_if:
+        case t_while:
+            predict("stmt_list --> stmt ; stmt_list");
+            if (stmt_ptr st = stmt())
+                list.push_back(st);
+            top_clean = match(t_semicolon) && nesting == 0;
+            if (top_clean && next_token == t_eof)
+            {
+                cut = true;
+                out_cut = out.tellp();
+                diag_cut = diag.tellp();
+            }
+            return true;
+        case t_end:
+        case t_eof:
+            predict("stmt_list --> epsilon");
+            return false; // epsilon production
+        default:
+            error();
+            return false;
+        }
+    }
+
+    stmt_ptr stmt()
+    {
+        typename Probe::scope enter(probe, m_stmt);
+        level nest(*this);
+        if (!contains(FIRST_S, next_token) && !recover(FIRST_S, FOLLOW_S))
+            return nullptr;
+
+        stmt_node st;
+        st.kind = next_token;
+        st.offset = s.token_start();
+        switch (next_token)
+        {
+        case t_int:
+            predict("stmt --> int id gets expr");
+            match(t_int);
+            st.id = name();
+            match(t_id);
+            match(t_gets);
+            st.value = expr();
+            break;
+        case t_real:
+            predict("stmt --> real id gets expr ");
+            match(t_real);
+            st.id = name();
+            match(t_id);
+            match(t_gets);
+            st.value = expr();
+            break;
+        case t_id:
+            predict("stmt --> id gets expr");
+            st.id = name();
+            match(t_id);
+            match(t_gets);
+            st.value = expr();
+            break;
+        case t_read:
+            predict("stmt --> read type id");
+            match(t_read);
+            st.type = type();
+            st.id = name();
+            match(t_id);
+            break;
+        case t_write:
+            predict("stmt --> write expr");
+            match(t_write);
+            st.value = expr();
+            break;
+        case t_if:
+            predict("stmt --> if condition then stmt_list end ");
+            match(t_if);
+            st.cond = condition();
+            match(t_then);
+            nesting++;
+            stmt_list(st.body);
+            nesting--;
+            match(t_end);
+            break;
+        case t_while:
+            predict("stmt --> while condition do stmt_list end");
+            match(t_while);
+            st.cond = condition();
+            match(t_do);
+            nesting++;
+            stmt_list(st.body);
+            nesting--;
+            match(t_end);
+            break;
+        default:
+            error();
+            return nullptr;
+        }
+        return Build::statement(std::move(st));
+    }
+
+    token type()
+    {
+        typename Probe::scope enter(probe, m_type);
+        switch (next_token)
+        {
+        case t_int:
+            predict("type --> int");
+            match(t_int);
+            return t_int;
+        case t_real:
+            predict("type --> real");
+            match(t_real);
+            return t_real;
+        case t_id:
+            predict("type --> epsilon");
+            return t_id; // epsilon production
+        default:
+            return t_id;
+        }
+    }
+
+    cond_node condition()
+    {
+        typename Probe::scope enter(probe, m_condition);
+        cond_node c;
+        if (!contains(FIRST_C, next_token) && !recover(FIRST_C, FOLLOW_C))
+            return c;
+        switch (next_token)
+        {
+        case t_lparen:
+        case t_id:
+        case t_i_num:
+        case t_r_num:
+        case t_float:
+        case t_trunc:
+            predict("condition --> expr ro expr");
+            c.left = expr();
+            c.rel = ro();
+            c.right = expr();
+            break;
+        default:
+            break;
+        }
+        return c;
+    }
+
+    expr_ptr expr()
+    {
+        typename Probe::scope enter(probe, m_expr);
+        level nest(*this);
+        if (!contains(FIRST_E, next_token) && !recover(FIRST_E, FOLLOW_E))
+            return nullptr;
+        switch (next_token)
+        {
+        case t_lparen:
+        case t_id:
+        case t_i_num:
+        case t_r_num:
+        case t_float:
+        case t_trunc:
+            predict("expr --> term term_tail");
+            return term_tail(term());
+        default:
+            return nullptr;
+        }
+    }
+
+    expr_ptr term_tail(expr_ptr left)
+    {
+        typename Probe::scope enter(probe, m_term_tail);
+        level nest(*this);
+        if (!contains(FIRST_TT, next_token) && !recover(FIRST_TT, FOLLOW_TT, true))
+            return left;
+        switch (next_token)
+        {
+        case t_add:
+        case t_sub:
+            predict("term_tail --> add_op term term_tail");
+            {
+                token op = add_op();
+                expr_ptr right = term();
+                return term_tail(Build::binary(op, left, right));
+            }
+        case t_rparen:
+        case t_equal:
+        case t_not_equal:
+        case t_greater:
+        case t_less:
+        case t_greater_or_equal:
+        case t_less_or_equal:
+        case t_do:
+        case t_then:
+        case t_semicolon:
+            predict("term_tail --> epsilon");
+            break; // epsilon production
+        default:
+            break;
+        }
+        return left;
+    }
+
+    expr_ptr term()
+    {
+        typename Probe::scope enter(probe, m_term);
+        if (!contains(FIRST_T, next_token) && !recover(FIRST_T, FOLLOW_T))
+            return nullptr;
+        switch (next_token)
+        {
+        case t_lparen:
+        case t_id:
+        case t_i_num:
+        case t_r_num:
+        case t_float:
+        case t_trunc:
+            predict("term --> factor factor_tail");
+            return factor_tail(factor());
+        default:
+            return nullptr;
+        }
+    }
+
+    expr_ptr factor_tail(expr_ptr left)
+    {
+        typename Probe::scope enter(probe, m_factor_tail);
+        level nest(*this);
+        if (!contains(FIRST_FT, next_token) && !recover(FIRST_FT, FOLLOW_FT, true))
+            return left;
+        switch (next_token)
+        {
+        case t_mul:
+        case t_div:
+            predict("factor_tail --> mul_op factor factor_tail");
+            {
+                token op = mul_op();
+                expr_ptr right = factor();
+                return factor_tail(Build::binary(op, left, right));
+            }
+        case t_add:
+        case t_sub:
+        case t_semicolon:
+        case t_rparen:
+        case t_equal:
+        case t_not_equal:
+        case t_greater:
+        case t_less:
+        case t_greater_or_equal:
+        case t_less_or_equal:
+        case t_do:
+        case t_then:
+            predict("factor_tail --> epsilon");
+            break; // epsilon production
+        default:
+            break;
+        }
+        return left;
+    }
+
+    expr_ptr factor()
+    {
+        typename Probe::scope enter(probe, m_factor);
+        if (!contains(FIRST_F, next_token) && !recover(FIRST_F, FOLLOW_F))
+            return nullptr;
+        switch (next_token)
+        {
+        case t_i_num:
+            predict("factor --> t_i_num");
+            {
+                expr_ptr leaf = Build::leaf(t_i_num, token_image);
+                match(t_i_num);
+                return leaf;
+            }
+        case t_r_num:
+            predict("factor --> t_r_num");
+            {
+                expr_ptr leaf = Build::leaf(t_r_num, token_image);
+                match(t_r_num);
+                return leaf;
+            }
+        case t_id:
+            predict("factor --> id");
+            {
+                expr_ptr leaf = Build::leaf(t_id, token_image);
+                match(t_id);
+                return leaf;
+            }
+        case t_lparen:
+            predict("factor --> lparen expr rparen");
+            {
+                match(t_lparen);
+                expr_ptr e = expr();
+                match(t_rparen);
+                return e;
+            }
+        case t_trunc:
+            predict("factor --> t_trunc lparen expr rparen");
+            {
+                match(t_trunc);
+                match(t_lparen);
+                expr_ptr e = expr();
+                match(t_rparen);
+                return Build::unary(t_trunc, e);
+            }
+        case t_float:
+            predict("factor --> t_float lparen expr rparen");
+            {
+                match(t_float);
+                match(t_lparen);
+                expr_ptr e = expr();
+                match(t_rparen);
+                return Build::unary(t_float, e);
+            }
+        default:
+            return nullptr;
+        }
+    }
+
+    token ro()
+    {
+        typename Probe::scope enter(probe, m_ro);
+        if (!contains(FIRST_RO, next_token) && !recover(FIRST_RO, FOLLOW_RO))
+            return t_eof;
+        switch (next_token)
+        {
+        case t_equal:
+            predict("ro --> equal");
+            match(t_equal);
+            return t_equal;
+        case t_not_equal:
+            predict("ro --> not_equal");
+            match(t_not_equal);
+            return t_not_equal;
+        case t_less:
+            predict("ro --> less");
+            match(t_less);
+            return t_less;
+        case t_greater:
+            predict("ro --> greater");
+            match(t_greater);
+            return t_greater;
+        case t_less_or_equal:
+            predict("ro --> less_or_equal");
+            match(t_less_or_equal);
+            return t_less_or_equal;
+        case t_greater_or_equal:
+            predict("ro --> greater_or_equal");
+            match(t_greater_or_equal);
+            return t_greater_or_equal;
+        default:
+            return t_eof;
+        }
+    }
+
+    token add_op()
+    {
+        typename Probe::scope enter(probe, m_add_op);
+        if (!contains(FIRST_AO, next_token) && !recover(FIRST_AO, FOLLOW_AO))
+            return t_eof;
+        switch (next_token)
+        {
+        case t_add:
+            predict("add_op --> add");
+            match(t_add);
+            return t_add;
+        case t_sub:
+            predict("add_op --> sub");
+            match(t_sub);
+            return t_sub;
+        default:
+            return t_eof;
+        }
+    }
+
+    token mul_op()
+    {
+        typename Probe::scope enter(probe, m_mul_op);
+        if (!contains(FIRST_MO, next_token) && !recover(FIRST_MO, FOLLOW_MO))
+            return t_eof;
+        switch (next_token)
+        {
+        case t_mul:
+            predict("mul_op --> mul");
+            match(t_mul);
+            return t_mul;
+        case t_div:
+            predict("mul_op --> div");
+            match(t_div);
+            return t_div;
+        default:
+            return t_eof;
+        }
+    }
+}; // basic_parser
+
+// Holds the scanner for a parser, so it is built before the parser uses it.
+struct scanner_holder
+{
+    scanner own;
+    scanner_holder(std::istream &in, std::ostream &diag) : own(in, diag) {}
+};
+
+// A parser that runs its own scanner over an istream.
+class parser : private scanner_holder, public basic_parser<scanner>
+{
+public:
+    parser(std::istream &in = std::cin, std::ostream &out = std::cout,
+           std::ostream &diag = std::cerr)
+        : scanner_holder(in, diag), basic_parser<scanner>(own, out, diag) {}
+};
+
+// A parser that only checks that a program is valid: it prints no trace,
+// builds no tree, and stops at the first error, which it reports.
+template <class Source>
+using validator = basic_parser<Source, no_probe, no_trace, fail_fast, no_tree>;
+
+#endif
@@ -29,9 +29,9 @@ const char *names[] = {"int", "id", "gets", "real", "trunc", "lparen", "rparen",
                        "equal", "noequal", "less", "greater", "less_or_equal", "greater_or_equal",
                        "add", "sub", "mul", "div", "semi_colon", "eof"};
 
-const std::vector<token> FIRST_P = {t_int, t_real, t_id, t_read, t_write, t_if, t_while, t_trunc, t_float};
-const std::vector<token> FIRST_S = {t_int, t_real, t_id, t_read, t_write, t_if, t_while, t_trunc, t_float};
-const std::vector<token> FIRST_SL = {t_int, t_real, t_id, t_read, t_write, t_if, t_while, t_trunc, t_float};
+const std::vector<token> FIRST_P = {t_int, t_real, t_id, t_read, t_write, t_if, t_while};
+const std::vector<token> FIRST_S = {t_int, t_real, t_id, t_read, t_write, t_if, t_while};
+const std::vector<token> FIRST_SL = {t_int, t_real, t_id, t_read, t_write, t_if, t_while};
 const std::vector<token> FIRST_TP = {t_int, t_real};
 const std::vector<token> FIRST_F = {t_lparen, t_id, t_i_num, t_r_num};
 const std::vector<token> FIRST_T = {t_lparen, t_id, t_i_num, t_r_num};
@@ -68,6 +68,27 @@ class parser
     token next_token;
     string token_image;
     scanner s;
+    int depth = 0; // levels open, counted as parse.hpp's MAX_DEPTH counts them
+
+    // One level of nesting, open for the life of the object.  A program
+    // nested deeper than parse.hpp allows is given up on, rather than left
+    // to run the stack out.
+    struct level
+    {
+        parser &p;
+        explicit level(parser &p) : p(p)
+        {
+            if (p.depth++ == 1000)
+            {
+                cerr << "syntax error: nested deeper than 1000" << endl;
+                exit(1);
+            }
+        }
+        ~level()
+        {
+            --p.depth;
+        }
+    };
 
     void errors()
     {
@@ -176,6 +197,7 @@ private:
 
     void stmt()
     {
+        level nest(*this);
         switch (next_token)
         {
         case t_int:
@@ -315,6 +337,7 @@ private:
 
     void expr()
     {
+        level nest(*this);
         switch (next_token)
         {
         case t_lparen:
@@ -348,6 +371,7 @@ private:
 
     void term_tail()
     {
+        level nest(*this);
         switch (next_token)
         {
         case t_add:
@@ -422,6 +446,7 @@ private:
 
     void factor_tail()
     {
+        level nest(*this);
         switch (next_token)
         {
         case t_mul:
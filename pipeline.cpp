@@ -0,0 +1,82 @@
+/* Scanner/parser pipelining.
+*/
+
+#include <sstream>
+
+#include "parse.hpp"
+#include "pipeline.hpp"
+
+using std::get;
+using std::make_tuple;
+
+pipelined_scanner::pipelined_scanner(const char *buf, size_t len, std::ostream &diag)
+    : buf(buf), diag(diag), producer(&pipelined_scanner::produce, this, len)
+{
+}
+
+pipelined_scanner::~pipelined_scanner()
+{
+    // The parser may stop before eof; don't leave the producer waiting
+    // for room in the ring.
+    stop = true;
+    producer.join();
+}
+
+void pipelined_scanner::produce(size_t len)
+{
+    memstream in(buf, buf + len);
+    std::ostringstream d;
+    scanner s(in, d);
+    for (size_t index = 0;; index++)
+    {
+        int before = s.errors();
+        token t = get<0>(s.scan());
+        if (s.errors() != before)
+        {
+            std::lock_guard<std::mutex> hold(pending_lock);
+            pending.push_back({index, s.errors() - before, d.str()});
+            d.str("");
+            posted.fetch_add(1, std::memory_order_release);
+        }
+        lexeme l = {t, uint32_t(s.token_start()), uint32_t(s.token_end() - s.token_start())};
+        while (!ring.try_push(l))
+        {
+            if (stop)
+                return;
+            std::this_thread::yield();
+        }
+        if (t == t_eof)
+            return;
+    }
+}
+
+tuple<token, string> pipelined_scanner::scan()
+{
+    if (done)
+        return make_tuple(t_eof, "");
+    lexeme l;
+    while (!ring.try_pop(l))
+        std::this_thread::yield();
+    if (posted.load(std::memory_order_acquire) != printed)
+    {
+        std::lock_guard<std::mutex> hold(pending_lock);
+        while (!pending.empty() && pending.front().index <= consumed)
+        {
+            diag << pending.front().text;
+            lex_errors += pending.front().count;
+            pending.pop_front();
+            printed++;
+        }
+    }
+    consumed++;
+    start = l.offset;
+    done = l.kind == t_eof;
+    return make_tuple(l.kind, image(buf, l));
+}
+
+void parse_pipelined(const char *buf, size_t len, std::ostream &out, std::ostream &diag)
+{
+    pipelined_scanner s(buf, len, diag);
+    basic_parser<pipelined_scanner> p(s, out, diag);
+    p.program();
+}
@@ -0,0 +1,111 @@
+/* Scanner/parser pipelining.  A producer thread scans the input into a
+   single-producer/single-consumer ring of lexemes while the parser
+   consumes them on the calling thread, so that scanning and parsing
+   overlap on two cores.
+*/
+
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "lex.hpp"
+
+// A bounded lock-free queue for one producer and one consumer thread.
+// Each side keeps a copy of the other's index and rereads the shared one
+// only when the queue looks full or empty, so the cache lines holding the
+// indices change hands about once per batch rather than once per element.
+template <class T, size_t N>
+class spsc_ring
+{
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+    alignas(64) std::atomic<size_t> head{0}; // next slot to read
+    size_t tail_seen = 0;                    // consumer's copy of tail
+    alignas(64) std::atomic<size_t> tail{0}; // next slot to write
+    size_t head_seen = 0;                    // producer's copy of head
+    alignas(64) T slots[N];
+
+public:
+    bool try_push(const T &v)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head_seen == N)
+        {
+            head_seen = head.load(std::memory_order_acquire);
+            if (t - head_seen == N)
+                return false;
+        }
+        slots[t & (N - 1)] = v;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &v)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail_seen)
+        {
+            tail_seen = tail.load(std::memory_order_acquire);
+            if (h == tail_seen)
+                return false;
+        }
+        v = slots[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// A token source for basic_parser that scans buf[0..len) on a thread of
+// its own.  Lexical errors travel beside the ring and are printed to diag
+// just before the token whose scan reported them is handed out, which is
+// when scanner::scan() would have printed them.
+class pipelined_scanner
+{
+    struct lex_error
+    {
+        size_t index; // of the token whose scan reported it
+        int count;
+        string text;
+    };
+
+    const char *buf;
+    std::ostream &diag;
+    spsc_ring<lexeme, 4096> ring;
+    std::atomic<bool> stop{false};
+    std::mutex pending_lock;
+    std::deque<lex_error> pending;
+    std::atomic<size_t> posted{0};
+    size_t printed = 0;
+    size_t consumed = 0;
+    size_t start = 0; // of the token last scanned
+    bool done = false;
+    int lex_errors = 0;
+    std::thread producer;
+
+    void produce(size_t len);
+
+public:
+    pipelined_scanner(const char *buf, size_t len, std::ostream &diag = std::cerr);
+    ~pipelined_scanner();
+    tuple<token, string> scan();
+    size_t token_start() const
+    {
+        return start;
+    }
+    int errors() const
+    {
+        return lex_errors;
+    }
+};
+
+// Parses the program in buf[0..len) as parser::program() would, with the
+// scanning done on a second thread.
+void parse_pipelined(const char *buf, size_t len, std::ostream &out = std::cout,
+                     std::ostream &diag = std::cerr);
+
+#endif
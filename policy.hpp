@@ -0,0 +1,104 @@
+/* Policies for basic_parser, chosen at compile time, for what it does
+   besides recognizing the language:
+     Trace     print_trace prints the productions predicted and the
+               tokens matched; no_trace prints nothing.
+     Recovery  skip_recovery reports a syntax error and skips to a token
+               in the FIRST or FOLLOW set of the current nonterminal;
+               fail_fast reports the first error and stops.
+     Build     build_tree builds the syntax tree (ast.hpp); no_tree
+               builds nothing.
+   The defaults are the teaching parser's.  no_trace, fail_fast and
+   no_tree together make a validator that does nothing but recognize.
+*/
+
+#ifndef POLICY_HPP
+#define POLICY_HPP
+
+#include <iostream>
+#include <string>
+
+#include "ast.hpp"
+
+struct print_trace
+{
+    static void predict(std::ostream &o, const char *production)
+    {
+        o << "predict " << production << std::endl;
+    }
+    static void matched(std::ostream &o, const char *name)
+    {
+        o << "matched " << name << std::endl;
+    }
+};
+
+struct no_trace
+{
+    static void predict(std::ostream &, const char *) {}
+    static void matched(std::ostream &, const char *) {}
+};
+
+struct skip_recovery
+{
+    static const bool recovers = true;
+};
+
+// With fail_fast, the parser stops at the first lexical or syntax error,
+// or at the first token that can neither start the current nonterminal
+// nor, if it can be empty, follow it, trunc or float at the start of a
+// program included.  Unlike skip_recovery it does not report an error
+// where a nullable nonterminal is followed by a token in its FOLLOW set,
+// so it accepts exactly the valid programs (bench/policy checks both).
+struct fail_fast
+{
+    static const bool recovers = false;
+};
+
+struct build_tree
+{
+    static string name(const string &image)
+    {
+        return image;
+    }
+    static expr_ptr leaf(token op, const string &text)
+    {
+        return make_leaf(op, text);
+    }
+    static expr_ptr binary(token op, expr_ptr left, expr_ptr right)
+    {
+        return make_binary(op, std::move(left), std::move(right));
+    }
+    static expr_ptr unary(token op, expr_ptr operand)
+    {
+        return make_unary(op, std::move(operand));
+    }
+    static stmt_ptr statement(stmt_node &&s)
+    {
+        return std::make_shared<const stmt_node>(std::move(s));
+    }
+};
+
+struct no_tree
+{
+    static string name(const string &)
+    {
+        return string();
+    }
+    static expr_ptr leaf(token, const string &)
+    {
+        return nullptr;
+    }
+    static expr_ptr binary(token, const expr_ptr &, const expr_ptr &)
+    {
+        return nullptr;
+    }
+    static expr_ptr unary(token, const expr_ptr &)
+    {
+        return nullptr;
+    }
+    static stmt_ptr statement(const stmt_node &)
+    {
+        return nullptr;
+    }
+};
+
+#endif
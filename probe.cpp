@@ -0,0 +1,70 @@
+/* Reports from parser instrumentation.
+*/
+
+#include <iomanip>
+
+#include "parse.hpp"
+#include "probe.hpp"
+
+const char *const method_names[N_METHODS] = {"program", "stmt_list", "stmt", "type", "condition",
+                                             "expr", "term_tail", "term", "factor_tail", "factor",
+                                             "ro", "add_op", "mul_op"};
+
+void parse_profile::report(std::ostream &o) const
+{
+    std::ios::fmtflags flags = o.flags();
+    o << std::dec;
+    uint64_t total = 0;
+    for (auto &m : methods)
+        total += m.self_cycles;
+    o << std::left << std::setw(14) << "method" << std::right << std::setw(12) << "calls"
+      << std::setw(12) << "tokens" << std::setw(8) << "errors" << std::setw(16) << "cycles"
+      << std::setw(16) << "self cycles" << std::setw(8) << "self%" << '\n';
+    for (int i = 0; i < N_METHODS; i++)
+    {
+        const method_stats &m = methods[i];
+        o << std::left << std::setw(14) << method_names[i] << std::right << std::setw(12) << m.calls
+          << std::setw(12) << m.tokens << std::setw(8) << m.errors << std::setw(16) << m.cycles
+          << std::setw(16) << m.self_cycles << std::setw(7) << std::fixed << std::setprecision(1)
+          << (total ? 100.0 * m.self_cycles / total : 0) << "%\n";
+    }
+    o << '\n' << std::left << std::setw(18) << "token" << std::right << std::setw(12) << "count"
+      << std::setw(16) << "scan cycles" << std::setw(12) << "per token" << '\n';
+    for (int t = 0; t <= t_eof; t++)
+    {
+        const token_stats &k = kinds[t];
+        if (!k.count)
+            continue;
+        o << std::left << std::setw(18) << names[t] << std::right << std::setw(12) << k.count
+          << std::setw(16) << k.cycles << std::setw(12) << std::setprecision(1)
+          << double(k.cycles) / k.count << '\n';
+    }
+    o.flags(flags);
+}
+
+void parse_profile::report_json(std::ostream &o) const
+{
+    std::ios::fmtflags flags = o.flags();
+    o << std::dec;
+    o << "{\n  \"methods\": {";
+    for (int i = 0; i < N_METHODS; i++)
+    {
+        const method_stats &m = methods[i];
+        o << (i ? "," : "") << "\n    \"" << method_names[i] << "\": {\"calls\": " << m.calls
+          << ", \"tokens\": " << m.tokens << ", \"errors\": " << m.errors << ", \"cycles\": "
+          << m.cycles << ", \"self_cycles\": " << m.self_cycles << "}";
+    }
+    o << "\n  },\n  \"tokens\": {";
+    bool first = true;
+    for (int t = 0; t <= t_eof; t++)
+    {
+        const token_stats &k = kinds[t];
+        if (!k.count)
+            continue;
+        o << (first ? "" : ",") << "\n    \"" << names[t] << "\": {\"count\": " << k.count
+          << ", \"cycles\": " << k.cycles << "}";
+        first = false;
+    }
+    o << "\n  }\n}\n";
+    o.flags(flags);
+}
@@ -0,0 +1,136 @@
+/* Instrumentation for the parser, chosen at compile time.
+   basic_parser takes a Probe type, which it tells when each parsing
+   routine is entered and left, when a token is scanned, and when it
+   reports a syntax error.  The default, no_probe, does nothing, and its
+   calls inline away; parse_profile counts calls, tokens, errors and
+   cycles per routine, and tokens and cycles per token kind.
+*/
+
+#ifndef PROBE_HPP
+#define PROBE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+#include "scan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// The parsing routines a probe can tell apart.
+enum parse_method {m_program, m_stmt_list, m_stmt, m_type, m_condition, m_expr, m_term_tail,
+                   m_term, m_factor_tail, m_factor, m_ro, m_add_op, m_mul_op, N_METHODS};
+
+extern const char *const method_names[N_METHODS];
+
+// A timestamp in cycles where there is a cycle counter to read, and in
+// nanoseconds elsewhere.
+inline uint64_t cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+class no_probe
+{
+public:
+    // Lives for the length of a call to a parsing routine.
+    struct scope
+    {
+        scope(no_probe &, parse_method) {}
+    };
+    uint64_t before_scan()
+    {
+        return 0;
+    }
+    void scanned(token, uint64_t) {}
+    void error() {}
+};
+
+class parse_profile
+{
+public:
+    struct method_stats
+    {
+        uint64_t calls = 0;
+        uint64_t tokens = 0;      // scanned during the call, including by callees
+        uint64_t errors = 0;      // syntax errors reported by the routine itself
+        uint64_t cycles = 0;      // including callees
+        uint64_t self_cycles = 0; // not counting callees
+    };
+    struct token_stats
+    {
+        uint64_t count = 0;
+        uint64_t cycles = 0; // in the scanner
+    };
+
+    class scope
+    {
+        parse_profile &p;
+        parse_method outer;
+        uint64_t start, outer_child, tokens;
+
+    public:
+        scope(parse_profile &p, parse_method m)
+            : p(p), outer(p.current), outer_child(p.child), tokens(p.total_tokens)
+        {
+            p.methods[m].calls++;
+            p.current = m;
+            p.child = 0;
+            start = cycles();
+        }
+        ~scope()
+        {
+            uint64_t spent = cycles() - start;
+            method_stats &m = p.methods[p.current];
+            m.cycles += spent;
+            m.self_cycles += spent - p.child;
+            m.tokens += p.total_tokens - tokens;
+            p.current = outer;
+            p.child = outer_child + spent;
+        }
+    };
+
+    uint64_t before_scan()
+    {
+        return cycles();
+    }
+    void scanned(token t, uint64_t start)
+    {
+        token_stats &k = kinds[t];
+        k.count++;
+        k.cycles += cycles() - start;
+        total_tokens++;
+    }
+    void error()
+    {
+        methods[current].errors++;
+    }
+
+    const method_stats &method(parse_method m) const
+    {
+        return methods[m];
+    }
+    const token_stats &kind(token t) const
+    {
+        return kinds[t];
+    }
+
+    void report(std::ostream &o) const;
+    void report_json(std::ostream &o) const;
+
+private:
+    method_stats methods[N_METHODS];
+    token_stats kinds[t_eof + 1];
+    parse_method current = m_program;
+    uint64_t child = 0; // cycles spent in callees of the current routine
+    uint64_t total_tokens = 0;
+};
+
+#endif
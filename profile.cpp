@@ -0,0 +1,120 @@
+/* Reports from profiles of runs on the VM.
+*/
+
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+
+#include "profile.hpp"
+
+namespace
+{
+
+// The line of text, counting from 1, that offset is on.
+size_t line_of(const std::string &text, size_t offset)
+{
+    offset = std::min(offset, text.size());
+    return 1 + std::count(text.begin(), text.begin() + offset, '\n');
+}
+
+// A statement as the reports name it: where it is and what it does.
+std::string label(const ir_statement &s, const std::string &text)
+{
+    std::string what;
+    switch (s.kind)
+    {
+    case t_int:
+        what = "int " + s.id;
+        break;
+    case t_real:
+        what = "real " + s.id;
+        break;
+    case t_id:
+        what = s.id + " :=";
+        break;
+    case t_read:
+        what = "read " + s.id;
+        break;
+    case t_write:
+        what = "write";
+        break;
+    case t_if:
+        what = "if";
+        break;
+    case t_while:
+        what = "while";
+        break;
+    default:
+        what = "?";
+    }
+    return "line " + std::to_string(line_of(text, s.offset)) + ": " + what;
+}
+
+} // namespace
+
+std::vector<run_profile::statement_stats> run_profile::statements(const vm_program &p) const
+{
+    std::vector<statement_stats> stats(p.statements.size());
+    for (size_t at = 0; at < p.code.size(); at++)
+    {
+        if (p.origin[at] < 0)
+            continue;
+        statement_stats &s = stats[p.origin[at]];
+        s.runs = std::max(s.runs, counts[at]);
+        s.instructions += counts[at];
+    }
+    for (size_t k = 0; k < stats.size(); k++)
+        stats[k].self_cycles = spent[k + 1];
+    // Nested statements come after those they are in.
+    for (size_t k = stats.size(); k-- > 0;)
+    {
+        stats[k].cycles += stats[k].self_cycles;
+        if (p.statements[k].parent >= 0)
+            stats[p.statements[k].parent].cycles += stats[k].cycles;
+    }
+    return stats;
+}
+
+void run_profile::report(std::ostream &o, const vm_program &p, const std::string &text) const
+{
+    std::ios::fmtflags flags = o.flags();
+    o << std::dec;
+    std::vector<statement_stats> stats = statements(p);
+    uint64_t total = std::accumulate(spent.begin(), spent.end(), uint64_t(0));
+    std::vector<size_t> order;
+    for (size_t k = 0; k < stats.size(); k++)
+        if (stats[k].instructions)
+            order.push_back(k);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return stats[a].cycles > stats[b].cycles; });
+    o << std::left << std::setw(28) << "statement" << std::right << std::setw(12) << "runs"
+      << std::setw(14) << "instructions" << std::setw(16) << "cycles" << std::setw(8) << "%"
+      << std::setw(16) << "self cycles" << std::setw(8) << "self%" << '\n';
+    for (size_t k : order)
+    {
+        const statement_stats &s = stats[k];
+        o << std::left << std::setw(28) << label(p.statements[k], text) << std::right
+          << std::setw(12) << s.runs << std::setw(14) << s.instructions << std::setw(16) << s.cycles
+          << std::setw(7) << std::fixed << std::setprecision(1)
+          << (total ? 100.0 * s.cycles / total : 0) << '%' << std::setw(16) << s.self_cycles
+          << std::setw(7) << (total ? 100.0 * s.self_cycles / total : 0) << "%\n";
+    }
+    o.flags(flags);
+}
+
+void run_profile::report_stacks(std::ostream &o, const vm_program &p, const std::string &text) const
+{
+    std::ios::fmtflags flags = o.flags();
+    o << std::dec;
+    std::vector<statement_stats> stats = statements(p);
+    std::vector<std::string> stacks(stats.size());
+    for (size_t k = 0; k < stats.size(); k++)
+    {
+        int parent = p.statements[k].parent;
+        stacks[k] = (parent >= 0 ? stacks[parent] + ';' : std::string()) +
+                    label(p.statements[k], text);
+        if (stats[k].self_cycles)
+            o << stacks[k] << ' ' << stats[k].self_cycles << '\n';
+    }
+    o.flags(flags);
+}
@@ -0,0 +1,108 @@
+/* Profiling calculator programs as they run on the VM (vm.hpp), by
+   statement of the source.  The VM's loop takes a probe, as the parser
+   does (probe.hpp); a plain run() has one that does nothing, so that
+   only a run given a run_profile pays for it.  The profile counts each
+   instruction run, and charges each statement of the source the cycles
+   spent in the instructions lowered from it.
+
+   An if or a while owns its condition and the jumps around its body, so
+   what a statement costs on its own leaves out the statements nested in
+   it; its total counts them in.  The optimizer may move code out of a
+   loop or merge that of two statements, and the code then counts for
+   the statement it was first built for.
+*/
+
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "probe.hpp"
+#include "vm.hpp"
+
+class run_profile
+{
+public:
+    struct statement_stats
+    {
+        uint64_t runs = 0;         // how many times it ran; for a while,
+                                   // how many times its condition was tested
+        uint64_t instructions = 0; // its own, not counting nested statements
+        uint64_t self_cycles = 0;  // likewise
+        uint64_t cycles = 0;       // including nested statements
+    };
+
+    // Clears the counts, sized for p.
+    void reset(const vm_program &p)
+    {
+        origin = p.origin.data();
+        counts.assign(p.code.size(), 0);
+        spent.assign(p.statements.size() + 1, 0);
+        current = -1;
+    }
+
+    // The cycles counter is read only where control passes from one
+    // statement's code to another's.
+    void start()
+    {
+        then = cycles();
+    }
+    void step(uint32_t at)
+    {
+        counts[at]++;
+        if (origin[at] != current)
+            charge(origin[at]);
+    }
+    void stop()
+    {
+        charge(-1);
+    }
+
+    // How many times the instruction at at in the code was run.
+    uint64_t count(size_t at) const
+    {
+        return counts[at];
+    }
+
+    // The counts gathered up by statement of p, which must be the program
+    // that was run.
+    std::vector<statement_stats> statements(const vm_program &p) const;
+
+    // Prints the statements that ran, the costliest first, with their
+    // lines in text, the source of p.
+    void report(std::ostream &o, const vm_program &p, const std::string &text) const;
+
+    // Writes the cycles spent in each statement in the collapsed-stack
+    // form flame graph tools read: a line for each, giving the statements
+    // it is nested in, outermost first, then it, then its own cycles.
+    void report_stacks(std::ostream &o, const vm_program &p, const std::string &text) const;
+
+private:
+    const int *origin = nullptr;
+    std::vector<uint64_t> counts; // by instruction
+    std::vector<uint64_t> spent;  // by statement, after those spent in no
+                                  // statement's code
+    int current = -1;             // statement whose code is running
+    uint64_t then = 0;            // when control came into it
+
+    void charge(int next)
+    {
+        uint64_t now = cycles();
+        spent[current + 1] += now - then;
+        then = now;
+        current = next;
+    }
+};
+
+// Runs the program as run() does, gathering a profile of the run.
+bool run(const vm_program &p, run_profile &profile, std::istream &in, std::ostream &out,
+         std::ostream &diag = std::cerr);
+
+// The same, stopping the run with a runtime error once past the limits.
+bool run(const vm_program &p, run_profile &profile, const vm_limits &limits, std::istream &in,
+         std::ostream &out, std::ostream &diag = std::cerr);
+
+#endif
@@ -0,0 +1,123 @@
+/* Push-style parsing.
+   The parse runs on a ucontext of its own, reading through this object
+   as a streambuf.  underflow() is where it runs out of input: it swaps
+   back to whoever called push(), and when the next push() swaps in
+   again, it points the get area at the new bytes.  A parse abandoned
+   before it is done is unwound with an exception thrown from
+   underflow(), so that everything on its stack is destroyed.
+*/
+
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "parse.hpp"
+#include "push.hpp"
+
+namespace
+{
+
+// Thrown through the parser to unwind a parse that will never finish.
+struct abandoned
+{
+};
+
+thread_local push_parser *starting; // makecontext() passes only ints
+
+// Stack the parser takes for each level of nesting, with room to spare,
+// and what it takes besides, with the scanner and the streams.
+const size_t level_bytes = 512, base_bytes = 32 * 1024;
+
+} // namespace
+
+push_parser::push_parser(std::ostream &out, std::ostream &diag, size_t stack_size)
+    : out(out), diag(diag), stack_size(stack_size)
+{
+    size_t levels = stack_size > base_bytes ? (stack_size - base_bytes) / level_bytes : 0;
+    depth = int(std::min<size_t>(levels, MAX_DEPTH));
+    // A page below the stack is left unmapped, so that running off the
+    // end of it faults rather than overwriting something.
+    size_t page = sysconf(_SC_PAGESIZE);
+    stack = mmap(nullptr, stack_size + page, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED)
+        throw std::bad_alloc();
+    mprotect(stack, page, PROT_NONE);
+    getcontext(&fiber);
+    fiber.uc_stack.ss_sp = static_cast<char *>(stack) + page;
+    fiber.uc_stack.ss_size = stack_size;
+    fiber.uc_link = nullptr;
+    makecontext(&fiber, &push_parser::run, 0);
+}
+
+push_parser::~push_parser()
+{
+    if (started && !finished)
+    {
+        abandon = true;
+        resume();
+    }
+    munmap(stack, stack_size + sysconf(_SC_PAGESIZE));
+}
+
+void push_parser::run()
+{
+    push_parser *self = starting;
+    try
+    {
+        std::istream in(self);
+        in.exceptions(std::ios::badbit); // so that abandoned gets through
+        parser p(in, self->out, self->diag);
+        p.limit_depth(self->depth);
+        p.program();
+        self->statements = p.tree();
+    }
+    catch (abandoned &)
+    {
+    }
+    self->finished = true;
+    swapcontext(&self->fiber, &self->caller);
+}
+
+void push_parser::resume()
+{
+    if (!started)
+    {
+        started = true;
+        starting = this;
+    }
+    swapcontext(&caller, &fiber);
+}
+
+std::streambuf::int_type push_parser::underflow()
+{
+    // All that was pushed is used up: wait for more, unless there is no
+    // more to come.
+    if (!at_eof)
+    {
+        swapcontext(&fiber, &caller);
+        if (abandon)
+            throw abandoned();
+    }
+    if (gptr() == egptr())
+        return traits_type::eof();
+    return traits_type::to_int_type(*gptr());
+}
+
+void push_parser::push(const char *buf, size_t len)
+{
+    if (finished || at_eof || len == 0)
+        return;
+    char *p = const_cast<char *>(buf);
+    setg(p, p, p + len);
+    resume();
+}
+
+void push_parser::finish()
+{
+    if (finished)
+        return;
+    at_eof = true;
+    setg(nullptr, nullptr, nullptr);
+    resume();
+}
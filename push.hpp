@@ -0,0 +1,76 @@
+/* Push-style parsing: the program is handed to the parser a piece at a
+   time, as it arrives, rather than pulled by the scanner from a stream
+   that blocks.  Each parse runs on a small stack of its own, and when
+   the scanner runs out of input, mid-token or mid-production, the parse
+   is suspended and push() returns; the next push() resumes it where it
+   stopped.  One thread can so keep any number of parses going at once.
+   The output is exactly that of parser::program() on the whole program.
+*/
+
+#ifndef PUSH_HPP
+#define PUSH_HPP
+
+#include <cstddef>
+#include <iostream>
+#include <streambuf>
+#include <ucontext.h>
+#include <vector>
+
+#include "ast.hpp"
+
+class push_parser : private std::streambuf
+{
+public:
+    // Prints the trace to out and diagnostics to diag as the parse goes.
+    // The stack bounds how deeply the program may nest: deeper than it
+    // holds is a syntax error, as deeper than MAX_DEPTH (parse.hpp) is
+    // anyway.  The default holds MAX_DEPTH.
+    explicit push_parser(std::ostream &out = std::cout, std::ostream &diag = std::cerr,
+                         size_t stack_size = 640 * 1024);
+    ~push_parser();
+    push_parser(const push_parser &) = delete;
+    push_parser &operator=(const push_parser &) = delete;
+
+    // Parses as far as buf[0..len) allows.  Nothing of it is kept, so
+    // the caller may reuse buf when this returns.
+    void push(const char *buf, size_t len);
+
+    // There is no more input: finishes the parse.
+    void finish();
+
+    bool done() const
+    {
+        return finished;
+    }
+
+    // How deeply the program may nest, on this stack.
+    int max_depth() const
+    {
+        return depth;
+    }
+
+    // Top-level statements, once done.
+    const std::vector<stmt_ptr> &tree() const
+    {
+        return statements;
+    }
+
+private:
+    std::ostream &out;
+    std::ostream &diag;
+    void *stack;
+    size_t stack_size;
+    int depth;
+    ucontext_t caller, fiber;
+    bool started = false;
+    bool finished = false;
+    bool at_eof = false;    // finish() has been called
+    bool abandon = false;   // destroyed before done
+    std::vector<stmt_ptr> statements;
+
+    int_type underflow() override;
+    void resume();
+    static void run();
+};
+
+#endif
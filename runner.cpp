@@ -0,0 +1,172 @@
+/* Running one program over a long stream of inputs on N workers.
+   The reader cuts the stream into shards at line ends and queues them
+   for the workers.  A worker that finishes a shard hands it back, and
+   whichever worker hands back the next shard to be written writes it,
+   and any after it that are waiting, so the only lock taken is once a
+   shard.  The reader waits while too many shards are read and not yet
+   written, so that a slow shard cannot make memory grow without bound.
+*/
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "runner.hpp"
+#include "scan.hpp"
+
+namespace
+{
+
+const size_t SHARD_BYTES = 64 * 1024;
+
+struct shard
+{
+    size_t index;      // in the order of the input
+    size_t first_line; // counting from 1
+    string input;      // whole lines
+    string output, errors;
+    size_t failed = 0;
+};
+typedef std::unique_ptr<shard> shard_ptr;
+
+class shard_queue
+{
+    std::mutex lock;
+    std::condition_variable ready, room;
+    std::deque<shard_ptr> waiting;        // read, not yet run
+    std::map<size_t, shard_ptr> finished; // run, not yet written
+    size_t next = 0;                      // shard to write next
+    size_t pending = 0;                   // read, not yet written
+    size_t limit;
+    bool closed = false;
+    std::ostream &out, &diag;
+
+public:
+    size_t failed = 0;
+
+    shard_queue(size_t limit, std::ostream &out, std::ostream &diag)
+        : limit(limit), out(out), diag(diag)
+    {
+    }
+
+    void push(shard_ptr s)
+    {
+        std::unique_lock<std::mutex> hold(lock);
+        room.wait(hold, [&] { return pending < limit; });
+        pending++;
+        waiting.push_back(std::move(s));
+        ready.notify_one();
+    }
+
+    // The next shard to run, or null once all have been taken.
+    shard_ptr pop()
+    {
+        std::unique_lock<std::mutex> hold(lock);
+        ready.wait(hold, [&] { return closed || !waiting.empty(); });
+        if (waiting.empty())
+            return nullptr;
+        shard_ptr s = std::move(waiting.front());
+        waiting.pop_front();
+        return s;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        closed = true;
+        ready.notify_all();
+    }
+
+    // Takes back a shard that has been run, and writes it and those
+    // after it if it is next.
+    void finish(shard_ptr s)
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        finished[s->index] = std::move(s);
+        for (auto it = finished.begin(); it != finished.end() && it->first == next;
+             it = finished.erase(it))
+        {
+            out.write(it->second->output.data(), it->second->output.size());
+            diag << it->second->errors;
+            failed += it->second->failed;
+            next++;
+            pending--;
+            room.notify_one();
+        }
+    }
+};
+
+void work(const vm_program &p, const vm_limits &limits, shard_queue &queue)
+{
+    vm_frame frame;
+    memstream in(nullptr, nullptr);
+    std::ostringstream out, error;
+    while (shard_ptr s = queue.pop())
+    {
+        out.str("");
+        size_t line = s->first_line;
+        const char *at = s->input.data(), *end = at + s->input.size();
+        while (at < end)
+        {
+            const char *eol = static_cast<const char *>(std::memchr(at, '\n', end - at));
+            if (!eol)
+                eol = end;
+            in.reset(at, eol);
+            error.str("");
+            if (!run(p, frame, limits, in, out, error))
+            {
+                s->errors += "line " + std::to_string(line) + ": " + error.str();
+                s->failed++;
+            }
+            at = eol + 1;
+            line++;
+        }
+        s->output = out.str();
+        queue.finish(std::move(s));
+    }
+}
+
+} // namespace
+
+size_t run_lines(const vm_program &p, std::istream &in, unsigned workers, std::ostream &out,
+                 std::ostream &diag, const vm_limits &limits)
+{
+    workers = std::max(workers, 1u);
+    shard_queue queue(4 * workers, out, diag);
+    std::vector<std::thread> pool;
+    for (unsigned k = 0; k < workers; k++)
+        pool.emplace_back([&] { work(p, limits, queue); });
+
+    size_t index = 0, line = 1;
+    string carry;
+    std::vector<char> buf(SHARD_BYTES);
+    auto push = [&](size_t len) {
+        shard_ptr s(new shard);
+        s->index = index++;
+        s->first_line = line;
+        s->input.assign(carry, 0, len);
+        carry.erase(0, len);
+        line += std::count(s->input.begin(), s->input.end(), '\n');
+        queue.push(std::move(s));
+    };
+    while (in.read(buf.data(), buf.size()) || in.gcount() > 0)
+    {
+        carry.append(buf.data(), in.gcount());
+        size_t cut = carry.rfind('\n');
+        if (cut != string::npos)
+            push(cut + 1);
+    }
+    if (!carry.empty())
+        push(carry.size());
+    queue.close();
+    for (std::thread &t : pool)
+        t.join();
+    return queue.failed;
+}
@@ -0,0 +1,25 @@
+/* Running one program over a long stream of inputs on N workers.
+   Each line of the stream is the input of a run of its own.  Lines are
+   read in shards of many at a time and run by a pool of N threads, each
+   with a frame of its own and all sharing the one compiled program; the
+   output of a shard is gathered in a buffer, and whole shards are
+   written out in the order of the input.
+*/
+
+#ifndef RUNNER_HPP
+#define RUNNER_HPP
+
+#include <iostream>
+
+#include "vm.hpp"
+
+// Runs p once for each line of in, with the line as its input, on
+// workers threads.  Writes what each run writes to out, and its runtime
+// error, if any, to diag after "line N: ", all in the order of the lines,
+// just as running them one after another would.  Each run is held to
+// limits on its own.  Returns how many runs ended in an error.
+size_t run_lines(const vm_program &p, std::istream &in, unsigned workers,
+                 std::ostream &out = std::cout, std::ostream &diag = std::cerr,
+                 const vm_limits &limits = vm_limits());
+
+#endif
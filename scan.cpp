@@ -6,8 +6,6 @@
 #include <iostream>
 #include <cctype>   // isalpha, isspace, isdigit
 #include <tuple>
-using std::cerr;
-using std::cin;
 using std::hex;
 using std::endl;
 using std::string;
@@ -31,14 +29,15 @@ tuple<token, string> scanner::scan() {
     // for each bad character, 
     // skip white space
     while (isspace(c)) {
-        c = cin.get();
+        c = get();
     }
+    start = next - 1;
     if (c == EOF)
         return make_tuple(t_eof, "");
     if (isalpha(c)) {
         do {
             token_image += c;
-            c = cin.get();
+            c = get();
         } while (isalpha(c) || isdigit(c) || c == '_');
         if (token_image == "real") return make_tuple(t_real, "");
         else if (token_image == "trunc") return make_tuple(t_trunc, "");
@@ -58,31 +57,32 @@ tuple<token, string> scanner::scan() {
         // [0-9]*\.?[0-9]+([eE][-+]?[0-9]+)?
         do {
             token_image += c;
-            c = cin.get();
+            c = get();
         } while (isdigit(c));
         if (c == '.'){
             token_image += c;
-            c = cin.get();
+            c = get();
             if (isdigit(c)){
                 do {
                     token_image += c;
-                    c = cin.get();
+                    c = get();
                 } while (isdigit(c));
                 if (c == 'e'){
                     token_image += c;
-                    c = cin.get();
+                    c = get();
                     if (c == '+' || c == '-'){
                         token_image += c;
-                        c = cin.get();
+                        c = get();
                         if(!isdigit(c)){
                             // case C:
-                            cerr << "lexical error: invalid real number. got '"
+                            ++lex_errors;
+                            diag << "lexical error: invalid real number. got '"
                             <<  std::string(1, c) << "' (0x" << hex << c << ") after " << token_image << "\n";
                             return scan();
                         } else{
                             do{
                                 token_image += c;
-                                c = cin.get();
+                                c = get();
                             }while (isdigit(c));
                             return make_tuple(t_r_num, token_image);
                         }
@@ -90,12 +90,13 @@ tuple<token, string> scanner::scan() {
                         if (isdigit(c)){
                             do{
                                 token_image += c;
-                                c = cin.get();
+                                c = get();
                             }while (isdigit(c));
                             return make_tuple(t_r_num, token_image);
                         } else{
                             // case C:
-                            cerr << "lexical error: invalid real number. got '"
+                            ++lex_errors;
+                            diag << "lexical error: invalid real number. got '"
                             <<std::string(1, c) << "' (0x" << hex << c << ") after " << token_image << "\n";
                             return scan();
                         }
@@ -105,7 +106,8 @@ tuple<token, string> scanner::scan() {
                 }
             } else {
                 // case C:
-                cerr << "lexical error: invalid real number. got '"
+                ++lex_errors;
+                diag << "lexical error: invalid real number. got '"
                      << std::string(1, c) << "' (0x" << hex << c << ") after " << token_image << "\n";
                 return scan();
             }
@@ -114,62 +116,65 @@ tuple<token, string> scanner::scan() {
         }
     } else switch (c) {
         case ':':
-            c = cin.get();
+            c = get();
             if (c != '=') {
                 // case C:
-                cerr << "lexical error: expected '=' after ':', got '"
+                ++lex_errors;
+                diag << "lexical error: expected '=' after ':', got '"
                      <<  std::string(1, c) << "' (0x" << hex << c << ")\n";
                 return scan();
             } else {
-                c = cin.get();
+                c = get();
                 return make_tuple(t_gets, "");
             }
             break;
         case '=':
-            c = cin.get();
+            c = get();
             if (c != '=') {
                 // case C:
-                cerr << "lexical error: expected '=' after ':', got '"
+                ++lex_errors;
+                diag << "lexical error: expected '=' after ':', got '"
                      << std::string(1, c) << "' (0x" << hex << c << ")\n";
                 return scan();
             } else {
-                c = cin.get();
+                c = get();
                 return make_tuple(t_equal, "");
             }
             break;
         case '<':
-            c = cin.get();
+            c = get();
             if(c == '>'){
-                c = cin.get();
+                c = get();
                 return make_tuple(t_not_equal, "");
             } 
             else if(c == '='){
-                c = cin.get();
+                c = get();
                 return make_tuple(t_less_or_equal, "");
             }
             else {return make_tuple(t_less, "");}
             break;
         case '>':
-            c = cin.get();
+            c = get();
             if (c == '=') {
-                c = cin.get();
+                c = get();
                 return make_tuple(t_greater_or_equal, "");
             } else {
                 return make_tuple(t_greater, "");
             }
             break;
-        case '+': c = cin.get(); return make_tuple(t_add, "");
-        case '-': c = cin.get(); return make_tuple(t_sub, "");
-        case '*': c = cin.get(); return make_tuple(t_mul, "");
-        case '/': c = cin.get(); return make_tuple(t_div, "");
-        case '(': c = cin.get(); return make_tuple(t_lparen, "");
-        case ')': c = cin.get(); return make_tuple(t_rparen, "");
-        case ';': c = cin.get(); return make_tuple(t_semicolon, "");
+        case '+': c = get(); return make_tuple(t_add, "");
+        case '-': c = get(); return make_tuple(t_sub, "");
+        case '*': c = get(); return make_tuple(t_mul, "");
+        case '/': c = get(); return make_tuple(t_div, "");
+        case '(': c = get(); return make_tuple(t_lparen, "");
+        case ')': c = get(); return make_tuple(t_rparen, "");
+        case ';': c = get(); return make_tuple(t_semicolon, "");
         default:   
             // case A:
-            cerr << "lexical error: began with unexpected character '"
+            ++lex_errors;
+            diag << "lexical error: began with unexpected character '"
                  << std::string(1, c) << "' (0x" << hex << c << ")\n";
-            c = cin.get();
+            c = get();
             return scan();
     }
 }
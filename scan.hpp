@@ -2,12 +2,18 @@
    Michael L. Scott, 2008-2022.
 */
 
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+#include <iostream>
+#include <streambuf>
+#include <string>
 #include <tuple>
 using std::tuple;
 using std::string;
 
-enum token {t_int, t_id, t_gets, t_real, t_trunc, t_lparen, t_rparen, t_float, 
-            t_read, t_write, t_if, t_then, t_end, t_while, t_do, t_i_num, t_r_num, 
+enum token {t_int, t_id, t_gets, t_real, t_trunc, t_lparen, t_rparen, t_float,
+            t_read, t_write, t_if, t_then, t_end, t_while, t_do, t_i_num, t_r_num,
             t_equal, t_not_equal, t_less, t_greater, t_less_or_equal, t_greater_or_equal,
             t_add, t_sub, t_mul, t_div, t_semicolon, t_eof
             };
@@ -15,8 +21,39 @@ enum token {t_int, t_id, t_gets, t_real, t_trunc, t_lparen, t_rparen, t_float,
 const int MAX_TOKEN_LEN = 256;
 extern char token_image[MAX_TOKEN_LEN];
 
+// An istream over bytes that are already in memory, so the scanner can
+// run over a slice of a larger buffer without copying it.
+class memstream : private std::streambuf, public std::istream {
+public:
+    memstream(const char *begin, const char *end) : std::istream(this) {
+        reset(begin, end);
+    }
+    // Starts over on other bytes, as a new memstream would, but without
+    // the cost of constructing an istream.
+    void reset(const char *begin, const char *end) {
+        setg(const_cast<char *>(begin), const_cast<char *>(begin),
+             const_cast<char *>(end));
+        clear();
+    }
+};
+
 class scanner {
     int c = ' ';
+    std::istream &in;
+    std::ostream &diag;
+    size_t next = 0;        // number of characters read so far
+    size_t start = 0;       // offset of the most recent token
+    int lex_errors = 0;
+    int get() { ++next; return in.get(); }
 public:
+    scanner(std::istream &in = std::cin, std::ostream &diag = std::cerr)
+        : in(in), diag(diag) {}
     tuple<token, string> scan();
+    // Byte offsets, relative to the start of the stream, of the first
+    // character of the last token and of the character just past it.
+    size_t token_start() const { return start; }
+    size_t token_end() const { return next - 1; }
+    int errors() const { return lex_errors; }
 };
+
+#endif
@@ -0,0 +1,508 @@
+/* A parse server on a Unix domain socket.
+   The event loop owns the connections.  It reads what each client sends,
+   and hands a program, once all of it has come, to the workers; it takes
+   a connection's next program only when the answer to its last one has
+   come back, so answers go out in order.  Workers put their answers on
+   a queue and wake the loop through an eventfd.
+
+   What a client can make the server hold is bounded.  A connection holds
+   at most MAX_PENDING bytes received and not handed on, and the loop
+   stops reading from it until they go to a worker; and its next program
+   goes to a worker only once the answers before it have gone out, so a
+   client that sends and does not read is soon left waiting to send.
+   When the server runs out of descriptors, it stops accepting until a
+   connection closes or a moment has passed, rather than spin on a
+   listener that stays readable.
+*/
+
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "parse.hpp"
+#include "server.hpp"
+
+namespace
+{
+
+// Longest length line a client may send before its newline.
+const size_t MAX_HEADER = 20;
+
+// Most a connection holds received and not yet handed on.
+const size_t MAX_PENDING = MAX_HEADER + 1 + MAX_PROGRAM;
+
+// How long accepting waits, having run out of descriptors, if no
+// connection closes first.
+const int ACCEPT_RETRY_MS = 100;
+
+// Output appended to a string, which keeps its capacity from one program
+// to the next.
+class string_buf : public std::streambuf
+{
+    string &s;
+
+    int_type overflow(int_type c) override
+    {
+        if (c == traits_type::eof())
+            return 0;
+        s.push_back(char(c));
+        return c;
+    }
+    std::streamsize xsputn(const char *p, std::streamsize n) override
+    {
+        s.append(p, n);
+        return n;
+    }
+
+public:
+    explicit string_buf(string &s) : s(s) {}
+};
+
+// What a worker keeps from one program to the next.
+class worker_state
+{
+    string trace, diagnostics;
+    string_buf out_buf{trace}, diag_buf{diagnostics};
+    std::ostream out{&out_buf}, diag{&diag_buf};
+
+public:
+    // Parses program and appends the answer to reply.
+    void parse(const string &program, string &reply)
+    {
+        trace.clear();
+        diagnostics.clear();
+        memstream in(program.data(), program.data() + program.size());
+        parser p(in, out, diag);
+        p.program();
+        diag.setf(std::ios::dec, std::ios::basefield); // the scanner leaves it in hex
+        reply += std::to_string(trace.size()) + ' ' + std::to_string(diagnostics.size()) + '\n';
+        reply += trace;
+        reply += diagnostics;
+    }
+};
+
+struct job
+{
+    uint64_t id; // of the connection
+    string text; // the program, or the answer
+};
+
+// Programs waiting for a worker, and answers waiting for the loop.
+class queues
+{
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<job> programs, answers;
+    bool stopping = false;
+    int wake;
+
+public:
+    explicit queues(int wake) : wake(wake) {}
+
+    void submit(job j)
+    {
+        {
+            std::lock_guard<std::mutex> hold(lock);
+            programs.push_back(std::move(j));
+        }
+        ready.notify_one();
+    }
+
+    // The next program, or false once the server is stopping.
+    bool next(job &j)
+    {
+        std::unique_lock<std::mutex> hold(lock);
+        ready.wait(hold, [&] { return stopping || !programs.empty(); });
+        if (stopping)
+            return false;
+        j = std::move(programs.front());
+        programs.pop_front();
+        return true;
+    }
+
+    void answer(job j)
+    {
+        {
+            std::lock_guard<std::mutex> hold(lock);
+            answers.push_back(std::move(j));
+        }
+        uint64_t one = 1;
+        if (::write(wake, &one, sizeof one) < 0)
+            return; // only if the counter would overflow, and then the loop will look
+    }
+
+    std::deque<job> take_answers()
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        std::deque<job> taken;
+        taken.swap(answers);
+        return taken;
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> hold(lock);
+            stopping = true;
+        }
+        ready.notify_all();
+    }
+};
+
+struct connection
+{
+    int fd;
+    string in;            // received and not yet handed on
+    string out;           // answers not yet sent
+    size_t sent = 0;      // of out
+    bool busy = false;    // a program of its is with a worker
+    bool full = false;    // in is at MAX_PENDING, so reading waits
+    bool drained = false; // the client will send no more
+    bool broken = false;  // by a bad frame or a failed write
+    bool writing = false; // waiting for the socket to take more
+};
+
+// Ids in epoll events that are not connections.
+enum : uint64_t
+{
+    LISTENER,
+    WAKE,
+    SIGNALS,
+    FIRST_CONNECTION
+};
+
+class event_loop
+{
+    int epoll, listener, wake, signals;
+    queues &work;
+    std::ostream &diag;
+    std::unordered_map<uint64_t, connection> connections;
+    uint64_t next_id = FIRST_CONNECTION;
+    bool accepting = true;
+    int accept_error = 0; // the last reported, so that it is not repeated
+
+    void watch(int op, int fd, uint64_t id, uint32_t events)
+    {
+        epoll_event ev = {};
+        ev.events = events;
+        ev.data.u64 = id;
+        epoll_ctl(epoll, op, fd, &ev);
+    }
+
+    // Watches for what the connection can still do.
+    void interest(uint64_t id, connection &c)
+    {
+        uint32_t events =
+            (c.drained || c.full ? 0 : EPOLLIN | EPOLLRDHUP) | (c.writing ? EPOLLOUT : 0);
+        watch(EPOLL_CTL_MOD, c.fd, id, events);
+    }
+
+    void accept_all()
+    {
+        while (true)
+        {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd >= 0)
+            {
+                connections[next_id].fd = fd;
+                watch(EPOLL_CTL_ADD, fd, next_id++, EPOLLIN | EPOLLRDHUP);
+                accept_error = 0;
+            }
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            else if (errno != EINTR && errno != ECONNABORTED)
+            {
+                // Out of descriptors or memory, most likely.  The client
+                // waits in the backlog.
+                if (errno != accept_error)
+                    diag << "cannot accept: " << std::strerror(errno) << std::endl;
+                accept_error = errno;
+                watch_listener(false);
+                return;
+            }
+        }
+    }
+
+    void watch_listener(bool on)
+    {
+        accepting = on;
+        watch(EPOLL_CTL_MOD, listener, LISTENER, on ? EPOLLIN : 0);
+    }
+
+    // Hands on the connection's next program, if it has all come, the
+    // last one has been answered, and the answers have gone out.
+    void dispatch(uint64_t id, connection &c)
+    {
+        if (c.busy || c.broken || c.writing)
+            return;
+        size_t eol = c.in.find('\n');
+        if (eol == string::npos)
+        {
+            if (c.in.size() > MAX_HEADER)
+                c.broken = true;
+            return;
+        }
+        char *end;
+        unsigned long long length = std::strtoull(c.in.c_str(), &end, 10);
+        if (eol == 0 || eol > MAX_HEADER || end != c.in.c_str() + eol || !isdigit((unsigned char)c.in[0]) ||
+            length > MAX_PROGRAM)
+        {
+            c.broken = true;
+            return;
+        }
+        if (c.in.size() - eol - 1 < length)
+            return;
+        job j = {id, c.in.substr(eol + 1, length)};
+        c.in.erase(0, eol + 1 + length);
+        c.busy = true;
+        work.submit(std::move(j));
+        if (c.full && c.in.size() < MAX_PENDING)
+        {
+            c.full = false;
+            interest(id, c);
+        }
+    }
+
+    void receive(uint64_t id, connection &c)
+    {
+        char buf[64 * 1024];
+        while (true)
+        {
+            if (c.in.size() >= MAX_PENDING)
+            {
+                // The rest waits in the socket until a worker takes this.
+                c.full = true;
+                interest(id, c);
+                break;
+            }
+            ssize_t n = ::read(c.fd, buf, std::min(sizeof buf, MAX_PENDING - c.in.size()));
+            if (n > 0)
+                c.in.append(buf, n);
+            else if (n < 0 && errno == EINTR)
+                continue;
+            else if (n == 0)
+            {
+                // Programs already sent are still answered.
+                c.drained = true;
+                interest(id, c);
+                break;
+            }
+            else
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    c.broken = true;
+                break;
+            }
+        }
+        dispatch(id, c);
+    }
+
+    void send(uint64_t id, connection &c)
+    {
+        while (c.sent < c.out.size())
+        {
+            ssize_t n = ::send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL);
+            if (n >= 0)
+                c.sent += n;
+            else if (errno == EINTR)
+                continue;
+            else
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    c.broken = true;
+                    c.out.clear();
+                    c.sent = 0;
+                }
+                break;
+            }
+        }
+        if (c.sent == c.out.size())
+        {
+            c.out.clear();
+            c.sent = 0;
+        }
+        bool more = !c.out.empty();
+        if (more != c.writing)
+        {
+            c.writing = more;
+            interest(id, c);
+            if (!more)
+                dispatch(id, c);
+        }
+    }
+
+    void collect_answers()
+    {
+        uint64_t count;
+        if (::read(wake, &count, sizeof count) < 0)
+            count = 0; // nothing new since the last look, but no harm in another
+        for (job &j : work.take_answers())
+        {
+            auto it = connections.find(j.id);
+            if (it == connections.end())
+                continue;
+            connection &c = it->second;
+            c.busy = false;
+            if (c.out.empty())
+                c.out.swap(j.text);
+            else
+                c.out += j.text;
+            send(j.id, c);
+            dispatch(j.id, c);
+            settle(j.id);
+        }
+    }
+
+    // Drops the connection if nothing more will come of it.
+    void settle(uint64_t id)
+    {
+        auto it = connections.find(id);
+        if (it == connections.end())
+            return;
+        connection &c = it->second;
+        if (!c.busy && (c.broken || (c.drained && c.out.empty())))
+        {
+            ::close(c.fd);
+            connections.erase(it);
+            if (!accepting)
+                watch_listener(true);
+        }
+    }
+
+public:
+    event_loop(int epoll, int listener, int wake, int signals, queues &work, std::ostream &diag)
+        : epoll(epoll), listener(listener), wake(wake), signals(signals), work(work), diag(diag)
+    {
+        watch(EPOLL_CTL_ADD, listener, LISTENER, EPOLLIN);
+        watch(EPOLL_CTL_ADD, wake, WAKE, EPOLLIN);
+        watch(EPOLL_CTL_ADD, signals, SIGNALS, EPOLLIN);
+    }
+
+    ~event_loop()
+    {
+        for (auto &c : connections)
+            ::close(c.second.fd);
+    }
+
+    // Runs until a signal comes.
+    void run()
+    {
+        epoll_event events[64];
+        while (true)
+        {
+            int n = epoll_wait(epoll, events, 64, accepting ? -1 : ACCEPT_RETRY_MS);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return;
+            if (n == 0)
+                watch_listener(true);
+            for (int k = 0; k < n; k++)
+            {
+                uint64_t id = events[k].data.u64;
+                if (id == LISTENER)
+                    accept_all();
+                else if (id == WAKE)
+                    collect_answers();
+                else if (id == SIGNALS)
+                    return;
+                else
+                {
+                    auto it = connections.find(id);
+                    if (it == connections.end())
+                        continue;
+                    connection &c = it->second;
+                    if (events[k].events & (EPOLLHUP | EPOLLERR))
+                    {
+                        // Gone both ways: nothing can be answered.
+                        c.broken = true;
+                        epoll_ctl(epoll, EPOLL_CTL_DEL, c.fd, nullptr);
+                    }
+                    else
+                    {
+                        if (events[k].events & (EPOLLIN | EPOLLRDHUP))
+                            receive(id, c);
+                        if (events[k].events & EPOLLOUT)
+                            send(id, c);
+                    }
+                    settle(id);
+                }
+            }
+        }
+    }
+};
+
+} // namespace
+
+bool serve(const string &path, unsigned workers, std::ostream &diag)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof addr.sun_path)
+    {
+        diag << "socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    ::unlink(path.c_str());
+    if (listener < 0 || bind(listener, (sockaddr *)&addr, sizeof addr) < 0 ||
+        listen(listener, SOMAXCONN) < 0)
+    {
+        diag << "cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0)
+            ::close(listener);
+        return false;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr); // before the workers start, so they inherit it
+    int signals = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    int wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+
+    queues work(wake);
+    std::vector<std::thread> pool;
+    for (unsigned k = 0; k < std::max(workers, 1u); k++)
+        pool.emplace_back([&work] {
+            worker_state state;
+            job j;
+            while (work.next(j))
+            {
+                job answer = {j.id, string()};
+                state.parse(j.text, answer.text);
+                work.answer(std::move(answer));
+            }
+        });
+    {
+        event_loop loop(epoll, listener, wake, signals, work, diag);
+        loop.run();
+    }
+    work.stop();
+    for (std::thread &t : pool)
+        t.join();
+    ::close(epoll);
+    ::close(wake);
+    ::close(signals);
+    ::close(listener);
+    ::unlink(path.c_str());
+    return true;
+}
@@ -0,0 +1,40 @@
+/* A parse server, so that a client with many small programs to parse
+   pays for starting a process once rather than once a program.  Clients
+   connect to a Unix domain socket and send programs one after another,
+   each framed as a line holding its length in bytes and then the bytes:
+
+       <length>\n<program>
+
+   and the server answers each, in order, with what parse would have
+   printed for it: a line holding the sizes of the trace and of the
+   diagnostics, and then their bytes:
+
+       <trace length> <diagnostics length>\n<trace><diagnostics>
+
+   A program may be at most MAX_PROGRAM bytes long; a connection that
+   sends a longer length, or anything not framed as above, is closed.  A
+   program that nests deeper than the parser allows (MAX_DEPTH in
+   parse.hpp) is answered with that as a syntax error, as parse would
+   report it.
+
+   One thread waits on every connection with epoll; a fixed pool of
+   worker threads does the parsing, each reusing its own output buffers
+   from one program to the next.
+*/
+
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// Longest program a client may send.
+const size_t MAX_PROGRAM = 1 << 20;
+
+// Serves the socket at path, which is created afresh, with workers
+// threads parsing, until SIGINT or SIGTERM, and then removes it.
+// Returns false, having said why on diag, if it cannot be served.
+bool serve(const std::string &path, unsigned workers, std::ostream &diag = std::cerr);
+
+#endif
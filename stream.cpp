@@ -0,0 +1,37 @@
+/* Streaming parses of input with no end in sight.
+*/
+
+#include <cerrno>
+#include <unistd.h>
+
+#include "parse.hpp"
+#include "stream.hpp"
+
+std::streambuf::int_type fdstream::underflow()
+{
+    ssize_t n;
+    do
+        n = ::read(fd, buf, SIZE);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return std::streambuf::traits_type::eof();
+    setg(buf, buf, buf + n);
+    return std::streambuf::traits_type::to_int_type(buf[0]);
+}
+
+void parse_stream(std::istream &in, const std::function<void(const stmt_ptr &)> &sink,
+                  std::ostream &out, std::ostream &diag)
+{
+    scanner s(in, diag);
+    basic_parser<scanner> p(s, out, diag);
+    if (!p.start_program())
+        return;
+    bool more;
+    do
+    {
+        more = p.next_statement();
+        for (const stmt_ptr &st : p.release())
+            sink(st);
+    } while (more);
+    p.finish_program();
+}
@@ -0,0 +1,39 @@
+/* Streaming parses of input with no end in sight.  The input is read
+   through a fixed buffer, and each top-level statement is handed on as
+   soon as its ';' is matched and then forgotten, so memory stays bounded
+   however long the input runs: by the buffer, plus the largest single
+   top-level statement.
+*/
+
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <cstddef>
+#include <functional>
+#include <iostream>
+
+#include "ast.hpp"
+
+// An istream over a file descriptor, read through a buffer of fixed size
+// that is refilled in place.  The scanner never looks back, so there is
+// no need to keep any of what it has already read.
+class fdstream : private std::streambuf, public std::istream
+{
+    static const size_t SIZE = 64 * 1024;
+    int fd;
+    char buf[SIZE];
+
+    std::streambuf::int_type underflow() override;
+
+public:
+    explicit fdstream(int fd) : std::istream(this), fd(fd) {}
+};
+
+// Parses the program read from in as parser::program() would, printing
+// its trace to out and diagnostics to diag, and passing each top-level
+// statement to sink as soon as it is parsed.  The parser keeps none of
+// them.
+void parse_stream(std::istream &in, const std::function<void(const stmt_ptr &)> &sink,
+                  std::ostream &out = std::cout, std::ostream &diag = std::cerr);
+
+#endif
@@ -0,0 +1,123 @@
+/* Checking that a program is valid, and nothing more.
+*/
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "parse.hpp"
+#include "validate.hpp"
+
+bool validate(std::istream &in, std::ostream &diag)
+{
+    // A run of bad characters can draw more than one lexical error from
+    // a single scan; only the first is kept.
+    std::ostringstream errors;
+    std::ostream discard(nullptr);
+    scanner s(in, errors);
+    validator<scanner> p(s, discard, errors);
+    p.program();
+    if (!p.failed())
+        return true;
+    string first = errors.str();
+    first.erase(std::min(first.find('\n'), first.size()));
+    diag << "byte " << s.token_start() << ": " << first << std::endl;
+    return false;
+}
+
+namespace
+{
+
+// Files being read at once.
+const unsigned IN_FLIGHT = 64;
+
+struct file_text
+{
+    size_t index;
+    string text;
+    int error;
+};
+
+// Files read and waiting to be checked.  The readers wait while it is
+// full, so that reading cannot run far ahead of checking.
+class file_queue
+{
+    static const size_t LIMIT = 1024;
+    std::mutex lock;
+    std::condition_variable not_empty, not_full;
+    std::deque<file_text> files;
+    bool closed = false;
+
+public:
+    void push(file_text f)
+    {
+        std::unique_lock<std::mutex> hold(lock);
+        not_full.wait(hold, [&] { return files.size() < LIMIT; });
+        files.push_back(std::move(f));
+        not_empty.notify_one();
+    }
+
+    // The next file, or false once all have been taken.
+    bool pop(file_text &f)
+    {
+        std::unique_lock<std::mutex> hold(lock);
+        not_empty.wait(hold, [&] { return closed || !files.empty(); });
+        if (files.empty())
+            return false;
+        f = std::move(files.front());
+        files.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        closed = true;
+        not_empty.notify_all();
+    }
+};
+
+} // namespace
+
+size_t validate_files(const std::vector<string> &paths, unsigned workers, read_method how,
+                      std::ostream &diag)
+{
+    std::vector<string> reports(paths.size());
+    file_queue queue;
+    std::vector<std::thread> pool;
+    for (unsigned k = 0; k < std::max(workers, 1u); k++)
+        pool.emplace_back([&] {
+            file_text f;
+            while (queue.pop(f))
+            {
+                std::ostringstream report;
+                if (f.error)
+                    report << "cannot read: " << std::strerror(f.error) << std::endl;
+                else
+                {
+                    memstream in(f.text.data(), f.text.data() + f.text.size());
+                    validate(in, report);
+                }
+                reports[f.index] = report.str();
+            }
+        });
+    read_files(paths, how, IN_FLIGHT, [&](size_t i, string &&text, int error) {
+        queue.push({i, std::move(text), error});
+    });
+    queue.close();
+    for (std::thread &t : pool)
+        t.join();
+
+    size_t invalid = 0;
+    for (size_t i = 0; i < paths.size(); i++)
+        if (!reports[i].empty())
+        {
+            diag << paths[i] << ": " << reports[i];
+            invalid++;
+        }
+    return invalid;
+}
@@ -0,0 +1,32 @@
+/* Checking that a program is valid, and nothing more.  The check stops
+   at the first lexical or syntax error, so on invalid input it takes
+   time in proportion to how far in the error is, and it prints no trace.
+*/
+
+#ifndef VALIDATE_HPP
+#define VALIDATE_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ingest.hpp"
+
+// Exit status of parse -v on a program that is not valid.  Success is 0
+// and a bad command line 2.
+const int EXIT_INVALID = 1;
+
+// Returns true if the program read from in is valid.  If not, writes one
+// line to diag: the byte offset of the token at which the check stopped,
+// and the diagnostic for the first error.
+bool validate(std::istream &in, std::ostream &diag = std::cerr);
+
+// Validates each of the files named in paths, reading them as how says
+// (ingest.hpp) with many in flight, while workers threads check those
+// already in.  Writes a line to diag for each file that is not valid or
+// cannot be read, in the order of paths, with the path in front of the
+// line validate() writes.  Returns how many there were.
+size_t validate_files(const std::vector<std::string> &paths, unsigned workers,
+                      read_method how = read_uring, std::ostream &diag = std::cerr);
+
+#endif
@@ -0,0 +1,1006 @@
+/* Lowering the SSA form to register code, and running it.
+   Blocks are laid out in order, so that control falls from a block into
+   the next where it can.  The copies for a phi are made at the end of
+   each predecessor; where the predecessor ends in a branch, those for
+   the taken edge go in a stub of their own after all the blocks.  The
+   copies into one block happen at once, in effect, so a copy whose
+   destination another still needs to read waits, and a cycle of them is
+   broken with the one spare register.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "io.hpp"
+#include "parse.hpp"
+#include "profile.hpp"
+#include "vm.hpp"
+
+const char *const vm_op_names[] = {
+    "mov", "add_i", "sub_i", "mul_i", "div_i", "add_r", "sub_r", "mul_r", "div_r",
+    "trunc", "float", "eq_i", "ne_i", "lt_i", "gt_i", "le_i", "ge_i", "eq_r", "ne_r",
+    "lt_r", "gt_r", "le_r", "ge_r", "read_i", "read_r", "write_i", "write_r", "jump",
+    "jump_if", "jump_unless", "halt",
+#define FUSE(name, first, second) #first "+" #second,
+#include "fusion.inc"
+#undef FUSE
+};
+
+namespace
+{
+
+struct fusion
+{
+    vm_op op, first, second;
+};
+
+const fusion fusions[] = {
+#define FUSE(name, first, second) {vm_##name, vm_##first, vm_##second},
+#include "fusion.inc"
+#undef FUSE
+};
+
+// Registers for values, shared by values whose lives do not overlap.
+// Liveness is found by the usual backward dataflow over the blocks, with
+// a phi's arguments live out of its predecessors rather than into its
+// block, and two values interfere if one is live where the other is
+// defined.  Each phi is then coalesced with those of its arguments it
+// does not interfere with, so that a variable updated in a loop keeps
+// one register and the copies on the loop's edges go away, and the
+// classes left are colored greedily, ints and bools apart from reals.
+class allocation
+{
+    typedef std::vector<uint64_t> bits;
+
+    const ir_program &ir;
+    size_t n;
+    std::vector<bool> allocated;            // by value: needs a register
+    std::vector<std::vector<int>> adjacent; // by value: values it interferes with
+    std::vector<int> leader;                // by value: of its class, in union-find
+    std::vector<std::vector<int>> members;  // by leader
+
+    static bool has(const bits &b, int v)
+    {
+        return b[v / 64] >> (v % 64) & 1;
+    }
+    static void set(bits &b, int v, bool on)
+    {
+        if (on)
+            b[v / 64] |= uint64_t(1) << (v % 64);
+        else
+            b[v / 64] &= ~(uint64_t(1) << (v % 64));
+    }
+
+    int find(int v)
+    {
+        while (leader[v] != v)
+            v = leader[v] = leader[leader[v]];
+        return v;
+    }
+
+    bool interfere(int a, int b)
+    {
+        a = find(a);
+        b = find(b);
+        if (members[a].size() > members[b].size())
+            std::swap(a, b);
+        for (int v : members[a])
+            for (int u : adjacent[v])
+                if (find(u) == b)
+                    return true;
+        return false;
+    }
+
+    // The values live into each block, phis left out, and out of each.
+    void liveness(std::vector<bits> &in, std::vector<bits> &out)
+    {
+        size_t words = (n + 63) / 64, blocks = ir.blocks.size();
+        in.assign(blocks, bits(words));
+        out.assign(blocks, bits(words));
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (size_t b = blocks; b-- > 0;)
+            {
+                bits live(words);
+                for (int s : ir.succs(b))
+                {
+                    for (size_t w = 0; w < words; w++)
+                        live[w] |= in[s][w];
+                    const ir_block &sb = ir.blocks[s];
+                    size_t k = std::find(sb.preds.begin(), sb.preds.end(), int(b)) - sb.preds.begin();
+                    for (int i : sb.code)
+                    {
+                        if (ir.insts[i].op != op_phi)
+                            break;
+                        int arg = ir.insts[i].args[k];
+                        if (allocated[arg])
+                            set(live, arg, true);
+                    }
+                }
+                out[b] = live;
+                for (auto i = ir.blocks[b].code.rbegin(); i != ir.blocks[b].code.rend(); ++i)
+                {
+                    const ir_inst &x = ir.insts[*i];
+                    set(live, *i, false);
+                    if (x.op != op_phi)
+                        for (int a : x.args)
+                            if (allocated[a])
+                                set(live, a, true);
+                }
+                if (live != in[b])
+                {
+                    in[b] = live;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    void interferences()
+    {
+        std::vector<bits> in, out;
+        liveness(in, out);
+        adjacent.assign(n, {});
+        auto defined = [&](int d, const bits &live) {
+            for (size_t w = 0; w < live.size(); w++)
+                for (uint64_t m = live[w]; m; m &= m - 1)
+                {
+                    int v = w * 64 + __builtin_ctzll(m);
+                    if (v != d)
+                    {
+                        adjacent[d].push_back(v);
+                        adjacent[v].push_back(d);
+                    }
+                }
+        };
+        for (size_t b = 0; b < ir.blocks.size(); b++)
+        {
+            bits live = out[b];
+            const std::vector<int> &code = ir.blocks[b].code;
+            for (auto i = code.rbegin(); i != code.rend(); ++i)
+            {
+                const ir_inst &x = ir.insts[*i];
+                if (x.op == op_phi)
+                    break;
+                set(live, *i, false);
+                if (allocated[*i])
+                    defined(*i, live);
+                for (int a : x.args)
+                    if (allocated[a])
+                        set(live, a, true);
+            }
+            // The phis are defined together, at the top of the block.
+            for (int i : code)
+                if (ir.insts[i].op == op_phi)
+                    set(live, i, true);
+            for (int i : code)
+            {
+                if (ir.insts[i].op != op_phi)
+                    break;
+                set(live, i, false);
+                defined(i, live);
+                set(live, i, true);
+            }
+        }
+    }
+
+public:
+    explicit allocation(const ir_program &ir) : ir(ir), n(ir.insts.size()), allocated(n)
+    {
+        for (const ir_block &b : ir.blocks)
+            for (int k : b.code)
+                allocated[k] = ir.insts[k].op != op_const && ir.insts[k].type != ir_void;
+    }
+
+    // Gives each value a register after first, ints and bools first and
+    // reals after them, in reg, and their types in types.  Returns the
+    // number of registers used.
+    uint32_t assign(uint32_t first, std::vector<uint32_t> &reg, std::vector<ir_type> &types)
+    {
+        interferences();
+        leader.resize(n);
+        members.assign(n, {});
+        for (size_t v = 0; v < n; v++)
+        {
+            leader[v] = v;
+            members[v] = {int(v)};
+        }
+        for (const ir_block &b : ir.blocks)
+            for (int k : b.code)
+            {
+                if (ir.insts[k].op != op_phi)
+                    break;
+                for (int a : ir.insts[k].args)
+                    if (allocated[a] && find(a) != find(k) && !interfere(a, k))
+                    {
+                        int x = find(a), y = find(k);
+                        if (members[x].size() < members[y].size())
+                            std::swap(x, y);
+                        leader[y] = x;
+                        members[x].insert(members[x].end(), members[y].begin(), members[y].end());
+                        members[y].clear();
+                    }
+            }
+
+        // Color the classes, in the order their first values are defined.
+        // A value that is an argument of a phi stays off the registers of
+        // the block's other phis where it can, since the copies into them
+        // would otherwise form a cycle, which takes another copy to break.
+        std::vector<std::vector<int>> feeds(n); // by value: phis it is an argument of
+        for (const ir_block &b : ir.blocks)
+            for (int k : b.code)
+            {
+                if (ir.insts[k].op != op_phi)
+                    break;
+                for (int a : ir.insts[k].args)
+                    feeds[a].push_back(k);
+            }
+        std::vector<int> color(n, -1); // by leader
+        uint32_t used[2] = {0, 0};     // colors, for ints and for reals
+        for (const ir_block &b : ir.blocks)
+            for (int k : b.code)
+                if (allocated[k] && color[find(k)] == -1)
+                {
+                    int c = find(k);
+                    int group = ir.insts[k].type == ir_real;
+                    std::vector<bool> taken(used[group] + 1), avoided(used[group] + 1);
+                    for (int v : members[c])
+                    {
+                        for (int u : adjacent[v])
+                        {
+                            int other = color[find(u)];
+                            if (other >= 0 && (ir.insts[u].type == ir_real) == group)
+                                taken[other] = true;
+                        }
+                        for (int phi : feeds[v])
+                            for (int u : ir.blocks[ir.insts[phi].block].code)
+                            {
+                                if (ir.insts[u].op != op_phi)
+                                    break;
+                                int other = color[find(u)];
+                                if (u != phi && find(u) != c && other >= 0 &&
+                                    (ir.insts[u].type == ir_real) == group)
+                                    avoided[other] = true;
+                            }
+                    }
+                    size_t pick = 0;
+                    while (taken[pick] || avoided[pick])
+                        pick++;
+                    color[c] = pick;
+                    used[group] = std::max(used[group], uint32_t(pick + 1));
+                }
+        for (size_t v = 0; v < n; v++)
+            if (allocated[v])
+            {
+                bool real = ir.insts[v].type == ir_real;
+                reg[v] = first + (real ? used[0] : 0) + color[find(v)];
+            }
+        types.insert(types.end(), used[0], ir_int);
+        types.insert(types.end(), used[1], ir_real);
+        return used[0] + used[1];
+    }
+};
+
+class lowering
+{
+    const ir_program &ir;
+    bool dense;
+    vm_program p;
+    std::vector<uint32_t> reg;   // by instruction
+    std::vector<uint32_t> label; // by block
+    uint32_t spare = 0;
+    int origin = -1;             // of what is being emitted
+
+    // Jumps to blocks, and to stubs, whose addresses are not known yet.
+    struct fixup
+    {
+        size_t at;
+        int block, stub;
+    };
+    std::vector<fixup> fixups;
+    std::vector<std::pair<int, int>> stubs; // edges from, to
+
+    void emit(vm_op op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0)
+    {
+        p.code.push_back({op, a, b, c});
+        p.origin.push_back(origin);
+    }
+
+    void jump_to(vm_op op, uint32_t cond, int block, int stub = -1)
+    {
+        fixups.push_back({p.code.size(), block, stub});
+        if (op == vm_jump)
+            emit(op);
+        else
+            emit(op, cond);
+    }
+
+    // The copies for the phis of to, coming from from.
+    std::vector<std::pair<uint32_t, uint32_t>> edge(int from, int to)
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> copies; // destination, source
+        const ir_block &b = ir.blocks[to];
+        size_t k = 0;
+        while (b.preds[k] != from)
+            k++;
+        for (int i : b.code)
+        {
+            if (ir.insts[i].op != op_phi)
+                break;
+            if (reg[i] != reg[ir.insts[i].args[k]])
+                copies.emplace_back(reg[i], reg[ir.insts[i].args[k]]);
+        }
+        return copies;
+    }
+
+    void copy(std::vector<std::pair<uint32_t, uint32_t>> copies)
+    {
+        while (!copies.empty())
+        {
+            auto read = [&](uint32_t r) {
+                for (auto &c : copies)
+                    if (c.second == r)
+                        return true;
+                return false;
+            };
+            auto ready = std::find_if(copies.begin(), copies.end(),
+                                      [&](const std::pair<uint32_t, uint32_t> &c) {
+                                          return !read(c.first);
+                                      });
+            if (ready == copies.end())
+            {
+                // A cycle: save a destination first.
+                uint32_t d = copies.front().first;
+                emit(vm_mov, spare, d);
+                for (auto &c : copies)
+                    if (c.second == d)
+                        c.second = spare;
+                continue;
+            }
+            emit(vm_mov, ready->first, ready->second);
+            copies.erase(ready);
+        }
+    }
+
+    void block(int b)
+    {
+        label[b] = p.code.size();
+        for (int k : ir.blocks[b].code)
+        {
+            const ir_inst &in = ir.insts[k];
+            bool real = in.type == ir_real;
+            origin = in.stmt;
+            uint32_t x = in.args.size() > 0 ? reg[in.args[0]] : 0;
+            uint32_t y = in.args.size() > 1 ? reg[in.args[1]] : 0;
+            switch (in.op)
+            {
+            case op_const:
+            case op_phi:
+                break;
+            case op_copy:
+                emit(vm_mov, reg[k], x);
+                break;
+            case op_add:
+            case op_sub:
+            case op_mul:
+            case op_div:
+                emit(vm_op((real ? vm_add_r : vm_add_i) + (in.op - op_add)), reg[k], x, y);
+                break;
+            case op_trunc:
+                emit(vm_trunc, reg[k], x);
+                break;
+            case op_float:
+                emit(vm_float, reg[k], x);
+                break;
+            case op_eq:
+            case op_ne:
+            case op_lt:
+            case op_gt:
+            case op_le:
+            case op_ge:
+                real = ir.insts[in.args[0]].type == ir_real;
+                emit(vm_op((real ? vm_eq_r : vm_eq_i) + (in.op - op_eq)), reg[k], x, y);
+                break;
+            case op_read:
+                emit(real ? vm_read_r : vm_read_i, reg[k]);
+                break;
+            case op_write:
+                emit(ir.insts[in.args[0]].type == ir_real ? vm_write_r : vm_write_i, x);
+                break;
+            case op_jump:
+                copy(edge(b, in.target[0]));
+                if (in.target[0] != b + 1)
+                    jump_to(vm_jump, 0, in.target[0]);
+                break;
+            case op_branch:
+            {
+                int t = in.target[0], f = in.target[1];
+                auto taken = edge(b, t), not_taken = edge(b, f);
+                if (t == b + 1 && not_taken.empty())
+                {
+                    jump_to(vm_jump_unless, x, f);
+                    copy(taken);
+                    break;
+                }
+                if (taken.empty())
+                    jump_to(vm_jump_if, x, t);
+                else
+                {
+                    jump_to(vm_jump_if, x, t, stubs.size());
+                    stubs.emplace_back(b, t);
+                }
+                copy(not_taken);
+                if (f != b + 1)
+                    jump_to(vm_jump, 0, f);
+                break;
+            }
+            case op_halt:
+                emit(vm_halt);
+                break;
+            }
+        }
+    }
+
+public:
+    lowering(const ir_program &ir, bool dense) : ir(ir), dense(dense) {}
+
+    vm_program lower()
+    {
+        reg.assign(ir.insts.size(), 0);
+        label.assign(ir.blocks.size(), 0);
+        p.statements = ir.statements;
+
+        // Constants first, one register for each distinct one.
+        std::map<std::pair<int, int64_t>, uint32_t> constants;
+        for (const ir_block &b : ir.blocks)
+            for (int k : b.code)
+                if (ir.insts[k].op == op_const)
+                {
+                    const ir_inst &in = ir.insts[k];
+                    vm_value v;
+                    if (in.type == ir_real)
+                        v.r = in.r;
+                    else
+                        v.i = in.i;
+                    auto it = constants.emplace(std::make_pair(in.type, v.i), p.constants.size());
+                    if (it.second)
+                    {
+                        p.constants.push_back(v);
+                        p.types.push_back(in.type);
+                    }
+                    reg[k] = it.first->second;
+                }
+        p.registers = p.constants.size();
+        if (dense)
+            p.registers += allocation(ir).assign(p.registers, reg, p.types);
+        else
+            for (const ir_block &b : ir.blocks)
+                for (int k : b.code)
+                    if (ir.insts[k].op != op_const && ir.insts[k].type != ir_void)
+                    {
+                        reg[k] = p.registers++;
+                        p.types.push_back(ir.insts[k].type);
+                    }
+        spare = p.registers++;
+        p.types.push_back(ir_void);
+
+        for (size_t b = 0; b < ir.blocks.size(); b++)
+            block(b);
+        std::vector<uint32_t> stub_label;
+        for (auto &s : stubs)
+        {
+            stub_label.push_back(p.code.size());
+            origin = ir.insts[ir.blocks[s.first].code.back()].stmt;
+            copy(edge(s.first, s.second));
+            jump_to(vm_jump, 0, s.second);
+        }
+        for (const fixup &f : fixups)
+        {
+            uint32_t to = f.stub >= 0 ? stub_label[f.stub] : label[f.block];
+            if (p.code[f.at].op == vm_jump)
+                p.code[f.at].a = to;
+            else
+                p.code[f.at].b = to;
+        }
+        return std::move(p);
+    }
+};
+
+bool fail(std::ostream &diag, const char *message)
+{
+    diag << "runtime error: " << message << std::endl;
+    return false;
+}
+
+} // namespace
+
+vm_program lower(const ir_program &ir, bool dense)
+{
+    return lowering(ir, dense).lower();
+}
+
+vm_op unfused(vm_op op)
+{
+    for (const fusion &f : fusions)
+        if (f.op == op)
+            return f.first;
+    return op;
+}
+
+void fuse(vm_program &p)
+{
+    std::vector<bool> target(p.code.size() + 1);
+    for (const vm_inst &x : p.code)
+        if (x.op == vm_jump)
+            target[x.a] = true;
+        else if (x.op == vm_jump_if || x.op == vm_jump_unless)
+            target[x.b] = true;
+    for (size_t k = 0; k + 1 < p.code.size(); k++)
+    {
+        if (target[k + 1])
+            continue;
+        for (const fusion &f : fusions)
+            if (f.first == p.code[k].op && f.second == p.code[k + 1].op)
+            {
+                p.code[k].op = f.op;
+                k++;
+                break;
+            }
+    }
+}
+
+bool compile(std::istream &in, vm_program &p, bool optimized, std::ostream &diag)
+{
+    scanner s(in, diag);
+    std::ostream discard(nullptr);
+    basic_parser<scanner, no_probe, no_trace, fail_fast> parse(s, discard, diag);
+    parse.program();
+    diag.setf(std::ios::dec, std::ios::basefield); // the scanner leaves it in hex
+    ir_program ir;
+    if (parse.failed() || !build_ir(parse.tree(), ir, diag))
+        return false;
+    if (optimized)
+        optimize(ir);
+    p = lower(ir);
+    if (optimized)
+        fuse(p);
+    return true;
+}
+
+namespace
+{
+
+// Frames kept between runs that are not given one, a pool to a thread.  A
+// run takes the frame on top and puts it back when done, so that a run
+// started while another is, by a stream the other writes to, gets a
+// frame of its own.
+class frame_pool
+{
+    std::vector<std::unique_ptr<vm_frame>> idle;
+
+public:
+    // A frame of the thread's pool, for as long as it lives.
+    class lease
+    {
+        frame_pool &pool;
+        std::unique_ptr<vm_frame> f;
+
+    public:
+        explicit lease(frame_pool &pool) : pool(pool)
+        {
+            if (pool.idle.empty())
+                f.reset(new vm_frame);
+            else
+            {
+                f = std::move(pool.idle.back());
+                pool.idle.pop_back();
+            }
+        }
+        ~lease()
+        {
+            pool.idle.push_back(std::move(f));
+        }
+        vm_frame &frame()
+        {
+            return *f;
+        }
+    };
+};
+
+thread_local frame_pool pool;
+
+// How many instructions to run between looks at the clock.
+const uint64_t CLOCK_STRIDE = 1 << 16;
+
+// Enforces a run's limits at the back edges of loops.  Between checks,
+// the VM compares the count of instructions run with next, and calls
+// check() only once past it.
+class guard
+{
+    uint64_t budget;
+    bool timed;
+    std::chrono::steady_clock::time_point deadline;
+
+public:
+    uint64_t next;
+
+    explicit guard(const vm_limits &limits)
+        : budget(limits.instructions ? limits.instructions : UINT64_MAX),
+          timed(limits.time.count() > 0),
+          deadline(timed ? std::chrono::steady_clock::now() + limits.time
+                         : std::chrono::steady_clock::time_point()),
+          next(timed ? std::min(budget, CLOCK_STRIDE) : budget)
+    {
+    }
+
+    // Whether the run may go on, having run n instructions; if not, says
+    // why on diag.
+    template <class IO>
+    bool check(uint64_t n, const vm_limits &limits, IO &output, std::ostream &diag)
+    {
+        if (n >= budget)
+        {
+            output.flush();
+            diag << "runtime error: ran out of its budget of " << limits.instructions
+                 << " instructions" << std::endl;
+            return false;
+        }
+        if (timed && std::chrono::steady_clock::now() >= deadline)
+        {
+            output.flush();
+            diag << "runtime error: ran out of its time of "
+                 << std::chrono::duration_cast<std::chrono::milliseconds>(limits.time).count()
+                 << " ms" << std::endl;
+            return false;
+        }
+        next = timed ? std::min(budget, n + CLOCK_STRIDE) : budget;
+        return true;
+    }
+};
+
+// A run's reads and writes as text on streams, through the frame's blocks.
+class stream_io
+{
+    value_output output;
+    value_input input;
+
+public:
+    stream_io(vm_frame &frame, std::istream &in, std::ostream &out)
+        : output(out, &frame.output), input(in, &output, &frame.input)
+    {
+    }
+
+    template <class T>
+    const char *read(T &v)
+    {
+        return input.read(v);
+    }
+
+    template <class T>
+    void write(T v)
+    {
+        output.write(v);
+    }
+
+    void flush()
+    {
+        output.flush();
+    }
+};
+
+// A run's reads and writes as values, through a caller's vm_values.
+class values_io
+{
+    vm_values &io;
+
+public:
+    explicit values_io(vm_values &io) : io(io) {}
+
+    const char *read(int64_t &v)
+    {
+        vm_value x;
+        const char *wrong = io.read(x, ir_int);
+        v = x.i;
+        return wrong;
+    }
+
+    const char *read(double &v)
+    {
+        vm_value x;
+        const char *wrong = io.read(x, ir_real);
+        v = x.r;
+        return wrong;
+    }
+
+    void write(int64_t v)
+    {
+        vm_value x;
+        x.i = v;
+        io.write(x, ir_int);
+    }
+
+    void write(double v)
+    {
+        vm_value x;
+        x.r = v;
+        io.write(x, ir_real);
+    }
+
+    void flush() {}
+};
+
+class no_vm_probe
+{
+public:
+    void start() {}
+    void step(uint32_t) {}
+    void stop() {}
+};
+
+// A run of a program: the loop that runs the code, reading and writing
+// through io, and telling probe of each instruction it is about to run.
+// Each opcode's work is a function of its own, so that a superinstruction
+// can do the work of both its halves with no dispatch between them.
+template <class Probe, class IO>
+class machine
+{
+    const vm_limits &limits;
+    std::ostream &diag;
+    Probe &probe;
+    vm_value *r;
+    const vm_inst *code, *pc;
+    uint64_t n = 0;
+    guard limit;
+    IO &io;
+    bool ok = true, running = true;
+
+    void stop(const char *message)
+    {
+        io.flush();
+        ok = running = fail(diag, message);
+    }
+
+    template <vm_op OP>
+    void exec(const vm_inst &x)
+    {
+        // Ints wrap around, as unsigned arithmetic does.
+        if constexpr (OP == vm_mov)
+            r[x.a] = r[x.b];
+        else if constexpr (OP == vm_add_i)
+            r[x.a].i = int64_t(uint64_t(r[x.b].i) + uint64_t(r[x.c].i));
+        else if constexpr (OP == vm_sub_i)
+            r[x.a].i = int64_t(uint64_t(r[x.b].i) - uint64_t(r[x.c].i));
+        else if constexpr (OP == vm_mul_i)
+            r[x.a].i = int64_t(uint64_t(r[x.b].i) * uint64_t(r[x.c].i));
+        else if constexpr (OP == vm_div_i)
+        {
+            if (r[x.c].i == 0)
+                stop("division by zero");
+            else if (r[x.c].i == -1) // INT64_MIN / -1 overflows
+                r[x.a].i = int64_t(0 - uint64_t(r[x.b].i));
+            else
+                r[x.a].i = r[x.b].i / r[x.c].i;
+        }
+        else if constexpr (OP == vm_add_r)
+            r[x.a].r = r[x.b].r + r[x.c].r;
+        else if constexpr (OP == vm_sub_r)
+            r[x.a].r = r[x.b].r - r[x.c].r;
+        else if constexpr (OP == vm_mul_r)
+            r[x.a].r = r[x.b].r * r[x.c].r;
+        else if constexpr (OP == vm_div_r)
+            r[x.a].r = r[x.b].r / r[x.c].r;
+        else if constexpr (OP == vm_trunc)
+        {
+            if (!(r[x.b].r >= -9223372036854775808.0 && r[x.b].r < 9223372036854775808.0))
+                stop("trunc of a real out of the range of int");
+            else
+                r[x.a].i = int64_t(r[x.b].r);
+        }
+        else if constexpr (OP == vm_float)
+            r[x.a].r = double(r[x.b].i);
+        else if constexpr (OP == vm_eq_i)
+            r[x.a].i = r[x.b].i == r[x.c].i;
+        else if constexpr (OP == vm_ne_i)
+            r[x.a].i = r[x.b].i != r[x.c].i;
+        else if constexpr (OP == vm_lt_i)
+            r[x.a].i = r[x.b].i < r[x.c].i;
+        else if constexpr (OP == vm_gt_i)
+            r[x.a].i = r[x.b].i > r[x.c].i;
+        else if constexpr (OP == vm_le_i)
+            r[x.a].i = r[x.b].i <= r[x.c].i;
+        else if constexpr (OP == vm_ge_i)
+            r[x.a].i = r[x.b].i >= r[x.c].i;
+        else if constexpr (OP == vm_eq_r)
+            r[x.a].i = r[x.b].r == r[x.c].r;
+        else if constexpr (OP == vm_ne_r)
+            r[x.a].i = r[x.b].r != r[x.c].r;
+        else if constexpr (OP == vm_lt_r)
+            r[x.a].i = r[x.b].r < r[x.c].r;
+        else if constexpr (OP == vm_gt_r)
+            r[x.a].i = r[x.b].r > r[x.c].r;
+        else if constexpr (OP == vm_le_r)
+            r[x.a].i = r[x.b].r <= r[x.c].r;
+        else if constexpr (OP == vm_ge_r)
+            r[x.a].i = r[x.b].r >= r[x.c].r;
+        else if constexpr (OP == vm_read_i || OP == vm_read_r)
+        {
+            if (const char *wrong = OP == vm_read_i ? io.read(r[x.a].i) : io.read(r[x.a].r))
+                stop(wrong);
+        }
+        else if constexpr (OP == vm_write_i)
+            io.write(r[x.a].i);
+        else if constexpr (OP == vm_write_r)
+            io.write(r[x.a].r);
+        else if constexpr (OP == vm_jump)
+        {
+            // Blocks are laid out in order, so a loop goes round by a jump
+            // back; a branch only goes forward, or to a stub.
+            if (x.a < pc - code && n >= limit.next && !limit.check(n, limits, io, diag))
+                ok = running = false;
+            else
+                pc = code + x.a;
+        }
+        else if constexpr (OP == vm_jump_if)
+        {
+            if (r[x.a].i)
+                pc = code + x.b;
+        }
+        else if constexpr (OP == vm_jump_unless)
+        {
+            if (!r[x.a].i)
+                pc = code + x.b;
+        }
+        else if constexpr (OP == vm_halt)
+            running = false;
+    }
+
+    // Runs the second half of a superinstruction, unless the first ended
+    // the run.
+    template <vm_op FIRST, vm_op SECOND>
+    void fused(const vm_inst &x)
+    {
+        exec<FIRST>(x);
+        if constexpr (FIRST == vm_div_i || FIRST == vm_trunc || FIRST == vm_read_i ||
+                      FIRST == vm_read_r)
+            if (!running)
+                return;
+        probe.step(pc - code);
+        n++;
+        exec<SECOND>(*pc++);
+    }
+
+public:
+    machine(const vm_program &p, vm_frame &frame, const vm_limits &limits, IO &io,
+            std::ostream &diag, Probe &probe)
+        : limits(limits), diag(diag), probe(probe), limit(limits), io(io)
+    {
+        if (frame.registers.size() < p.registers)
+            frame.registers.resize(p.registers);
+        std::copy(p.constants.begin(), p.constants.end(), frame.registers.begin());
+        r = frame.registers.data();
+        code = pc = p.code.data();
+    }
+
+    bool run(uint64_t *executed)
+    {
+        probe.start();
+        while (running)
+        {
+            probe.step(pc - code);
+            const vm_inst &x = *pc++;
+            n++;
+            switch (x.op)
+            {
+#define OP(name)                                                                                   \
+    case vm_##name:                                                                                \
+        exec<vm_##name>(x);                                                                        \
+        break;
+                OP(mov) OP(add_i) OP(sub_i) OP(mul_i) OP(div_i) OP(add_r) OP(sub_r) OP(mul_r)
+                OP(div_r) OP(trunc) OP(float) OP(eq_i) OP(ne_i) OP(lt_i) OP(gt_i) OP(le_i)
+                OP(ge_i) OP(eq_r) OP(ne_r) OP(lt_r) OP(gt_r) OP(le_r) OP(ge_r) OP(read_i)
+                OP(read_r) OP(write_i) OP(write_r) OP(jump) OP(jump_if) OP(jump_unless) OP(halt)
+#undef OP
+#define FUSE(name, first, second)                                                                  \
+    case vm_##name:                                                                                \
+        fused<vm_##first, vm_##second>(x);                                                         \
+        break;
+#include "fusion.inc"
+#undef FUSE
+            }
+        }
+        probe.stop();
+        io.flush();
+        if (executed)
+            *executed += n;
+        return ok;
+    }
+};
+
+} // namespace
+
+bool run(const vm_program &p, std::istream &in, std::ostream &out, std::ostream &diag,
+         uint64_t *executed)
+{
+    frame_pool::lease lease(pool);
+    return run(p, lease.frame(), in, out, diag, executed);
+}
+
+bool run(const vm_program &p, vm_frame &frame, std::istream &in, std::ostream &out,
+         std::ostream &diag, uint64_t *executed)
+{
+    return run(p, frame, vm_limits(), in, out, diag, executed);
+}
+
+bool run(const vm_program &p, vm_frame &frame, const vm_limits &limits, std::istream &in,
+         std::ostream &out, std::ostream &diag, uint64_t *executed)
+{
+    no_vm_probe none;
+    stream_io io(frame, in, out);
+    return machine<no_vm_probe, stream_io>(p, frame, limits, io, diag, none).run(executed);
+}
+
+bool run(const vm_program &p, vm_frame &frame, vm_values &io, std::ostream &diag,
+         uint64_t *executed)
+{
+    no_vm_probe none;
+    values_io values(io);
+    vm_limits limits;
+    return machine<no_vm_probe, values_io>(p, frame, limits, values, diag, none).run(executed);
+}
+
+bool run(const vm_program &p, run_profile &profile, std::istream &in, std::ostream &out,
+         std::ostream &diag)
+{
+    return run(p, profile, vm_limits(), in, out, diag);
+}
+
+bool run(const vm_program &p, run_profile &profile, const vm_limits &limits, std::istream &in,
+         std::ostream &out, std::ostream &diag)
+{
+    frame_pool::lease lease(pool);
+    profile.reset(p);
+    stream_io io(lease.frame(), in, out);
+    return machine<run_profile, stream_io>(p, lease.frame(), limits, io, diag, profile)
+        .run(nullptr);
+}
+
+void print(std::ostream &o, const vm_program &p)
+{
+    for (size_t k = 0; k < p.constants.size(); k++)
+        o << "    r" << k << " = " << p.constants[k].i << '\n';
+    for (size_t k = 0; k < p.code.size(); k++)
+    {
+        const vm_inst &x = p.code[k];
+        o << k << ":\t" << vm_op_names[x.op];
+        switch (unfused(x.op))
+        {
+        case vm_halt:
+            break;
+        case vm_jump:
+            o << ' ' << x.a;
+            break;
+        case vm_jump_if:
+        case vm_jump_unless:
+            o << " r" << x.a << ", " << x.b;
+            break;
+        case vm_read_i:
+        case vm_read_r:
+        case vm_write_i:
+        case vm_write_r:
+            o << " r" << x.a;
+            break;
+        case vm_mov:
+        case vm_trunc:
+        case vm_float:
+            o << " r" << x.a << ", r" << x.b;
+            break;
+        default:
+            o << " r" << x.a << ", r" << x.b << ", r" << x.c;
+        }
+        o << '\n';
+    }
+}
@@ -0,0 +1,175 @@
+/* A virtual machine to run calculator programs.  The SSA form (ir.hpp)
+   is lowered to code for a register machine.  Constants are loaded into
+   the first registers before the program starts, and after them each
+   variable, in effect, gets a slot of its own: values whose lives do not
+   overlap share a register, a phi shares one with its arguments where
+   that does not cost a copy elsewhere, and what copies are left are put
+   on the edges into the phi's block.  Ints and bools have one range of
+   the registers and reals the next, and no name is looked up as a
+   program runs.
+*/
+
+#ifndef VM_HPP
+#define VM_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "io.hpp"
+#include "ir.hpp"
+
+enum vm_op : uint8_t
+{
+    vm_mov,         // r[a] = r[b]
+    vm_add_i,       // r[a] = r[b] + r[c], on ints; likewise to vm_div_i
+    vm_sub_i,
+    vm_mul_i,
+    vm_div_i,
+    vm_add_r,       // the same on reals
+    vm_sub_r,
+    vm_mul_r,
+    vm_div_r,
+    vm_trunc,       // r[a] = r[b] as an int
+    vm_float,       // r[a] = r[b] as a real
+    vm_eq_i,        // r[a] = r[b] == r[c], on ints; likewise to vm_ge_i
+    vm_ne_i,
+    vm_lt_i,
+    vm_gt_i,
+    vm_le_i,
+    vm_ge_i,
+    vm_eq_r,        // the same on reals
+    vm_ne_r,
+    vm_lt_r,
+    vm_gt_r,
+    vm_le_r,
+    vm_ge_r,
+    vm_read_i,      // r[a] = the next input
+    vm_read_r,
+    vm_write_i,     // output r[a]
+    vm_write_r,
+    vm_jump,        // to a
+    vm_jump_if,     // to b if r[a]
+    vm_jump_unless, // to b unless r[a]
+    vm_halt,
+    // Superinstructions, made by fuse(): each does what its first half
+    // would with its own operands, then what the next instruction would.
+#define FUSE(name, first, second) vm_##name,
+#include "fusion.inc"
+#undef FUSE
+};
+
+extern const char *const vm_op_names[];
+
+// The first half of a superinstruction, or any other opcode itself.
+vm_op unfused(vm_op op);
+
+struct vm_inst
+{
+    vm_op op;
+    uint32_t a, b, c;
+};
+
+union vm_value
+{
+    int64_t i; // ints, and bools as 0 or 1
+    double r;
+};
+
+struct vm_program
+{
+    std::vector<vm_inst> code;            // entered at 0
+    std::vector<vm_value> constants;      // the first registers start with these
+    uint32_t registers = 0;               // in all
+    std::vector<ir_type> types;           // of each register; ir_void for the one
+                                          // that holds either, to break cycles
+    std::vector<ir_statement> statements; // of the source, as in ir_program
+    std::vector<int> origin;              // by instruction: the statement it
+                                          // runs for, or -1
+};
+
+// Lowers a program built by build_ir(), optimized or not.  If dense,
+// values whose lives do not overlap share registers, and a phi shares
+// one with its arguments where it can, as a variable would; ints and
+// bools have the registers after the constants, and reals those after
+// them.  Otherwise each value has a register of its own.
+vm_program lower(const ir_program &ir, bool dense = true);
+
+// Joins pairs of instructions into superinstructions where fusion.inc
+// has one for them, the first does not jump and the second is not jumped
+// to.  The second keeps its place and its operands, so addresses do not
+// change, and code that does not know superinstructions can run the
+// first as unfused() says.
+void fuse(vm_program &p);
+
+// Parses the program read from in, builds its IR, optimizes it if asked
+// to, and lowers it into p, fusing its instructions too if optimized.
+// Returns false, having written diagnostics to diag, if the program is
+// not valid, in which case only the first lexical or syntax error is
+// reported, or breaks a rule of the language.
+bool compile(std::istream &in, vm_program &p, bool optimized = true,
+             std::ostream &diag = std::cerr);
+
+// What a run has of its own: the registers, and the blocks its input and
+// output go through.  A program is not changed by running it, so it may
+// be run on many threads at once, each run in a frame of its own.  A
+// frame may be used for one run after another, of any program, and grows
+// to the largest; once it has, starting a run in it allocates nothing.
+struct vm_frame
+{
+    std::vector<vm_value> registers;
+    io_block input, output;
+};
+
+// Runs the program, reading the values it reads from in and writing
+// those it writes to out, one to a line.  Returns false, having written
+// a line to diag, on a runtime error or input that is not a number of
+// the type read.  Adds the number of instructions run to *executed.
+// The run takes a frame from a pool kept by each thread, and gives it
+// back when done.
+bool run(const vm_program &p, std::istream &in, std::ostream &out,
+         std::ostream &diag = std::cerr, uint64_t *executed = nullptr);
+
+// The same, in the given frame.
+bool run(const vm_program &p, vm_frame &frame, std::istream &in, std::ostream &out,
+         std::ostream &diag = std::cerr, uint64_t *executed = nullptr);
+
+// Bounds on a run, for programs that cannot be trusted to stop.  They are
+// checked only where control goes back to the top of a loop, which is
+// the only way a program can keep running; a run may go past them by as
+// much as the code does between one loop and the next.  Time is checked
+// every so many instructions, and a run waiting for input is not stopped.
+// The VM allocates nothing as a program runs, so its memory is bounded
+// by the program's registers.
+struct vm_limits
+{
+    uint64_t instructions = 0;        // to run at most, or 0 for no bound
+    std::chrono::nanoseconds time{0}; // to run for at most, or 0 for no bound
+};
+
+// The same, stopping the run with a runtime error once past the limits.
+bool run(const vm_program &p, vm_frame &frame, const vm_limits &limits, std::istream &in,
+         std::ostream &out, std::ostream &diag = std::cerr, uint64_t *executed = nullptr);
+
+// Where a run takes the values it reads and puts those it writes, for a
+// caller that has them as values rather than as text.
+class vm_values
+{
+public:
+    // Reads the next value, of type t, into v, or says what is wrong.
+    virtual const char *read(vm_value &v, ir_type t) = 0;
+    virtual void write(vm_value v, ir_type t) = 0;
+
+protected:
+    ~vm_values() = default;
+};
+
+// The same as run() in the given frame, reading and writing through io.
+bool run(const vm_program &p, vm_frame &frame, vm_values &io, std::ostream &diag = std::cerr,
+         uint64_t *executed = nullptr);
+
+// Prints the code, an instruction to a line, for reading.
+void print(std::ostream &o, const vm_program &p);
+
+#endif